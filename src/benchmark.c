@@ -0,0 +1,507 @@
+#define _GNU_SOURCE
+#include <unistd.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <time.h>
+#include <signal.h>
+#include <stdint.h>
+#include <sys/wait.h>
+
+/* benchmark: замер конвейера parent -> каналы -> обработчики (make bench).
+   Для каждого набора строк генерируется вход, parent запускается без диалога (-o шаблон),
+   вход подаётся в его stdin, а stdout читается одновременно.
+   Каждая строка начинается с метки - своего номера (8 шестнадцатеричных цифр) и пробела.
+   В выводе метка стоит в конце строки задом наперёд; по ней считается задержка строки:
+   от записи её конца в stdin до появления в stdout. Вход подаётся без пауз, поэтому это
+   задержка под полной нагрузкой (вместе с очередями в каналах).
+   Пиковая память - VmHWM из /proc, который опрашивается во время работы (ru_maxrss из wait4
+   не годится: он учитывает память benchmark, унаследованную до exec). Последний замер - когда
+   весь вход отдан, но stdin ещё открыт: до EOF parent не закрывает каналы, и обработчики
+   гарантированно работают, даже если прогон короче периода опроса. Если замерить parent или
+   обработчиков (в режиме --threads они в памяти parent) не удалось, память - null, а прогон
+   считается неудачным.
+   Результаты выводятся таблицей и дописываются в файл по объекту JSON на строку,
+   чтобы прогоны можно было сравнивать. */
+
+#define TAG_LEN 8            // Цифр в метке строки
+#define IO_CHUNK (1 << 20)   // Порция записи в stdin и чтения из stdout
+#define SAMPLE_MS 20         // Период опроса памяти обработчиков
+#define MAX_PROCS 64         // Обработчиков, за памятью которых следим
+#define OUT_TEMPLATE "bench_out%d.txt"
+
+/* bench_case: набор строк. Длина - без метки и '\n', равномерно в [min_len, max_len]. */
+struct bench_case
+{
+    const char *name;
+    size_t lines;
+    size_t min_len, max_len;
+    int utf8; // Вперемешку ASCII и 2-, 3-, 4-байтные символы; parent запускается с -u
+};
+
+static const struct bench_case cases[] = {
+    {"tiny", 2000000, 0, 8, 0},                   // Строки короче метки - накладные расходы на строку
+    {"line80", 500000, 71, 71, 0},                // 80 символов вместе с меткой
+    {"line64k", 512, 65536 - 10, 65536 - 10, 0},  // 64 КиБ вместе с меткой и '\n'
+    {"multimb", 8, 4 << 20, 4 << 20, 0},          // Строки по 4 МиБ
+    {"utf8mix", 300000, 20, 300, 1},
+};
+
+/* now_ns: монотонное время в наносекундах */
+static uint64_t now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+}
+
+static uint64_t rng = 0x9e3779b97f4a7c15ull; // Одинаковый вход от прогона к прогону
+
+/* rnd: xorshift64* */
+static uint64_t rnd(void)
+{
+    rng ^= rng >> 12;
+    rng ^= rng << 25;
+    rng ^= rng >> 27;
+    return rng * 0x2545f4914f6cdd1dull;
+}
+
+/* put_payload: len байт содержимого строки (без '\n') */
+static void put_payload(char *p, size_t len, int utf8)
+{
+    static const char *wide[] = {"ж", "ё", "é", "文", "中", "€", "😀"}; // 2, 2, 2, 3, 3, 3, 4 байта
+    size_t i = 0;
+    while (i < len)
+    {
+        uint64_t r = rnd();
+        if (utf8 && (r & 3) == 0) // Примерно каждый четвёртый символ - многобайтный
+        {
+            const char *c = wide[(r >> 8) % (sizeof(wide) / sizeof(wide[0]))];
+            size_t n = strlen(c);
+            if (i + n <= len)
+            {
+                memcpy(p + i, c, n);
+                i += n;
+                continue;
+            }
+        }
+        p[i++] = (char)('a' + (r >> 16) % 26);
+    }
+}
+
+/* generate: вход набора c (scale - множитель числа строк). Возвращает буфер (malloc). */
+static char *generate(const struct bench_case *c, double scale, size_t *nlines, size_t *size)
+{
+    size_t n = (size_t)((double)c->lines * scale);
+    if (n == 0)
+        n = 1;
+    size_t cap = n * (TAG_LEN + 1 + c->max_len + 1);
+    char *buf = malloc(cap);
+    if (!buf)
+        return NULL;
+    char *p = buf;
+    for (size_t k = 0; k < n; ++k)
+    {
+        size_t len = c->min_len + (c->max_len > c->min_len ? rnd() % (c->max_len - c->min_len + 1) : 0);
+        char tag[TAG_LEN + 2];
+        snprintf(tag, sizeof(tag), "%08zx ", k & 0xffffffffu);
+        memcpy(p, tag, TAG_LEN + 1);
+        p += TAG_LEN + 1;
+        put_payload(p, len, c->utf8);
+        p += len;
+        *p++ = '\n';
+    }
+    *nlines = n;
+    *size = (size_t)(p - buf);
+    return buf;
+}
+
+/* hwm_kb: VmHWM процесса в КиБ (0 - процесса уже нет) */
+static long hwm_kb(pid_t pid)
+{
+    char path[64], line[256];
+    snprintf(path, sizeof(path), "/proc/%d/status", (int)pid);
+    FILE *f = fopen(path, "r");
+    if (!f)
+        return 0;
+    long kb = 0;
+    while (fgets(line, sizeof(line), f))
+        if (sscanf(line, "VmHWM: %ld", &kb) == 1)
+            break;
+    fclose(f);
+    return kb;
+}
+
+/* procs: пиковая память обработчиков (дочерних процессов parent) */
+struct procs
+{
+    pid_t pid[MAX_PROCS];
+    long kb[MAX_PROCS];
+    int n;
+    long parent_kb;
+};
+
+/* sample: обновляет пики parent и его дочерних процессов */
+static void sample(struct procs *ps, pid_t parent)
+{
+    long kb = hwm_kb(parent);
+    if (kb > ps->parent_kb)
+        ps->parent_kb = kb;
+    char path[64];
+    snprintf(path, sizeof(path), "/proc/%d/task/%d/children", (int)parent, (int)parent);
+    FILE *f = fopen(path, "r");
+    if (!f)
+        return;
+    int pid;
+    while (fscanf(f, "%d", &pid) == 1)
+    {
+        kb = hwm_kb(pid);
+        if (kb == 0) // Уже завершился (у зомби памяти нет) - не замер
+            continue;
+        int i = 0;
+        while (i < ps->n && ps->pid[i] != pid)
+            i++;
+        if (i == ps->n)
+        {
+            if (ps->n == MAX_PROCS)
+                continue;
+            ps->pid[ps->n] = pid;
+            ps->kb[ps->n++] = 0;
+        }
+        if (kb > ps->kb[i])
+            ps->kb[i] = kb;
+    }
+    fclose(f);
+}
+
+/* tag_of: номер строки по её последним TAG_LEN байтам (метка задом наперёд); -1 - не метка */
+static long tag_of(const char *last)
+{
+    long v = 0;
+    for (int i = TAG_LEN - 1; i >= 0; --i)
+    {
+        char c = last[i];
+        int d = c >= '0' && c <= '9' ? c - '0' : c >= 'a' && c <= 'f' ? c - 'a' + 10 : -1;
+        if (d < 0)
+            return -1;
+        v = v * 16 + d;
+    }
+    return v;
+}
+
+/* result: итог одного прогона */
+struct result
+{
+    double seconds;
+    size_t got;         // Строк с меткой в выводе
+    size_t out_bytes;   // Байт в stdout
+    double p50_ms, p99_ms;
+    int status;         // Код завершения parent
+    long parent_kb;
+    struct procs ps;
+};
+
+static int cmp_u64(const void *a, const void *b)
+{
+    uint64_t x = *(const uint64_t *)a, y = *(const uint64_t *)b;
+    return x < y ? -1 : x > y;
+}
+
+/* run: запускает parent с аргументами argv, подаёт buf в stdin и разбирает stdout */
+static int run(char **argv, const char *buf, size_t size, size_t nlines, struct result *res)
+{
+    memset(res, 0, sizeof(*res));
+    uint64_t *sent = malloc(nlines * sizeof(*sent));  // Когда ушёл конец строки k
+    uint64_t *lat = malloc(nlines * sizeof(*lat));    // Задержки полученных строк
+    char *rbuf = malloc(IO_CHUNK);
+    int in[2], out[2];
+    if (!sent || !lat || !rbuf || pipe2(in, O_CLOEXEC) < 0 || pipe2(out, O_CLOEXEC) < 0)
+    {
+        free(sent);
+        free(lat);
+        free(rbuf);
+        return -1;
+    }
+    int ex[2]; // Закрывается при exec: до этого VmHWM потомка - память benchmark
+    if (pipe2(ex, O_CLOEXEC) < 0)
+        ex[0] = ex[1] = -1;
+    uint64_t t0 = now_ns();
+    pid_t pid = fork();
+    if (pid == 0)
+    {
+        dup2(in[0], 0);
+        dup2(out[1], 1);
+        execv("./parent", argv);
+        _exit(127);
+    }
+    close(in[0]);
+    close(out[1]);
+    if (ex[0] >= 0)
+    {
+        char c;
+        close(ex[1]);
+        while (read(ex[0], &c, 1) < 0 && errno == EINTR)
+            ;
+        close(ex[0]);
+    }
+    fcntl(in[1], F_SETFL, O_NONBLOCK);
+    fcntl(out[0], F_SETFL, O_NONBLOCK);
+
+    size_t pos = 0, sent_lines = 0;
+    char tail[TAG_LEN] = {0}; // Последние байты прошлой порции вывода
+    uint64_t last_sample = 0;
+    int in_fd = in[1];
+    while (1)
+    {
+        struct pollfd pfd[2] = {{out[0], POLLIN, 0}, {in_fd, POLLOUT, 0}};
+        if (poll(pfd, in_fd >= 0 ? 2 : 1, SAMPLE_MS) < 0 && errno != EINTR)
+            break;
+        uint64_t t = now_ns();
+        if (t - last_sample >= SAMPLE_MS * 1000000ull)
+        {
+            sample(&res->ps, pid);
+            last_sample = t;
+        }
+        if (in_fd >= 0 && pfd[1].revents)
+        {
+            size_t n = size - pos < IO_CHUNK ? size - pos : IO_CHUNK;
+            ssize_t w = write(in_fd, buf + pos, n);
+            if (w > 0)
+            {
+                t = now_ns();
+                const char *p = buf + pos, *e = p + w, *nl;
+                while (p < e && (nl = memchr(p, '\n', (size_t)(e - p))) != NULL)
+                {
+                    sent[sent_lines++] = t;
+                    p = nl + 1;
+                }
+                pos += (size_t)w;
+            }
+            if ((w < 0 && errno != EAGAIN && errno != EINTR) || pos == size) // Всё отдано или parent упал
+            {
+                sample(&res->ps, pid); // Обработчики ещё работают: каналы закроются только после EOF
+                close(in_fd);
+                in_fd = -1;
+            }
+        }
+        if (pfd[0].revents)
+        {
+            ssize_t r = read(out[0], rbuf, IO_CHUNK);
+            if (r == 0)
+                break;
+            if (r < 0)
+            {
+                if (errno == EAGAIN || errno == EINTR)
+                    continue;
+                break;
+            }
+            t = now_ns();
+            res->out_bytes += (size_t)r;
+            const char *p = rbuf, *e = rbuf + r, *nl;
+            while (p < e && (nl = memchr(p, '\n', (size_t)(e - p))) != NULL)
+            {
+                char last[TAG_LEN];
+                size_t have = (size_t)(nl - rbuf);
+                if (have >= TAG_LEN)
+                    memcpy(last, nl - TAG_LEN, TAG_LEN);
+                else // Метка начиналась в прошлой порции
+                {
+                    memcpy(last, tail + TAG_LEN - (TAG_LEN - have), TAG_LEN - have);
+                    memcpy(last + TAG_LEN - have, rbuf, have);
+                }
+                long k = tag_of(last);
+                if (k >= 0 && (size_t)k < sent_lines && res->got < nlines)
+                    lat[res->got++] = t - sent[k];
+                p = nl + 1;
+            }
+            if ((size_t)r >= TAG_LEN) // Запоминаем хвост для метки на границе порций
+                memcpy(tail, e - TAG_LEN, TAG_LEN);
+            else
+            {
+                memmove(tail, tail + r, TAG_LEN - (size_t)r);
+                memcpy(tail + TAG_LEN - r, rbuf, (size_t)r);
+            }
+        }
+    }
+    if (in_fd >= 0)
+        close(in_fd);
+    close(out[0]);
+    int st = 0;
+    while (waitpid(pid, &st, 0) < 0 && errno == EINTR)
+        ;
+    res->seconds = (double)(now_ns() - t0) / 1e9;
+    res->status = WIFEXITED(st) ? WEXITSTATUS(st) : 128 + WTERMSIG(st);
+    res->parent_kb = res->ps.parent_kb;
+    if (res->got > 0)
+    {
+        qsort(lat, res->got, sizeof(*lat), cmp_u64);
+        res->p50_ms = (double)lat[res->got / 2] / 1e6;
+        res->p99_ms = (double)lat[res->got * 99 / 100] / 1e6;
+    }
+    free(sent);
+    free(lat);
+    free(rbuf);
+    return 0;
+}
+
+/* json_str: строка JSON (аргументы parent - без кавычек и управляющих символов на практике) */
+static void json_str(FILE *f, const char *s)
+{
+    fputc('"', f);
+    for (; *s; ++s)
+    {
+        if (*s == '"' || *s == '\\')
+            fputc('\\', f);
+        if ((unsigned char)*s >= 0x20)
+            fputc(*s, f);
+    }
+    fputc('"', f);
+}
+
+static void usage(void)
+{
+    fprintf(stderr, "Usage: benchmark [-o RESULTS] [-s SCALE] [-c CASE]... [-- PARENT_ARGS...]\n"
+                    "  -o RESULTS  append one JSON object per case to RESULTS (default bench.json)\n"
+                    "  -s SCALE    multiply the number of lines in every case (default 1)\n"
+                    "  -c CASE     run only the named case (tiny, line80, line64k, multimb, utf8mix)\n"
+                    "  PARENT_ARGS extra parent options, e.g. -- -j 4 --io-uring\n");
+}
+
+int main(int argc, char *argv[])
+{
+    const char *results = "bench.json";
+    double scale = 1.0;
+    const char *only[16];
+    int nonly = 0;
+    int opt;
+    while ((opt = getopt(argc, argv, "o:s:c:h")) != -1)
+    {
+        if (opt == 'o')
+            results = optarg;
+        else if (opt == 's')
+            scale = atof(optarg);
+        else if (opt == 'c' && nonly < 16)
+            only[nonly++] = optarg;
+        else
+        {
+            usage();
+            return opt == 'h' ? 0 : 1;
+        }
+    }
+    if (scale <= 0)
+    {
+        usage();
+        return 1;
+    }
+    char **extra = argv + optind; // Аргументы для parent после "--"
+    int nextra = argc - optind;
+    int threads = 0; // Обработчики - потоки parent: отдельных процессов для замера памяти нет
+    for (int i = 0; i < nextra; ++i)
+        threads |= strcmp(extra[i], "--threads") == 0;
+    signal(SIGPIPE, SIG_IGN); // parent может завершиться раньше, чем прочитает вход
+
+    /* Общая часть командной строки: "-o шаблон" вместо диалога, плюс аргументы пользователя */
+    char args_str[1024] = "";
+    for (int i = 0; i < nextra; ++i)
+    {
+        strncat(args_str, extra[i], sizeof(args_str) - strlen(args_str) - 2);
+        if (i + 1 < nextra)
+            strcat(args_str, " ");
+    }
+
+    FILE *json = fopen(results, "a");
+    if (!json)
+    {
+        perror(results);
+        return 1;
+    }
+    int failed = 0;
+    printf("%-8s %9s %12s %8s %12s %9s %9s %9s  %s\n", "case", "lines", "MB", "sec", "lines/s", "MB/s",
+           "p50 ms", "p99 ms", "peak RSS KiB (parent; workers)");
+    for (size_t ci = 0; ci < sizeof(cases) / sizeof(cases[0]); ++ci)
+    {
+        const struct bench_case *c = &cases[ci];
+        int want = nonly == 0;
+        for (int i = 0; i < nonly; ++i)
+            want |= strcmp(only[i], c->name) == 0;
+        if (!want)
+            continue;
+
+        size_t nlines, size;
+        char *buf = generate(c, scale, &nlines, &size);
+        if (!buf)
+        {
+            fprintf(stderr, "%s: out of memory\n", c->name);
+            failed = 1;
+            continue;
+        }
+        char *pargv[64];
+        int na = 0;
+        pargv[na++] = "parent";
+        pargv[na++] = "-o";
+        pargv[na++] = OUT_TEMPLATE;
+        if (c->utf8)
+            pargv[na++] = "-u";
+        for (int i = 0; i < nextra && na < 63; ++i)
+            pargv[na++] = extra[i];
+        pargv[na] = NULL;
+
+        struct result r;
+        if (run(pargv, buf, size, nlines, &r) < 0)
+        {
+            fprintf(stderr, "%s: failed to start parent\n", c->name);
+            free(buf);
+            failed = 1;
+            continue;
+        }
+        free(buf);
+        for (int i = 1; i <= MAX_PROCS; ++i) // Выходные файлы обработчиков больше не нужны
+        {
+            char name[64];
+            snprintf(name, sizeof(name), OUT_TEMPLATE, i);
+            unlink(name);
+        }
+
+        /* Все строки должны вернуться, parent - завершиться успешно, а память - быть замерена */
+        int ok = r.status == 0 && r.got == nlines;
+        if (!ok)
+            fprintf(stderr, "%s: parent exit %d, %zu of %zu lines came back\n", c->name, r.status, r.got, nlines);
+        int rss_ok = r.parent_kb > 0 && (r.ps.n > 0 || threads);
+        if (!rss_ok)
+        {
+            fprintf(stderr, "%s: peak memory of %s not measured\n", c->name, r.parent_kb > 0 ? "workers" : "parent");
+            ok = 0;
+        }
+        failed |= !ok;
+        double mb = (double)size / 1e6;
+        char parent_kb[24] = "null", workers[64 * 12] = "null";
+        if (r.parent_kb > 0)
+            snprintf(parent_kb, sizeof(parent_kb), "%ld", r.parent_kb);
+        if (rss_ok)
+        {
+            int len = snprintf(workers, sizeof(workers), "[");
+            for (int i = 0; i < r.ps.n; ++i)
+                len += snprintf(workers + len, sizeof(workers) - (size_t)len, i ? ", %ld" : "%ld", r.ps.kb[i]);
+            snprintf(workers + len, sizeof(workers) - (size_t)len, "]");
+        }
+        printf("%-8s %9zu %12.1f %8.2f %12.0f %9.1f %9.3f %9.3f  %s; %s\n", c->name, nlines, mb, r.seconds,
+               (double)nlines / r.seconds, mb / r.seconds, r.p50_ms, r.p99_ms, parent_kb, workers);
+        fflush(stdout);
+
+        fprintf(json, "{\"time\": %ld, \"case\": ", (long)time(NULL));
+        json_str(json, c->name);
+        fprintf(json, ", \"args\": ");
+        json_str(json, args_str);
+        fprintf(json,
+                ", \"lines\": %zu, \"bytes\": %zu, \"seconds\": %.4f, \"lines_per_s\": %.0f, \"mb_per_s\": %.2f"
+                ", \"p50_ms\": %.4f, \"p99_ms\": %.4f, \"rss_parent_kb\": %s, \"rss_workers_kb\": %s, \"ok\": %s}\n",
+                nlines, size, r.seconds, (double)nlines / r.seconds, mb / r.seconds, r.p50_ms, r.p99_ms, parent_kb,
+                workers, ok ? "true" : "false");
+        fflush(json);
+    }
+    fclose(json);
+    return failed;
+}
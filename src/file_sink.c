@@ -0,0 +1,200 @@
+#define _GNU_SOURCE
+#include <unistd.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+
+#include "file_sink.h"
+#include "stats.h"
+
+int fs_parse_sync(const char *s, struct fs_conf *c)
+{
+    if (strcmp(s, "none") == 0)
+        c->sync = FS_SYNC_NONE;
+    else if (strcmp(s, "close") == 0)
+        c->sync = FS_SYNC_CLOSE;
+    else if (strncmp(s, "periodic", 8) == 0 && (s[8] == '\0' || s[8] == ':'))
+    {
+        c->sync = FS_SYNC_PERIODIC;
+        c->sync_bytes = FS_DEFAULT_SYNC_BYTES;
+        if (s[8] == ':')
+        {
+            char *end;
+            unsigned long long mib = strtoull(s + 9, &end, 10);
+            if (*end != '\0' || mib == 0)
+                return -1;
+            c->sync_bytes = mib * 1024 * 1024;
+        }
+    }
+    else
+        return -1;
+    return 0;
+}
+
+/* direct_off: дальше - через страничный кэш (хвост не кратен блоку или ФС отвергла запись) */
+static void direct_off(struct file_sink *fs)
+{
+    int fl = fcntl(fs->fd, F_GETFL);
+    if (fl >= 0)
+        fcntl(fs->fd, F_SETFL, fl & ~O_DIRECT);
+    fs->direct = 0;
+}
+
+int fs_init(struct file_sink *fs, int fd, const struct fs_conf *conf)
+{
+    memset(fs, 0, sizeof(*fs));
+    fs->fd = fd;
+    fs->conf = *conf;
+    fs->st_sync = st_entry("file.sync");
+    if (posix_memalign((void **)&fs->buf, FS_ALIGN, FS_BLOCK) != 0)
+    {
+        fs->buf = NULL;
+        return -1;
+    }
+    off_t pos = lseek(fd, 0, SEEK_CUR);
+    fs->off = pos > 0 ? (uint64_t)pos : 0;
+    fs->synced = fs->wb_start = fs->off;
+    fs->reserved = fs->off;
+    fs->can_reserve = 1;
+    if (conf->direct && fs->off % FS_ALIGN == 0)
+    {
+        int fl = fcntl(fd, F_GETFL);
+        fs->direct = fl >= 0 && fcntl(fd, F_SETFL, fl | O_DIRECT) == 0; // tmpfs и др. откажут
+    }
+    return 0;
+}
+
+/* reserve: выделяет место под файл до end (с подсказкой - сразу под весь файл, без неё -
+   шагами не меньше FS_GROW_MIN и четверти уже выделенного), чтобы файл лёг непрерывно */
+static void reserve(struct file_sink *fs, uint64_t end)
+{
+    if (!fs->can_reserve || end <= fs->reserved)
+        return;
+    uint64_t step = fs->reserved / 4 > FS_GROW_MIN ? fs->reserved / 4 : FS_GROW_MIN;
+    uint64_t to = fs->reserved + step;
+    if (fs->conf.size_hint > to)
+        to = fs->conf.size_hint;
+    if (end > to)
+        to = end;
+    to = (to + FS_BLOCK - 1) / FS_BLOCK * FS_BLOCK;
+    /* KEEP_SIZE: размер файла не меняется - читатель не увидит нулей за концом данных */
+    if (fallocate(fs->fd, FALLOC_FL_KEEP_SIZE, (off_t)fs->reserved, (off_t)(to - fs->reserved)) < 0)
+    {
+        fs->can_reserve = 0; // Не поддерживается или нет места - дальше без выделения
+        return;
+    }
+    fs->reserved = to;
+}
+
+/* written: после записи - фоновая запись окнами и периодический fdatasync */
+static void written(struct file_sink *fs)
+{
+    uint64_t win = fs->conf.writeback_bytes;
+    while (win && !fs->direct && fs->off - fs->wb_start >= win)
+    {
+        uint64_t s = fs->wb_start;
+        sync_file_range(fs->fd, (off_t)s, (off_t)win, SYNC_FILE_RANGE_WRITE); // Окно - на диск в фоне
+        if (fs->wb_prev) // Предыдущее окно уже пишется - дожидаемся и убираем из кэша
+        {
+            uint64_t t0 = st_now();
+            sync_file_range(fs->fd, (off_t)(s - win), (off_t)win,
+                            SYNC_FILE_RANGE_WAIT_BEFORE | SYNC_FILE_RANGE_WRITE | SYNC_FILE_RANGE_WAIT_AFTER);
+            st_account(fs->st_sync, t0, 0);
+            posix_fadvise(fs->fd, (off_t)(s - win), (off_t)win, POSIX_FADV_DONTNEED);
+        }
+        fs->wb_start += win;
+        fs->wb_prev = 1;
+    }
+    if (fs->conf.sync == FS_SYNC_PERIODIC && fs->off - fs->synced >= fs->conf.sync_bytes)
+    {
+        uint64_t t0 = st_now();
+        if (fdatasync(fs->fd) < 0)
+            fs->err = 1;
+        st_account(fs->st_sync, t0, 0);
+        fs->synced = fs->off;
+    }
+}
+
+/* put: пишет n байт по текущему смещению */
+static int put(struct file_sink *fs, const char *p, size_t n)
+{
+    reserve(fs, fs->off + n);
+    while (n > 0)
+    {
+        ssize_t w = st_write(fs->fd, p, n);
+        if (w < 0 && errno == EINTR)
+            continue;
+        if (w < 0 && errno == EINVAL && fs->direct) // O_DIRECT включился, но запись не принята
+        {
+            direct_off(fs);
+            continue;
+        }
+        if (w <= 0)
+        {
+            fs->err = 1;
+            return -1;
+        }
+        p += w;
+        n -= (size_t)w;
+        fs->off += (uint64_t)w;
+    }
+    written(fs);
+    return fs->err ? -1 : 0;
+}
+
+int fs_write(struct file_sink *fs, const void *data, size_t len)
+{
+    const char *p = data;
+    while (len > 0 && !fs->err)
+    {
+        if (fs->len == 0 && len >= FS_BLOCK && !fs->direct) // Целые блоки - без копирования
+        {
+            size_t n = len - len % FS_BLOCK;
+            put(fs, p, n);
+            p += n;
+            len -= n;
+            continue;
+        }
+        size_t n = FS_BLOCK - fs->len < len ? FS_BLOCK - fs->len : len;
+        memcpy(fs->buf + fs->len, p, n);
+        fs->len += n;
+        p += n;
+        len -= n;
+        if (fs->len == FS_BLOCK)
+        {
+            put(fs, fs->buf, FS_BLOCK);
+            fs->len = 0;
+        }
+    }
+    return fs->err ? -1 : 0;
+}
+
+int fs_close(struct file_sink *fs)
+{
+    if (fs->len > 0 && !fs->err)
+    {
+        if (fs->direct) // Хвост не кратен выравниванию
+            direct_off(fs);
+        put(fs, fs->buf, fs->len);
+        fs->len = 0;
+    }
+    if (fs->reserved > fs->off) // Выделено больше, чем записано: блоки за концом освобождает усечение
+        ftruncate(fs->fd, (off_t)fs->off);
+    if (fs->conf.writeback_bytes && fs->off > fs->wb_start) // Остаток - на диск в фоне
+        sync_file_range(fs->fd, (off_t)fs->wb_start, (off_t)(fs->off - fs->wb_start), SYNC_FILE_RANGE_WRITE);
+    if (!fs->err && (fs->conf.sync == FS_SYNC_CLOSE || (fs->conf.sync == FS_SYNC_PERIODIC && fs->off > fs->synced)))
+    {
+        uint64_t t0 = st_now();
+        if (fdatasync(fs->fd) < 0)
+            fs->err = 1;
+        st_account(fs->st_sync, t0, 0);
+    }
+    return fs->err ? -1 : 0;
+}
+
+void fs_free(struct file_sink *fs)
+{
+    free(fs->buf);
+    fs->buf = NULL;
+}
@@ -0,0 +1,77 @@
+#ifndef FILE_SINK_H
+#define FILE_SINK_H
+
+#include <sys/types.h>
+#include <stdint.h>
+#include <stddef.h>
+
+/* Выходной файл обработчика. Данные копятся в выровненном буфере и пишутся блоками по
+   FS_BLOCK байт по выровненным смещениям (хвост - при закрытии), место под файл выделяется
+   заранее (fallocate) - по подсказке размера от родителя или шагами по мере роста; лишнее
+   после конца файла освобождается при закрытии.
+     direct    - запись мимо страничного кэша (O_DIRECT; если ФС его не даёт - обычная);
+     writeback - окнами по столько байт: запись окна сразу запускается в фоне
+                 (sync_file_range), а предыдущее окно дожидается и уходит из кэша
+                 (POSIX_FADV_DONTNEED) - память не растёт на многогигабайтных файлах;
+     sync      - когда данные гарантированно на диске: FS_SYNC_NONE - не требуется,
+                 FS_SYNC_PERIODIC - fdatasync каждые sync_bytes, FS_SYNC_CLOSE - при закрытии. */
+
+#define FS_BLOCK (1024 * 1024)                // Блок записи
+#define FS_ALIGN 4096                         // Выравнивание буфера и смещений для O_DIRECT
+#define FS_GROW_MIN (16ull * 1024 * 1024)     // Наименьший шаг выделения места без подсказки
+#define FS_DEFAULT_SYNC_BYTES (64ull * 1024 * 1024) // Период fdatasync по умолчанию
+
+enum fs_sync
+{
+    FS_SYNC_NONE,
+    FS_SYNC_PERIODIC,
+    FS_SYNC_CLOSE,
+};
+
+/* fs_conf: параметры файла */
+struct fs_conf
+{
+    uint64_t size_hint;       // Ожидаемый размер файла (0 - не известен)
+    int direct;               // O_DIRECT
+    enum fs_sync sync;
+    uint64_t sync_bytes;      // FS_SYNC_PERIODIC: период
+    uint64_t writeback_bytes; // Окно фоновой записи и вытеснения из кэша (0 - выключено)
+};
+
+/* fs_parse_sync: разбирает "none", "close", "periodic" или "periodic:MiB" в c.
+   Возвращает 0 или -1. */
+int fs_parse_sync(const char *s, struct fs_conf *c);
+
+/* file_sink: файл с буфером */
+struct file_sink
+{
+    int fd;
+    struct fs_conf conf;
+    char *buf;          // FS_BLOCK байт, выровнен по FS_ALIGN
+    size_t len;         // Занято в буфере
+    uint64_t off;       // Записано в файл
+    uint64_t reserved;  // Выделено место до этого смещения (fallocate)
+    int can_reserve;    // fallocate поддерживается
+    int direct;         // O_DIRECT включён
+    uint64_t synced;    // FS_SYNC_PERIODIC: смещение последнего fdatasync
+    uint64_t wb_start;  // Начало окна фоновой записи, которое ещё не запущено
+    int wb_prev;        // Окно перед ним запущено (его и нужно дождаться)
+    int st_sync;        // Запись статистики: fdatasync и ожидание фоновой записи (stats.h)
+    int err;            // Ошибка записи: дальше данные не пишутся
+};
+
+/* fs_init: fd - открытый пустой файл (смещение 0). Возвращает 0 или -1 при нехватке памяти.
+   Что не поддерживается файловой системой (fallocate, O_DIRECT), просто не используется. */
+int fs_init(struct file_sink *fs, int fd, const struct fs_conf *conf);
+
+/* fs_write: добавляет данные. 0 или -1 после ошибки записи. */
+int fs_write(struct file_sink *fs, const void *data, size_t len);
+
+/* fs_close: пишет хвост, освобождает лишнее выделенное место и выполняет политику sync.
+   Возвращает 0 или -1, если файл записан не целиком. fd не закрывается. */
+int fs_close(struct file_sink *fs);
+
+/* fs_free: освобождает буфер */
+void fs_free(struct file_sink *fs);
+
+#endif
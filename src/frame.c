@@ -0,0 +1,290 @@
+#define _GNU_SOURCE
+#include <unistd.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <sys/uio.h>
+
+#include "frame.h"
+#include "stats.h"
+
+#define FQ_MAX_SPARE 4 // Сколько отправленных фреймов держать для повторного использования
+
+void fq_init(struct frame_queue *q)
+{
+    q->head = q->tail = q->spare = NULL;
+    q->nspare = 0;
+    q->bytes = 0;
+}
+
+/* fo_free: освобождает фрейм целиком */
+static void fo_free(struct frame_out *f)
+{
+    free(f->lens);
+    free(f->data);
+    free(f);
+}
+
+void fq_free(struct frame_queue *q)
+{
+    struct frame_out *lists[2] = {q->head, q->spare};
+    for (int i = 0; i < 2; ++i)
+    {
+        struct frame_out *f = lists[i];
+        while (f)
+        {
+            struct frame_out *next = f->next;
+            fo_free(f);
+            f = next;
+        }
+    }
+    fq_init(q);
+}
+
+/* fo_size: полный размер фрейма в канале */
+static size_t fo_size(const struct frame_out *f)
+{
+    return sizeof(f->hdr) + sizeof(uint32_t) * f->hdr.count + f->hdr.bytes;
+}
+
+/* fq_recycle: возвращает отправленный фрейм в список свободных (или освобождает) */
+static void fq_recycle(struct frame_queue *q, struct frame_out *f)
+{
+    if (q->nspare >= FQ_MAX_SPARE)
+    {
+        fo_free(f);
+        return;
+    }
+    f->next = q->spare;
+    q->spare = f;
+    q->nspare++;
+}
+
+int fq_write(struct frame_queue *q, int fd)
+{
+    while (q->head)
+    {
+        struct frame_out *f = q->head;
+        struct iovec iov[3] = {
+            {&f->hdr, sizeof(f->hdr)},                 // Заголовок
+            {f->lens, sizeof(uint32_t) * f->hdr.count}, // Таблица длин
+            {f->data, f->hdr.bytes},                    // Полезная нагрузка
+        };
+        /* Пропускаем уже записанную часть фрейма */
+        int first = 0;
+        size_t skip = f->sent;
+        while (skip >= iov[first].iov_len)
+            skip -= iov[first++].iov_len;
+        iov[first].iov_base = (char *)iov[first].iov_base + skip;
+        iov[first].iov_len -= skip;
+
+        ssize_t w = st_writev(fd, iov + first, 3 - first); // Весь остаток фрейма - одним вызовом
+        if (w < 0)
+        {
+            if (errno == EINTR) // Прервано сигналом - повторяем
+                continue;
+            if (errno == EAGAIN || errno == EWOULDBLOCK) // Канал заполнен - допишем позже
+                return 0;
+            return -1;
+        }
+        f->sent += (size_t)w;
+        q->bytes -= (size_t)w;
+        if (f->sent < fo_size(f)) // Фрейм записан не полностью
+            continue;
+        q->head = f->next; // Фрейм отправлен - снимаем с очереди
+        if (!q->head)
+            q->tail = NULL;
+        fq_recycle(q, f);
+    }
+    return 1;
+}
+
+void fb_init(struct frame_builder *fb, struct frame_queue *q, size_t max_bytes, uint32_t max_records)
+{
+    fb->q = q;
+    fb->max_bytes = max_bytes ? max_bytes : FRAME_DEFAULT_BYTES;
+    fb->max_records = max_records ? max_records : FRAME_DEFAULT_RECORDS;
+    fb->cur = NULL;
+    fb->first_ns = 0;
+}
+
+void fb_free(struct frame_builder *fb)
+{
+    if (fb->cur)
+        fo_free(fb->cur);
+    fb->cur = NULL;
+}
+
+/* fb_start: берёт фрейм для сборки - свободный из очереди или новый */
+static struct frame_out *fb_start(struct frame_builder *fb)
+{
+    struct frame_queue *q = fb->q;
+    struct frame_out *f = q->spare;
+    if (f) // Есть отправленный фрейм - переиспользуем его буферы
+    {
+        q->spare = f->next;
+        q->nspare--;
+    }
+    else
+    {
+        f = calloc(1, sizeof(*f));
+        if (!f)
+            return NULL;
+    }
+    if (f->lens_cap < fb->max_records) // Таблица длин под текущий предел записей
+    {
+        uint32_t *nl = realloc(f->lens, sizeof(uint32_t) * fb->max_records);
+        if (!nl)
+        {
+            fo_free(f);
+            return NULL;
+        }
+        f->lens = nl;
+        f->lens_cap = fb->max_records;
+    }
+    /* Буфер данных под предел фрейма; буфер, раздутый одной огромной записью, ужимаем обратно */
+    if (f->cap < fb->max_bytes || f->cap > 2 * fb->max_bytes)
+    {
+        char *nd = realloc(f->data, fb->max_bytes);
+        if (!nd)
+        {
+            fo_free(f);
+            return NULL;
+        }
+        f->data = nd;
+        f->cap = fb->max_bytes;
+    }
+    f->hdr = (struct frame_hdr){FRAME_MAGIC, 0, 0, 0};
+    f->next = NULL;
+    f->sent = 0;
+    return f;
+}
+
+void fb_seal(struct frame_builder *fb)
+{
+    struct frame_out *f = fb->cur;
+    if (!f) // Нечего отправлять
+        return;
+    struct frame_queue *q = fb->q;
+    if (q->tail) // В конец очереди
+        q->tail->next = f;
+    else
+        q->head = f;
+    q->tail = f;
+    q->bytes += fo_size(f);
+    fb->cur = NULL;
+    fb->first_ns = 0;
+}
+
+int fb_add(struct frame_builder *fb, const char *rec, size_t len, int more)
+{
+    if (fb->cur && fb->cur->hdr.bytes + len > fb->max_bytes) // Запись не влезает - закрываем фрейм
+        fb_seal(fb);
+    if (!fb->cur) // Начинаем новый фрейм
+    {
+        if (!(fb->cur = fb_start(fb)))
+            return -1;
+        fb->first_ns = now_ns(); // Отсчёт дедлайна - от первой записи фрейма
+    }
+    struct frame_out *f = fb->cur;
+    if (len > f->cap) // Одна запись больше предела - фрейм будет из неё одной
+    {
+        char *nd = realloc(f->data, len);
+        if (!nd)
+            return -1;
+        f->data = nd;
+        f->cap = len;
+    }
+    memcpy(f->data + f->hdr.bytes, rec, len); // Копируем: буфер читателя будет переиспользован
+    f->hdr.bytes += (uint32_t)len;
+    f->lens[f->hdr.count++] = (uint32_t)len;
+    if (more) // Кусок строки - последняя запись фрейма
+        f->hdr.flags |= FRAME_MORE;
+    if (more || f->hdr.count == fb->max_records || f->hdr.bytes >= fb->max_bytes) // Фрейм заполнен
+        fb_seal(fb);
+    return 0;
+}
+
+int fr_init(struct frame_reader *fr, int fd)
+{
+    fr->lens = NULL;
+    fr->data = NULL;
+    fr->frame_len = 0;
+    fr->count = fr->idx = 0;
+    fr->flags = 0;
+    fr->more = 0;
+    return lr_init(&fr->in, fd, 2 * FRAME_DEFAULT_BYTES); // Фрейм по умолчанию и начало следующего
+}
+
+void fr_free(struct frame_reader *fr)
+{
+    lr_free(&fr->in);
+}
+
+/* fr_buffer: дочитывает, пока в буфере не окажется need байт. 1 - есть, 0 - EOF до первого
+   байта, -1 - ошибка или EOF посреди фрейма (поток оборван). */
+static int fr_buffer(struct frame_reader *fr, size_t need)
+{
+    while (lr_buffered(&fr->in) < need)
+    {
+        ssize_t r = lr_fill(&fr->in); // Буфер растёт сам, если фрейм больше него
+        if (r < 0)
+            return -1;
+        if (r == 0)
+        {
+            if (lr_buffered(&fr->in) == 0)
+                return 0;
+            errno = EPROTO;
+            return -1;
+        }
+    }
+    return 1;
+}
+
+/* fr_load: читает следующий фрейм целиком. 1 - прочитан, 0 - EOF, -1 - ошибка. */
+static int fr_load(struct frame_reader *fr)
+{
+    lr_consume(&fr->in, fr->frame_len); // Записи прошлого фрейма больше не нужны
+    fr->frame_len = 0;
+    fr->count = fr->idx = 0;
+    struct frame_hdr h;
+    int r = fr_buffer(fr, sizeof(h)); // Заголовок
+    if (r <= 0)
+        return r;
+    memcpy(&h, lr_data(&fr->in), sizeof(h));
+    if (h.magic != FRAME_MAGIC) // Поток рассинхронизирован
+    {
+        errno = EPROTO;
+        return -1;
+    }
+    size_t total = sizeof(h) + sizeof(uint32_t) * (size_t)h.count + h.bytes; // + таблица длин и данные
+    if (fr_buffer(fr, total) < 0) // Остаток фрейма (заголовок уже в буфере - 0 не вернётся)
+        return -1;
+    char *p = lr_data(&fr->in); // Буфер мог переехать при дочитывании
+    fr->lens = p + sizeof(h);
+    fr->data = p + sizeof(h) + sizeof(uint32_t) * (size_t)h.count; // Данные идут сразу за таблицей длин
+    fr->frame_len = total;
+    fr->count = h.count;
+    fr->flags = h.flags;
+    return 1;
+}
+
+ssize_t fr_next(struct frame_reader *fr, char **rec)
+{
+    while (fr->idx == fr->count) // Текущий фрейм исчерпан - читаем следующий
+    {
+        int r = fr_load(fr);
+        if (r <= 0)
+        {
+            *rec = NULL;
+            fr->more = 0;
+            return r;
+        }
+    }
+    uint32_t len;
+    memcpy(&len, fr->lens + sizeof(uint32_t) * fr->idx++, sizeof(len)); // Длина очередной записи
+    *rec = fr->data;
+    fr->data += len;
+    fr->more = fr->idx == fr->count && (fr->flags & FRAME_MORE);
+    return (ssize_t)len;
+}
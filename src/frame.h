@@ -0,0 +1,138 @@
+#ifndef FRAME_H
+#define FRAME_H
+
+#include <sys/types.h>
+#include <stdint.h>
+#include <stddef.h>
+#include <time.h>
+
+#include "line_reader.h"
+
+/* Формат пакета (фрейма) между родителем и дочерними процессами:
+     struct frame_hdr              - заголовок
+     uint32_t lens[count]          - таблица длин записей
+     char payload[bytes]           - записи подряд, без разделителей
+   Все числа - в порядке байт хоста (обе стороны на одной машине). */
+
+#define FRAME_MAGIC 0x314d5246u              // "FRM1"
+#define FRAME_DEFAULT_BYTES (64 * 1024)      // Предел полезной нагрузки фрейма по умолчанию
+#define FRAME_DEFAULT_RECORDS 1024           // Предел числа записей во фрейме по умолчанию
+#define FRAME_DEFAULT_DEADLINE_MS 10         // Максимальная задержка неполного фрейма по умолчанию
+#define FRAME_MORE 0x1u                      // flags: последняя запись - кусок, строка продолжается в следующем фрейме
+
+struct frame_hdr
+{
+    uint32_t magic; // FRAME_MAGIC - защита от рассинхронизации потока
+    uint32_t count; // Число записей во фрейме
+    uint32_t bytes; // Суммарная длина записей
+    uint32_t flags; // FRAME_MORE
+};
+
+/* frame_out: собранный фрейм, ожидающий отправки (заголовок, таблица длин и данные лежат раздельно
+   и уходят одним writev, без склейки в общий буфер) */
+struct frame_out
+{
+    struct frame_out *next; // Следующий фрейм в очереди
+    struct frame_hdr hdr;   // Заголовок (count и bytes заполняются по мере добавления записей)
+    uint32_t *lens;         // Таблица длин
+    uint32_t lens_cap;      // Ёмкость таблицы длин
+    char *data;             // Полезная нагрузка
+    size_t cap;             // Ёмкость data
+    size_t sent;            // Сколько байт фрейма уже записано в канал
+};
+
+/* frame_queue: очередь исходящих фреймов одного канала.
+   Отправленные фреймы не освобождаются, а переиспользуются построителем. */
+struct frame_queue
+{
+    struct frame_out *head, *tail; // Фреймы в порядке отправки
+    struct frame_out *spare;       // Свободные фреймы для повторного использования
+    int nspare;                    // Их число
+    size_t bytes;                  // Неотправленных байт в очереди
+};
+
+/* frame_builder: накапливает записи для одного канала и ставит готовые фреймы в очередь */
+struct frame_builder
+{
+    struct frame_queue *q; // Очередь, в которую попадают готовые фреймы
+    size_t max_bytes;      // Предел полезной нагрузки
+    uint32_t max_records;  // Предел числа записей
+    struct frame_out *cur; // Собираемый фрейм (NULL - пусто)
+    uint64_t first_ns;     // Время добавления первой записи (для дедлайна)
+};
+
+/* frame_reader: читает фреймы из fd и выдаёт записи по одной без копирования.
+   Канал читается крупными порциями через line_reader как поток байтов, фрейм разбирается
+   прямо в его буфере (таблица длин может оказаться невыровненной). */
+struct frame_reader
+{
+    struct line_reader in; // Поток байтов канала
+    const char *lens;      // Таблица длин текущего фрейма (внутри буфера in)
+    char *data;            // Следующая запись
+    size_t frame_len;      // Размер текущего фрейма в потоке (снимается при чтении следующего)
+    uint32_t count;        // Записей в текущем фрейме
+    uint32_t idx;          // Индекс следующей записи
+    uint32_t flags;        // Флаги текущего фрейма
+    int more;              // Последняя выданная запись - кусок строки (FRAME_MORE)
+};
+
+/* now_ns: монотонное время в наносекундах */
+static inline uint64_t now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+}
+
+void fq_init(struct frame_queue *q);
+void fq_free(struct frame_queue *q);
+
+/* fq_write: пишет фреймы из очереди в fd, пока очередь не опустеет или канал не заполнится
+   (для fd с O_NONBLOCK). Возвращает 1 - очередь пуста, 0 - канал заполнен (EAGAIN), -1 - ошибка. */
+int fq_write(struct frame_queue *q, int fd);
+
+/* fq_bytes: неотправленных байт в очереди */
+static inline size_t fq_bytes(const struct frame_queue *q)
+{
+    return q->bytes;
+}
+
+/* fb_init: готовит построитель, складывающий фреймы в очередь q. 0 в пределах - значения по умолчанию. */
+void fb_init(struct frame_builder *fb, struct frame_queue *q, size_t max_bytes, uint32_t max_records);
+void fb_free(struct frame_builder *fb);
+
+/* fb_add: копирует запись в текущий фрейм; заполненный фрейм ставится в очередь.
+   more - запись лишь кусок строки: фрейм закрывается с FRAME_MORE, продолжение - в следующем.
+   Возвращает 0 или -1 при нехватке памяти. */
+int fb_add(struct frame_builder *fb, const char *rec, size_t len, int more);
+
+/* fb_seal: ставит текущий фрейм в очередь (если он не пуст) */
+void fb_seal(struct frame_builder *fb);
+
+/* fb_empty: в построителе нет несобранных записей */
+static inline int fb_empty(const struct frame_builder *fb)
+{
+    return fb->cur == NULL;
+}
+
+int fr_init(struct frame_reader *fr, int fd);
+void fr_free(struct frame_reader *fr);
+
+/* fr_use_uring: канал читается через io_uring с опережением (см. lr_use_uring) */
+static inline void fr_use_uring(struct frame_reader *fr, struct uring *io)
+{
+    lr_use_uring(&fr->in, io);
+}
+
+/* fr_ready: в текущем фрейме остались записи - fr_next не обратится к каналу */
+static inline int fr_ready(const struct frame_reader *fr)
+{
+    return fr->idx < fr->count;
+}
+
+/* fr_next: выдаёт следующую запись (указатель внутрь буфера фрейма, можно менять на месте).
+   Возвращает длину записи, 0 на EOF между фреймами, -1 при ошибке или повреждённом потоке.
+   fr->more = 1 - запись кусок строки, следующая запись её продолжает. */
+ssize_t fr_next(struct frame_reader *fr, char **rec);
+
+#endif
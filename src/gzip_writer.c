@@ -0,0 +1,235 @@
+#define _GNU_SOURCE
+#include <unistd.h>
+#include <stdlib.h>
+#include <string.h>
+#include <signal.h>
+
+#include "gzip_writer.h"
+#include "stats.h"
+
+/* compress_block: сжимает блок в один член gzip. zs - поток сжатия потока-исполнителя
+   (создаётся при первом блоке, дальше переиспользуется). Возвращает 0 или -1. */
+static int compress_block(z_stream *zs, int *ready, int level, size_t cap, struct gzw_block *b)
+{
+    if (!*ready)
+    {
+        memset(zs, 0, sizeof(*zs));
+        if (deflateInit2(zs, level, Z_DEFLATED, 15 + 16, 8, Z_DEFAULT_STRATEGY) != Z_OK) // +16 - обёртка gzip
+            return -1;
+        *ready = 1;
+    }
+    else if (deflateReset(zs) != Z_OK)
+        return -1;
+    zs->next_in = (Bytef *)b->in;
+    zs->avail_in = (uInt)b->len;
+    zs->next_out = b->out;
+    zs->avail_out = (uInt)cap;
+    if (deflate(zs, Z_FINISH) != Z_STREAM_END) // Места хватает на худший случай - один вызов
+        return -1;
+    b->out_len = cap - zs->avail_out;
+    return 0;
+}
+
+/* take_queued: ближайший к голове блок, ждущий сжатия, - помечается сжимаемым (-1 - нет).
+   Вызывается под mu. */
+static int take_queued(struct gzip_writer *g)
+{
+    for (int i = 0, k = g->head; i < g->nblk; ++i, k = (k + 1) % g->nblk)
+        if (g->blk[k].state == GZW_QUEUED)
+        {
+            g->blk[k].state = GZW_BUSY;
+            return k;
+        }
+    return -1;
+}
+
+/* helper: поток-помощник - сжимает блоки из очереди, пока не остановят */
+static void *helper(void *arg)
+{
+    struct gzip_writer *g = arg;
+    z_stream zs;
+    int ready = 0;
+    pthread_mutex_lock(&g->mu);
+    while (1)
+    {
+        int k = take_queued(g);
+        if (k < 0)
+        {
+            if (g->stop)
+                break;
+            g->idle++;
+            pthread_cond_wait(&g->work, &g->mu);
+            g->idle--;
+            continue;
+        }
+        pthread_mutex_unlock(&g->mu);
+        int err = compress_block(&zs, &ready, g->level, g->out_cap, &g->blk[k]);
+        pthread_mutex_lock(&g->mu);
+        g->blk[k].err = err;
+        g->blk[k].state = GZW_DONE;
+        pthread_cond_signal(&g->done);
+    }
+    pthread_mutex_unlock(&g->mu);
+    if (ready)
+        deflateEnd(&zs);
+    return NULL;
+}
+
+int gzw_init(struct gzip_writer *g, struct file_sink *sink, int level, int threads)
+{
+    memset(g, 0, sizeof(*g));
+    if (threads < 0)
+    {
+        long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+        threads = cpus > 0 ? (int)cpus : 1;
+    }
+    g->sink = sink;
+    g->level = level;
+    g->max_threads = threads < GZW_MAX_THREADS ? threads : GZW_MAX_THREADS;
+    g->out_cap = compressBound(GZW_BLOCK) + 64; // Обёртка gzip длиннее zlib на 12 байт
+    g->nblk = g->max_threads + 2; // Все помощники заняты, один блок пишется, один заполняется
+    g->last = -1;
+    g->st_wait = st_entry("gzip.wait");
+    pthread_mutex_init(&g->mu, NULL);
+    pthread_cond_init(&g->work, NULL);
+    pthread_cond_init(&g->done, NULL);
+    g->blk = calloc((size_t)g->nblk, sizeof(*g->blk));
+    if (!g->blk)
+    {
+        gzw_free(g);
+        return -1;
+    }
+    for (int i = 0; i < g->nblk; ++i)
+    {
+        g->blk[i].in = malloc(GZW_BLOCK);
+        g->blk[i].out = malloc(g->out_cap);
+        if (!g->blk[i].in || !g->blk[i].out)
+        {
+            gzw_free(g);
+            return -1;
+        }
+    }
+    return 0;
+}
+
+/* write_block: пишет сжатый блок в файл (после ошибки - пропускает) */
+static void write_block(struct gzip_writer *g, struct gzw_block *b)
+{
+    if (b->err || (!g->err && fs_write(g->sink, b->out, b->out_len) < 0))
+        g->err = 1;
+    b->len = 0;
+}
+
+/* collect: пишет сжатые блоки по порядку от головы. until >= 0 - не выходить, пока этот блок
+   не будет записан; ожидая, вызывающий поток сам сжимает блоки из очереди. */
+static void collect(struct gzip_writer *g, int until)
+{
+    pthread_mutex_lock(&g->mu);
+    while (g->blk[g->head].state != GZW_FREE)
+    {
+        struct gzw_block *b = &g->blk[g->head];
+        if (b->state == GZW_DONE) // Запись - без блокировки: блок уже ничей, кроме нашего
+        {
+            pthread_mutex_unlock(&g->mu);
+            write_block(g, b);
+            pthread_mutex_lock(&g->mu);
+            b->state = GZW_FREE;
+            g->head = (g->head + 1) % g->nblk;
+            continue;
+        }
+        if (until < 0 || g->blk[until].state == GZW_FREE)
+            break;
+        int k = take_queued(g);
+        if (k >= 0) // Помощники заняты (или их нет) - сжимаем сами
+        {
+            pthread_mutex_unlock(&g->mu);
+            int err = compress_block(&g->zs, &g->zs_ready, g->level, g->out_cap, &g->blk[k]);
+            pthread_mutex_lock(&g->mu);
+            g->blk[k].err = err;
+            g->blk[k].state = GZW_DONE;
+            continue;
+        }
+        uint64_t t0 = st_now();
+        pthread_cond_wait(&g->done, &g->mu);
+        st_account(g->st_wait, t0, 0);
+    }
+    pthread_mutex_unlock(&g->mu);
+}
+
+/* submit: заполненный блок - в очередь; при нужде запускается ещё один помощник */
+static void submit(struct gzip_writer *g)
+{
+    int k = g->fill;
+    pthread_mutex_lock(&g->mu);
+    g->blk[k].state = GZW_QUEUED;
+    if (g->idle > 0)
+        pthread_cond_signal(&g->work);
+    else if (g->nthreads < g->max_threads)
+    {
+        /* Сигналы (SIGUSR1 - отчёт статистики) обрабатывает не помощник: у него нет слота */
+        sigset_t all, old;
+        sigfillset(&all);
+        pthread_sigmask(SIG_BLOCK, &all, &old);
+        if (pthread_create(&g->tid[g->nthreads], NULL, helper, g) == 0)
+            g->nthreads++; // Не вышло - блок сожмёт вызывающий поток в collect
+        pthread_sigmask(SIG_SETMASK, &old, NULL);
+    }
+    pthread_mutex_unlock(&g->mu);
+    g->last = k;
+    g->fill = (k + 1) % g->nblk;
+    /* Без помощников блок сжимается сразу; иначе ждём, только если следующий блок ещё в пути */
+    collect(g, g->max_threads == 0 ? k : g->fill);
+}
+
+int gzw_write(struct gzip_writer *g, const void *data, size_t len)
+{
+    const char *p = data;
+    while (len > 0)
+    {
+        struct gzw_block *b = &g->blk[g->fill];
+        size_t n = GZW_BLOCK - b->len < len ? GZW_BLOCK - b->len : len;
+        memcpy(b->in + b->len, p, n);
+        b->len += n;
+        p += n;
+        len -= n;
+        if (b->len == GZW_BLOCK)
+            submit(g);
+    }
+    return g->err ? -1 : 0;
+}
+
+int gzw_close(struct gzip_writer *g)
+{
+    if (g->blk[g->fill].len > 0 || g->last < 0) // Неполный последний блок; пустой файл - пустой член
+        submit(g);
+    if (g->last >= 0)
+        collect(g, g->last);
+    pthread_mutex_lock(&g->mu);
+    g->stop = 1;
+    pthread_cond_broadcast(&g->work);
+    pthread_mutex_unlock(&g->mu);
+    for (int i = 0; i < g->nthreads; ++i)
+        pthread_join(g->tid[i], NULL);
+    g->nthreads = 0;
+    return g->err ? -1 : 0;
+}
+
+void gzw_free(struct gzip_writer *g)
+{
+    if (g->blk)
+    {
+        for (int i = 0; i < g->nblk; ++i)
+        {
+            free(g->blk[i].in);
+            free(g->blk[i].out);
+        }
+        free(g->blk);
+        g->blk = NULL;
+    }
+    pthread_mutex_destroy(&g->mu);
+    pthread_cond_destroy(&g->work);
+    pthread_cond_destroy(&g->done);
+    if (g->zs_ready)
+        deflateEnd(&g->zs);
+    g->zs_ready = 0;
+}
@@ -0,0 +1,81 @@
+#ifndef GZIP_WRITER_H
+#define GZIP_WRITER_H
+
+#include <sys/types.h>
+#include <stddef.h>
+#include <pthread.h>
+#include <zlib.h>
+
+#include "file_sink.h"
+
+/* Сжатый выходной файл (gzip). Данные режутся на блоки по GZW_BLOCK байт, каждый блок -
+   отдельный член gzip (RFC 1952 допускает их последовательность): блоки сжимаются независимо
+   и параллельно, а gzip -d / zcat распаковывают файл в то же, что записал бы обычный режим.
+   Сжимают помощники - потоки, которые запускаются, только когда блок готов, а свободного
+   помощника нет (строки приходят быстрее, чем их успевают сжимать), но не больше заданного
+   числа. Пишет в файл только вызывающий поток, строго по порядку блоков; ожидая блок, он
+   сам сжимает очередной из очереди. */
+
+#define GZW_BLOCK (256 * 1024) // Размер блока (члена gzip) до сжатия
+#define GZW_MAX_THREADS 16     // Предел числа помощников
+#define GZW_DEFAULT_LEVEL 6    // Уровень сжатия по умолчанию (как у gzip)
+
+enum gzw_state
+{
+    GZW_FREE,   // Свободен или заполняется
+    GZW_QUEUED, // Ждёт сжатия
+    GZW_BUSY,   // Сжимается
+    GZW_DONE,   // Сжат, ждёт записи
+};
+
+/* gzw_block: блок конвейера */
+struct gzw_block
+{
+    char *in;               // Несжатые данные
+    size_t len;             // Их длина
+    unsigned char *out;     // Член gzip
+    size_t out_len;
+    enum gzw_state state;
+    int err;                // Сжатие не удалось
+};
+
+/* gzip_writer: конвейер сжатия в файл */
+struct gzip_writer
+{
+    struct file_sink *sink; // Куда пишутся сжатые блоки
+    int level;              // Уровень сжатия zlib (1..9)
+    int max_threads;        // Предел помощников (0 - сжимает вызывающий поток)
+    size_t out_cap;         // Ёмкость блока после сжатия (с запасом на несжимаемые данные)
+    struct gzw_block *blk;  // Кольцо блоков: max_threads + 2
+    int nblk;
+    int head;               // Старейший незаписанный блок
+    int fill;               // Заполняемый блок
+    int last;               // Последний отданный на сжатие (-1 - не было)
+    z_stream zs;            // Поток сжатия вызывающего потока
+    int zs_ready;
+    pthread_mutex_t mu;     // Защищает state и поля помощников
+    pthread_cond_t work;    // Появился блок для сжатия или пора завершаться
+    pthread_cond_t done;    // Блок сжат
+    pthread_t tid[GZW_MAX_THREADS];
+    int nthreads;           // Запущено помощников
+    int idle;               // Из них ждут работы
+    int stop;
+    int err;                // Ошибка сжатия или записи: дальше данные не пишутся
+    int st_wait;            // Запись статистики: ожидание сжатия (stats.h)
+};
+
+/* gzw_init: level - 1..9, threads - предел помощников (<0 - по числу процессоров).
+   Возвращает 0 или -1 при нехватке памяти. */
+int gzw_init(struct gzip_writer *g, struct file_sink *sink, int level, int threads);
+
+/* gzw_write: добавляет данные (сжимаются и пишутся полными блоками). 0 или -1 после ошибки. */
+int gzw_write(struct gzip_writer *g, const void *data, size_t len);
+
+/* gzw_close: сжимает и пишет остаток, дожидается всех блоков и останавливает помощников.
+   Возвращает 0 или -1, если файл записан не целиком. sink не закрывается. */
+int gzw_close(struct gzip_writer *g);
+
+/* gzw_free: освобождает буферы (после gzw_close) */
+void gzw_free(struct gzip_writer *g);
+
+#endif
@@ -0,0 +1,83 @@
+#define _GNU_SOURCE
+#include <unistd.h>
+#include <string.h>
+#include <errno.h>
+#include <sys/socket.h>
+
+#include "jobs.h"
+
+int job_send(int sock, const struct job_hdr *h, const int *fds, int nfds)
+{
+    union
+    {
+        char buf[CMSG_SPACE(sizeof(int) * JOB_MAX_FDS)];
+        struct cmsghdr align;
+    } ctl;
+    struct iovec iov = {(void *)h, sizeof(*h)};
+    struct msghdr msg = {.msg_iov = &iov, .msg_iovlen = 1};
+    if (nfds > JOB_MAX_FDS)
+    {
+        errno = EINVAL;
+        return -1;
+    }
+    if (nfds > 0)
+    {
+        memset(&ctl, 0, sizeof(ctl));
+        msg.msg_control = ctl.buf;
+        msg.msg_controllen = CMSG_SPACE(sizeof(int) * (size_t)nfds);
+        struct cmsghdr *c = CMSG_FIRSTHDR(&msg);
+        c->cmsg_level = SOL_SOCKET;
+        c->cmsg_type = SCM_RIGHTS;
+        c->cmsg_len = CMSG_LEN(sizeof(int) * (size_t)nfds);
+        memcpy(CMSG_DATA(c), fds, sizeof(int) * (size_t)nfds);
+    }
+    while (sendmsg(sock, &msg, MSG_NOSIGNAL) < 0)
+    {
+        if (errno != EINTR)
+            return -1;
+    }
+    return 0;
+}
+
+int job_recv(int sock, struct job_hdr *h, int *fds, int max, int *nfds)
+{
+    union
+    {
+        char buf[CMSG_SPACE(sizeof(int) * JOB_MAX_FDS)];
+        struct cmsghdr align;
+    } ctl;
+    struct iovec iov = {h, sizeof(*h)};
+    struct msghdr msg = {.msg_iov = &iov, .msg_iovlen = 1, .msg_control = ctl.buf, .msg_controllen = sizeof(ctl.buf)};
+    ssize_t r;
+    while ((r = recvmsg(sock, &msg, MSG_CMSG_CLOEXEC)) < 0)
+    {
+        if (errno != EINTR)
+            return -1;
+    }
+    if (r == 0)
+        return 0;
+    /* Сначала забираем дескрипторы: даже из негодного сообщения их нужно закрыть */
+    int got = 0;
+    int tmp[JOB_MAX_FDS];
+    for (struct cmsghdr *c = CMSG_FIRSTHDR(&msg); c; c = CMSG_NXTHDR(&msg, c))
+    {
+        if (c->cmsg_level != SOL_SOCKET || c->cmsg_type != SCM_RIGHTS)
+            continue;
+        int n = (int)((c->cmsg_len - CMSG_LEN(0)) / sizeof(int));
+        if (got + n > JOB_MAX_FDS)
+            n = JOB_MAX_FDS - got;
+        memcpy(tmp + got, CMSG_DATA(c), sizeof(int) * (size_t)n);
+        got += n;
+    }
+    if ((size_t)r != sizeof(*h) || h->magic != JOB_MAGIC || got > max || (msg.msg_flags & (MSG_TRUNC | MSG_CTRUNC)))
+    {
+        for (int i = 0; i < got; ++i)
+            close(tmp[i]);
+        errno = EPROTO;
+        return -1;
+    }
+    if (got > 0)
+        memcpy(fds, tmp, sizeof(int) * (size_t)got);
+    *nfds = got;
+    return 1;
+}
@@ -0,0 +1,50 @@
+#ifndef JOBS_H
+#define JOBS_H
+
+#include <sys/types.h>
+#include <stdint.h>
+#include <stddef.h>
+
+/* Режим демона (parent --daemon): задания и дескрипторы идут сообщениями по сокетам Unix
+   (SOCK_SEQPACKET - границы сообщений сохраняются), дескрипторы - через SCM_RIGHTS.
+     клиент -> демон:      JOB_RUN  + stdin, stdout клиента и его открытые выходные файлы;
+     демон -> обработчик:  JOB_WORK + вход задания (канал или кольцо), stdout, файл;
+     обработчик -> демон, демон -> клиент: JOB_DONE со статусом.
+   Клиент сам открывает выходные файлы - имена разрешаются в его каталоге и с его правами,
+   а демон и обработчики пишут прямо в stdout клиента. */
+
+#define JOB_MAGIC 0x31424f4au // "JOB1"
+#define JOB_MAX_FDS 68        // stdin, stdout и до 64 файлов (запас под кольцо)
+
+enum job_kind
+{
+    JOB_RUN = 1, // Клиент: выполнить задание
+    JOB_WORK,    // Демон: обработчику - его часть задания
+    JOB_DONE,    // Задание выполнено (status - код завершения)
+};
+
+#define JOB_UTF8 0x1u // Разворот по символам UTF-8
+#define JOB_SHM 0x2u  // JOB_WORK: вход - кольцо (3 дескриптора), иначе канал с фреймами
+#define JOB_FILE 0x4u // JOB_WORK: последний дескриптор - выходной файл
+
+/* job_hdr: заголовок сообщения (дескрипторы - во вспомогательных данных) */
+struct job_hdr
+{
+    uint32_t magic;  // JOB_MAGIC
+    uint32_t kind;   // enum job_kind
+    uint32_t flags;  // JOB_*
+    uint32_t nfiles; // JOB_RUN: число обработчиков (выходных файлов)
+    uint64_t files;  // JOB_RUN: маска обработчиков, для которых передан открытый файл
+    int32_t status;  // JOB_DONE: 0 - успешно
+    uint32_t pad;
+};
+
+/* job_send: заголовок и nfds дескрипторов одним сообщением. 0 или -1. */
+int job_send(int sock, const struct job_hdr *h, const int *fds, int nfds);
+
+/* job_recv: следующее сообщение; дескрипторы (O_CLOEXEC) - в fds, их число - в *nfds.
+   Возвращает 1 - сообщение, 0 - другая сторона закрыла сокет, -1 - ошибка или
+   повреждённое сообщение (полученные дескрипторы тогда закрыты). */
+int job_recv(int sock, struct job_hdr *h, int *fds, int max, int *nfds);
+
+#endif
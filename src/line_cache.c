@@ -0,0 +1,171 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include "line_cache.h"
+#include "stats.h"
+
+#define P1 0x9e3779b185ebca87ull // Константы xxHash64
+#define P2 0xc2b2ae3d27d4eb4full
+#define P3 0x165667b19e3779f9ull
+
+static inline uint64_t rotl(uint64_t x, int r)
+{
+    return (x << r) | (x >> (64 - r));
+}
+
+/* round64: шаг одной цепочки */
+static inline uint64_t round64(uint64_t acc, uint64_t w)
+{
+    return rotl(acc + w * P2, 31) * P1;
+}
+
+static inline uint64_t load64(const char *p)
+{
+    uint64_t w;
+    memcpy(&w, p, 8);
+    return w;
+}
+
+uint64_t lc_hash(const char *s, size_t n)
+{
+    uint64_t h = P3 + (uint64_t)n;
+    size_t left = n;
+    if (left >= 32) // Цепочки не зависят друг от друга - умножения идут параллельно
+    {
+        uint64_t a = P1 + P2, b = P2, c = 0, d = -P1;
+        for (; left >= 32; left -= 32, s += 32)
+        {
+            a = round64(a, load64(s));
+            b = round64(b, load64(s + 8));
+            c = round64(c, load64(s + 16));
+            d = round64(d, load64(s + 24));
+        }
+        h += rotl(a, 1) + rotl(b, 7) + rotl(c, 12) + rotl(d, 18);
+    }
+    for (; left >= 8; left -= 8, s += 8)
+        h = round64(h, load64(s));
+    if (left > 0)
+    {
+        uint64_t w = 0;
+        memcpy(&w, s, left);
+        h = round64(h, w);
+    }
+    h ^= h >> 33; // Перемешивание: от каждого бита входа зависят все биты хеша
+    h *= P2;
+    h ^= h >> 29;
+    h *= P3;
+    h ^= h >> 32;
+    return h;
+}
+
+int lc_init(struct line_cache *c, size_t cap)
+{
+    memset(c, 0, sizeof(*c));
+    c->st_hit = st_entry("cache.hit");
+    c->st_miss = st_entry("cache.miss");
+    if (cap == 0)
+        return 0;
+    size_t nslot = 64; // Ячейка на 256 байт области - записи коротких строк
+    while (nslot * 256 < cap)
+        nslot *= 2;
+    size_t table = nslot * sizeof(struct lc_slot);
+    if (cap < 2 * table) // Слишком мал - таблица заняла бы всё
+        return -1;
+    c->slot = calloc(nslot, sizeof(struct lc_slot));
+    c->half_size = (cap - table) / 2;
+    c->half[0] = malloc(2 * c->half_size);
+    if (!c->slot || !c->half[0])
+    {
+        lc_free(c);
+        return -1;
+    }
+    c->half[1] = c->half[0] + c->half_size;
+    c->mask = nslot - 1;
+    c->gen = 1;
+    c->max_entry = c->half_size / 16 < 2 * LC_MAX_LINE ? c->half_size / 16 : 2 * LC_MAX_LINE;
+    return 0;
+}
+
+/* live: в ячейке действующая запись (текущей или прошлой половины) */
+static inline int live(const struct line_cache *c, const struct lc_slot *s)
+{
+    return s->gen != 0 && s->gen + 1 >= c->gen;
+}
+
+/* flip: текущей становится другая половина; записи в ней забываются (их поколение устарело) */
+static void flip(struct line_cache *c)
+{
+    c->gen++;
+    c->used = 0;
+}
+
+/* promote: запись прошлой половины - в текущую, если там есть место (смена половины затёрла бы её) */
+static void promote(struct line_cache *c, struct lc_slot *s)
+{
+    size_t len = s->key_len + (s->out_len > 0 ? (size_t)s->out_len : 0);
+    if (c->used + len > c->half_size)
+        return;
+    memcpy(c->half[c->gen & 1] + c->used, c->half[s->gen & 1] + s->off, len);
+    s->gen = c->gen;
+    s->off = (uint32_t)c->used;
+    c->used += len;
+}
+
+int lc_get(struct line_cache *c, const char *key, size_t n, const char **out, ssize_t *out_len)
+{
+    c->staged = 0;
+    if (!c->slot || 2 * n > c->max_entry) // Результат не длиннее строки - места на две
+        return 0;
+    uint64_t h = lc_hash(key, n);
+    size_t victim = (size_t)h & c->mask; // Куда ляжет запись при промахе
+    int victim_rank = 3;                 // 0 - пустая ячейка, 1 - прошлой половины, 2 - текущей
+    for (size_t i = 0; i < LC_WAYS; ++i)
+    {
+        size_t at = ((size_t)h + i) & c->mask;
+        struct lc_slot *s = &c->slot[at];
+        int rank = !live(c, s) ? 0 : s->gen != c->gen ? 1 : 2;
+        if (rank > 0 && s->hash == h && s->key_len == n && memcmp(c->half[s->gen & 1] + s->off, key, n) == 0)
+        {
+            if (rank == 1)
+                promote(c, s);
+            *out = c->half[s->gen & 1] + s->off + n;
+            *out_len = s->out_len;
+            st_count(c->st_hit, n);
+            return 1;
+        }
+        if (rank < victim_rank)
+        {
+            victim = at;
+            victim_rank = rank;
+        }
+    }
+    st_count(c->st_miss, n);
+    if (c->used + 2 * n > c->half_size)
+        flip(c);
+    memcpy(c->half[c->gen & 1] + c->used, key, n); // Строку сейчас преобразуют на месте
+    c->pending = (struct lc_slot){h, c->gen, (uint32_t)c->used, (uint32_t)n, 0};
+    c->pending_at = victim;
+    c->staged = 1;
+    return 0;
+}
+
+void lc_put(struct line_cache *c, const char *out, ssize_t out_len)
+{
+    if (!c->staged || out_len > (ssize_t)c->pending.key_len)
+        return;
+    c->staged = 0;
+    struct lc_slot *s = &c->pending;
+    if (out_len > 0)
+        memcpy(c->half[s->gen & 1] + s->off + s->key_len, out, (size_t)out_len);
+    s->out_len = (int32_t)out_len;
+    c->slot[c->pending_at] = *s;
+    c->used += s->key_len + (out_len > 0 ? (size_t)out_len : 0);
+}
+
+void lc_free(struct line_cache *c)
+{
+    free(c->slot);
+    free(c->half[0]);
+    c->slot = NULL;
+    c->half[0] = c->half[1] = NULL;
+}
@@ -0,0 +1,73 @@
+#ifndef LINE_CACHE_H
+#define LINE_CACHE_H
+
+#include <sys/types.h>
+#include <stdint.h>
+#include <stddef.h>
+
+/* Хеш содержимого строки и кэш результатов обработчика.
+   Режим -D hash: родитель выбирает обработчика по хешу строки (lc_shard; у длинной строки -
+   по хешу её начала, см. hash_target в parent.c), так что одинаковые
+   строки всегда попадают к одному обработчику, а тот отдаёт повторную строку из кэша, не
+   преобразуя её заново. Кэш ограничен по памяти: таблица записей и две половины области
+   строк (ключ - исходная строка, рядом - результат). Новые записи дописываются в текущую
+   половину; когда она заполнена, текущей становится другая, а её записи разом забываются.
+   Попадание в записи прошлой половины копирует её в текущую - часто повторяющиеся строки
+   переживают смену половин (приближение LRU). Запись ищется в окне из LC_WAYS ячеек таблицы;
+   при промахе место занимает пустая или самая старая ячейка окна. */
+
+#define LC_WAYS 8                   // Ячеек таблицы, в которых может лежать запись
+#define LC_MAX_LINE (16 * 1024)     // Строки длиннее не кэшируются (редко повторяются)
+#define LC_DEFAULT_BYTES (16u << 20) // Предел памяти кэша по умолчанию (режим -D hash)
+
+/* lc_hash: хеш содержимого строки (4 независимые цепочки по 8 байт, как в xxHash64) */
+uint64_t lc_hash(const char *s, size_t n);
+
+/* lc_shard: обработчик из n для строки с хешем h. Берутся старшие биты: младшие выбирают
+   ячейку таблицы кэша, и у строк одного обработчика они не должны совпадать. */
+static inline int lc_shard(uint64_t h, int n)
+{
+    return (int)((h >> 32) % (uint64_t)n);
+}
+
+/* lc_slot: ячейка таблицы */
+struct lc_slot
+{
+    uint64_t hash;
+    uint32_t gen;     // Поколение половины с записью (0 - пусто; чётность - номер половины)
+    uint32_t off;     // Смещение записи в половине
+    uint32_t key_len; // Длина исходной строки; результат - сразу за ней
+    int32_t out_len;  // Длина результата (-1 - строка отброшена)
+};
+
+/* line_cache: кэш результатов одного обработчика */
+struct line_cache
+{
+    struct lc_slot *slot; // Таблица
+    size_t mask;          // Ячеек - 1
+    char *half[2];        // Половины области строк
+    size_t half_size;
+    size_t used;          // Занято в текущей половине
+    uint32_t gen;         // Поколение текущей половины (её номер - gen & 1)
+    size_t max_entry;     // Предел записи (ключ и результат)
+    int staged;           // Ключ промаха скопирован, lc_put добавит запись
+    struct lc_slot pending; // Её будущая ячейка
+    size_t pending_at;      // Номер ячейки
+    int st_hit;           // Записи статистики: попадания и промахи (stats.h)
+    int st_miss;
+};
+
+/* lc_init: кэш не больше cap байт вместе с таблицей (0 - кэш выключен). 0 или -1. */
+int lc_init(struct line_cache *c, size_t cap);
+
+/* lc_get: ищет результат для строки key длины n. 1 - найден: *out и *out_len (-1 - строка
+   отброшена; данные действительны до следующего lc_get). 0 - нет (или кэш выключен, или строка
+   длиннее LC_MAX_LINE): ключ запомнен, и lc_put после преобразования строки добавит запись. */
+int lc_get(struct line_cache *c, const char *key, size_t n, const char **out, ssize_t *out_len);
+
+/* lc_put: результат преобразования строки последнего промаха (out_len -1 - отброшена) */
+void lc_put(struct line_cache *c, const char *out, ssize_t out_len);
+
+void lc_free(struct line_cache *c);
+
+#endif
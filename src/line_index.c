@@ -0,0 +1,142 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include "line_index.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#define INDEX_X86 1
+#include <immintrin.h>
+#endif
+
+#define LI_BLOCK (64 * 1024) // Файл сканируется блоками: перед блоком в ends есть место на каждый байт
+
+/* scanner: ядро поиска '\n'. Дописывает в out смещения за каждым '\n' в p[0, n)
+   (base - смещение p в файле) и возвращает их число. */
+struct scanner
+{
+    const char *name;
+    size_t (*scan)(const char *p, size_t n, uint64_t base, uint64_t *out);
+};
+
+static size_t scan_scalar(const char *p, size_t n, uint64_t base, uint64_t *out)
+{
+    size_t k = 0;
+    const char *s = p, *e = p + n;
+    const char *nl;
+    while (s < e && (nl = memchr(s, '\n', (size_t)(e - s))) != NULL)
+    {
+        out[k++] = base + (uint64_t)(nl - p) + 1;
+        s = nl + 1;
+    }
+    return k;
+}
+
+#ifdef INDEX_X86
+/* scan_sse2: 16 байт за шаг - сравнение с '\n' даёт битовую маску, каждый установленный
+   бит - конец строки. Для коротких строк это дешевле вызова memchr на строку. */
+__attribute__((target("sse2"))) static size_t scan_sse2(const char *p, size_t n, uint64_t base, uint64_t *out)
+{
+    const __m128i nl = _mm_set1_epi8('\n');
+    size_t k = 0, i = 0;
+    for (; i + 16 <= n; i += 16)
+    {
+        unsigned m = (unsigned)_mm_movemask_epi8(_mm_cmpeq_epi8(_mm_loadu_si128((const __m128i *)(p + i)), nl));
+        while (m)
+        {
+            out[k++] = base + i + (unsigned)__builtin_ctz(m) + 1;
+            m &= m - 1; // Снимаем младший бит
+        }
+    }
+    return k + scan_scalar(p + i, n - i, base + i, out + k);
+}
+
+/* scan_avx2: то же по 32 байта */
+__attribute__((target("avx2"))) static size_t scan_avx2(const char *p, size_t n, uint64_t base, uint64_t *out)
+{
+    const __m256i nl = _mm256_set1_epi8('\n');
+    size_t k = 0, i = 0;
+    for (; i + 32 <= n; i += 32)
+    {
+        unsigned m = (unsigned)_mm256_movemask_epi8(_mm256_cmpeq_epi8(_mm256_loadu_si256((const __m256i *)(p + i)), nl));
+        while (m)
+        {
+            out[k++] = base + i + (unsigned)__builtin_ctz(m) + 1;
+            m &= m - 1;
+        }
+    }
+    _mm256_zeroupper(); // Дальше SSE-код
+    return k + scan_sse2(p + i, n - i, base + i, out + k);
+}
+#endif
+
+static const struct scanner scanners[] = {
+#ifdef INDEX_X86
+    {"avx2", scan_avx2},
+    {"sse2", scan_sse2},
+#endif
+    {"scalar", scan_scalar},
+};
+
+static const struct scanner *active; // Выбранное ядро (NULL - ещё не выбрано)
+
+/* pick: первое ядро, которое поддерживает процессор */
+static const struct scanner *pick(void)
+{
+    if (!active)
+    {
+        size_t i = 0;
+#ifdef INDEX_X86
+        __builtin_cpu_init();
+        if (!__builtin_cpu_supports("avx2"))
+            i++;
+        if (i == 1 && !__builtin_cpu_supports("sse2"))
+            i++;
+#endif
+        active = &scanners[i];
+    }
+    return active;
+}
+
+/* li_reserve: место ещё на n концов строк */
+static int li_reserve(struct line_index *li, size_t n)
+{
+    if (li->count + n <= li->cap)
+        return 0;
+    size_t ncap = li->cap ? li->cap * 2 : LI_BLOCK;
+    if (ncap < li->count + n)
+        ncap = li->count + n;
+    uint64_t *ne = realloc(li->ends, ncap * sizeof(*ne));
+    if (!ne)
+        return -1;
+    li->ends = ne;
+    li->cap = ncap;
+    return 0;
+}
+
+int li_build(struct line_index *li, const char *data, size_t size)
+{
+    memset(li, 0, sizeof(*li));
+    li->data = data;
+    li->size = size;
+    const struct scanner *s = pick();
+    for (size_t pos = 0; pos < size; pos += LI_BLOCK)
+    {
+        size_t n = size - pos < LI_BLOCK ? size - pos : LI_BLOCK;
+        if (li_reserve(li, n) < 0) // Худший случай - '\n' в каждом байте блока
+            return -1;
+        li->count += s->scan(data + pos, n, pos, li->ends + li->count);
+    }
+    if (size > 0 && data[size - 1] != '\n') // Последняя строка без '\n'
+    {
+        if (li_reserve(li, 1) < 0)
+            return -1;
+        li->ends[li->count++] = size;
+    }
+    return 0;
+}
+
+void li_free(struct line_index *li)
+{
+    free(li->ends);
+    memset(li, 0, sizeof(*li));
+}
@@ -0,0 +1,51 @@
+#ifndef LINE_INDEX_H
+#define LINE_INDEX_H
+
+#include <sys/types.h>
+#include <stdint.h>
+#include <stddef.h>
+
+/* Режим входного файла (parent --input): родитель отображает файл в память, строит индекс
+   концов строк и вместо самих строк отправляет обработчикам описатели struct line_desc.
+   Обработчик отображает тот же файл и выходной файл и разворачивает строку сразу в нём -
+   данные строк через каналы не идут. */
+
+/* line_desc: описатель строки (запись фрейма или кольца вместо самой строки) */
+struct line_desc
+{
+    uint64_t in_off;  // Смещение строки во входном файле
+    uint64_t out_off; // Смещение в выходном файле обработчика
+    uint32_t len;     // Длина вместе с '\n'
+    uint32_t flags;   // Зарезервировано (0)
+};
+
+/* line_index: концы строк отображённого файла. Поиск '\n' векторный: ядро (AVX2, SSE2 или
+   memchr) выбирается по возможностям процессора, как в reverse.c. */
+struct line_index
+{
+    const char *data; // Отображение файла
+    size_t size;      // Его размер
+    uint64_t *ends;   // Смещение за концом каждой строки (за '\n' или конец файла)
+    size_t count;     // Число строк
+    size_t cap;       // Ёмкость ends
+};
+
+/* li_build: строит индекс строк data[0, size). Последняя строка может быть без '\n'.
+   Возвращает 0 или -1 при нехватке памяти. */
+int li_build(struct line_index *li, const char *data, size_t size);
+
+void li_free(struct line_index *li);
+
+/* li_start: смещение начала строки k (с 0) */
+static inline uint64_t li_start(const struct line_index *li, size_t k)
+{
+    return k ? li->ends[k - 1] : 0;
+}
+
+/* li_len: длина строки k вместе с '\n' */
+static inline size_t li_len(const struct line_index *li, size_t k)
+{
+    return (size_t)(li->ends[k] - li_start(li, k));
+}
+
+#endif
@@ -0,0 +1,203 @@
+#define _GNU_SOURCE
+#include <unistd.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <stdint.h>
+
+#include "line_reader.h"
+#include "stats.h"
+
+int lr_init(struct line_reader *lr, int fd, size_t cap)
+{
+    if (cap == 0)             // Если ёмкость не задана
+        cap = LR_DEFAULT_CAP; // Используем значение по умолчанию
+    lr->buf = malloc(cap);    // Один буфер на всё время жизни читателя
+    if (!lr->buf)
+        return -1;
+    lr->fd = fd;
+    lr->cap = cap;
+    lr->start = lr->end = lr->scan = 0; // Буфер пуст
+    lr->eof = 0;
+    lr->max_line = 0;
+    lr->more = 0;
+    lr->io = NULL;
+    lr->rd_state = LR_RD_IDLE;
+    return 0;
+}
+
+/* lr_read_done: завершение чтения io_uring (результат учитывается в lr_fill) */
+static void lr_read_done(struct uring_op *op, int res)
+{
+    struct line_reader *lr = (struct line_reader *)((char *)op - offsetof(struct line_reader, op));
+    lr->rd_res = res;
+    lr->rd_state = LR_RD_DONE;
+}
+
+void lr_use_uring(struct line_reader *lr, struct uring *io)
+{
+    lr->io = io;
+    lr->op.done = lr_read_done;
+}
+
+void lr_free(struct line_reader *lr)
+{
+    while (lr->rd_state == LR_RD_BUSY) // Ядро ещё пишет в буфер
+        if (uring_submit(lr->io, 1) < 0)
+            break;
+    free(lr->buf); // Освобождаем буфер
+    lr->buf = NULL;
+    lr->cap = lr->start = lr->end = lr->scan = 0;
+}
+
+/* lr_make_room: обеспечивает свободное место в конце буфера.
+   Сначала пробует сдвинуть непрочитанный хвост в начало, иначе удваивает буфер. */
+static int lr_make_room(struct line_reader *lr)
+{
+    if (lr->start == lr->end) // Все данные выданы - просто начинаем сначала
+    {
+        lr->start = lr->end = lr->scan = 0;
+        return 0;
+    }
+    if (lr->end < lr->cap) // Место в конце ещё есть
+        return 0;
+    if (lr->start > 0) // Есть выданные данные в начале - сдвигаем хвост
+    {
+        size_t n = lr->end - lr->start;
+        memmove(lr->buf, lr->buf + lr->start, n); // Переносим хвост в начало
+        lr->scan -= lr->start;
+        lr->end = n;
+        lr->start = 0;
+        return 0;
+    }
+    /* Буфер целиком занят одной незаконченной строкой - увеличиваем его */
+    size_t ncap = lr->cap * 2;
+    char *nb = realloc(lr->buf, ncap);
+    if (!nb)
+        return -1;
+    lr->buf = nb;
+    lr->cap = ncap;
+    return 0;
+}
+
+/* lr_submit: ставит чтение через io_uring в свободный хвост буфера */
+static int lr_submit(struct line_reader *lr)
+{
+    if (uring_reserve(lr->io, 1) < 0)
+        return -1;
+    struct io_uring_sqe *sqe = uring_sqe(lr->io, &lr->op);
+    sqe->opcode = IORING_OP_READ;
+    sqe->fd = lr->fd;
+    sqe->addr = (uint64_t)(uintptr_t)(lr->buf + lr->end);
+    sqe->len = (unsigned)(lr->cap - lr->end < (1u << 30) ? lr->cap - lr->end : (1u << 30));
+    sqe->off = (uint64_t)-1; // С текущей позиции (канал)
+    lr->rd_state = LR_RD_BUSY;
+    return uring_submit(lr->io, 0); // Запись уже в SQ: даже при ошибке уйдёт со следующим вызовом
+}
+
+/* lr_fill_uring: lr_fill через io_uring - дожидается чтения в полёте (или ставит новое)
+   и сразу ставит следующее в остаток буфера */
+static ssize_t lr_fill_uring(struct line_reader *lr)
+{
+    while (1)
+    {
+        if (lr->rd_state == LR_RD_IDLE && (lr_make_room(lr) < 0 || lr_submit(lr) < 0))
+            return -1;
+        while (lr->rd_state == LR_RD_BUSY)
+            if (uring_submit(lr->io, 1) < 0)
+                return -1;
+        lr->rd_state = LR_RD_IDLE;
+        int r = lr->rd_res;
+        if (r == -EINTR || r == -EAGAIN) // Прервано - повторяем
+            continue;
+        if (r < 0)
+        {
+            errno = -r;
+            return -1;
+        }
+        if (r == 0) // Конец файла
+            lr->eof = 1;
+        lr->end += (size_t)r;
+        if (!lr->eof && lr->cap - lr->end >= LR_MIN_AHEAD) // Опережающее чтение, пока разбираем это
+            lr_submit(lr);
+        return r;
+    }
+}
+
+ssize_t lr_fill(struct line_reader *lr)
+{
+    if (lr->eof) // После EOF больше не читаем
+        return 0;
+    if (lr->io)
+        return lr_fill_uring(lr);
+    if (lr_make_room(lr) < 0)
+        return -1;
+    while (1)
+    {
+        ssize_t r = st_read(lr->fd, lr->buf + lr->end, lr->cap - lr->end); // Читаем сколько поместится
+        if (r < 0)
+        {
+            if (errno == EINTR) // Прервано сигналом - повторяем
+                continue;
+            return -1;
+        }
+        if (r == 0)      // Конец файла
+            lr->eof = 1;
+        lr->end += (size_t)r;
+        return r;
+    }
+}
+
+ssize_t lr_take(struct line_reader *lr, char **line)
+{
+    if (lr->scan < lr->start) // Поиск никогда не начинается раньше начала данных
+        lr->scan = lr->start;
+    char *nl = memchr(lr->buf + lr->scan, '\n', lr->end - lr->scan); // Ищем конец строки
+    size_t len;
+    lr->more = 0;
+    if (nl) // Нашли '\n' - выдаём строку вместе с ним
+        len = (size_t)(nl - (lr->buf + lr->start)) + 1;
+    else if (lr->eof && lr->end > lr->start) // EOF без '\n' - выдаём хвост как последнюю строку
+        len = lr->end - lr->start;
+    else if (lr->max_line && lr->end - lr->start >= lr->max_line) // Длинная строка - всё прочитанное куском
+    {
+        len = lr->end - lr->start;
+        lr->more = 1;
+    }
+    else
+    {
+        lr->scan = lr->end; // Запоминаем, что уже просмотрено
+        return 0;
+    }
+    *line = lr->buf + lr->start; // Указатель прямо в буфер, без копирования
+    lr->start += len;
+    lr->scan = lr->start;
+    return (ssize_t)len;
+}
+
+int lr_ready(struct line_reader *lr)
+{
+    if (lr->scan < lr->start)
+        lr->scan = lr->start;
+    if (memchr(lr->buf + lr->scan, '\n', lr->end - lr->scan)) // Позицию не сдвигаем: lr_take найдёт его же
+        return 1;
+    lr->scan = lr->end; // Просмотренное повторно не сканируем
+    return (lr->eof || (lr->max_line && lr->end - lr->start >= lr->max_line)) && lr->end > lr->start;
+}
+
+ssize_t lr_next(struct line_reader *lr, char **line)
+{
+    while (1)
+    {
+        ssize_t len = lr_take(lr, line); // Сначала пробуем выдать строку из буфера
+        if (len > 0)
+            return len;
+        if (lr->eof) // Данных больше не будет
+        {
+            *line = NULL;
+            return 0;
+        }
+        if (lr_fill(lr) < 0) // Дочитываем ещё порцию
+            return -1;
+    }
+}
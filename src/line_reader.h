@@ -0,0 +1,101 @@
+#ifndef LINE_READER_H
+#define LINE_READER_H
+
+#include <sys/types.h>
+#include <stddef.h>
+
+#include "uring.h"
+
+#define LR_DEFAULT_CAP (64 * 1024) // Начальная ёмкость буфера читателя (64 КиБ)
+#define LR_MIN_AHEAD (16 * 1024)   // Меньше этого свободного хвоста опережающее чтение не ставим
+#define LR_PIECE (1024 * 1024)     // Кусок длинной строки (режим max_line)
+
+/* line_reader: постоянный буферизованный читатель строк для одного fd.
+   Буфер переиспользуется между вызовами: прочитанные строки "съедаются" с начала,
+   а непрочитанный хвост сдвигается в начало только когда место в конце закончилось.
+   Строки выдаются как (указатель, длина) прямо в буфер — без malloc на строку.
+   С io_uring (lr_use_uring) после каждого чтения в свободный хвост буфера сразу ставится
+   следующее: ядро читает канал, пока обработчик разбирает уже прочитанное. Пока чтение
+   в полёте, хвост буфера принадлежит ядру - буфер не сдвигается и не растёт.
+   С пределом max_line строка, которая не закончилась и в буфере её уже не меньше предела,
+   выдаётся кусками (more = 1 - строка продолжается): буфер не растёт до размера строки. */
+struct line_reader
+{
+    int fd;       // Дескриптор, из которого читаем
+    char *buf;    // Буфер данных
+    size_t cap;   // Ёмкость буфера
+    size_t start; // Начало ещё не выданных данных
+    size_t end;   // Конец прочитанных данных
+    size_t scan;  // Позиция, до которой '\n' уже искали (чтобы не сканировать повторно)
+    int eof;      // Флаг: read() вернул 0
+    size_t max_line; // Предел незаконченной строки в буфере (0 - строки выдаются целиком)
+    int more;        // Последняя выданная запись - кусок, строка продолжается
+    struct uring *io;   // Чтение через io_uring (NULL - обычный read)
+    struct uring_op op; // Операция чтения (в полёте не больше одной)
+    int rd_state;       // LR_RD_*
+    int rd_res;         // Результат завершённого чтения
+};
+
+enum
+{
+    LR_RD_IDLE, // Чтение не поставлено
+    LR_RD_BUSY, // В полёте
+    LR_RD_DONE, // Завершено, результат в rd_res ещё не учтён
+};
+
+/* lr_init: инициализирует читатель для fd с ёмкостью cap (0 - по умолчанию).
+   Возвращает 0 при успехе, -1 при нехватке памяти. */
+int lr_init(struct line_reader *lr, int fd, size_t cap);
+
+/* lr_use_uring: дальнейшие чтения идут через io_uring с опережением (см. выше) */
+void lr_use_uring(struct line_reader *lr, struct uring *io);
+
+/* lr_free: освобождает буфер читателя (fd не закрывается); дожидается чтения в полёте */
+void lr_free(struct line_reader *lr);
+
+/* lr_fill: выполняет один read() в свободное место буфера (при необходимости
+   сдвигает хвост или увеличивает буфер). Возвращает число прочитанных байт,
+   0 на EOF, -1 при ошибке (errno сохраняется, EINTR повторяется). */
+ssize_t lr_fill(struct line_reader *lr);
+
+/* lr_take: выдаёт очередную строку из уже прочитанных данных без системных вызовов.
+   Возвращает длину строки (вместе с '\n') и указатель в *line;
+   0 - полной строки в буфере нет (после EOF - данные закончились).
+   С max_line может выдать кусок строки (тогда lr->more = 1).
+   Указатель действителен до следующего вызова lr_fill/lr_next. */
+ssize_t lr_take(struct line_reader *lr, char **line);
+
+/* lr_next: блокирующее чтение строки: lr_take + lr_fill, пока строка не появится.
+   Возвращает длину строки, 0 на EOF, -1 при ошибке. */
+ssize_t lr_next(struct line_reader *lr, char **line);
+
+/* lr_ready: в буфере есть строка - lr_next выдаст её без системных вызовов */
+int lr_ready(struct line_reader *lr);
+
+/* lr_buffered: количество прочитанных, но ещё не выданных байт */
+static inline size_t lr_buffered(const struct line_reader *lr)
+{
+    return lr->end - lr->start;
+}
+
+/* lr_data: начало прочитанных, но ещё не выданных данных (lr_buffered байт) */
+static inline char *lr_data(const struct line_reader *lr)
+{
+    return lr->buf + lr->start;
+}
+
+/* lr_consume: помечает первые n байт из lr_data как выданные */
+static inline void lr_consume(struct line_reader *lr, size_t n)
+{
+    lr->start += n;
+}
+
+/* lr_untake: возвращает в буфер запись длины len, только что выданную lr_take, - следующий
+   lr_take выдаст её снова (поиск '\n' продолжится с её последнего байта) */
+static inline void lr_untake(struct line_reader *lr, size_t len)
+{
+    lr->start -= len;
+    lr->scan = lr->start + len - 1;
+}
+
+#endif
@@ -0,0 +1,227 @@
+#define _GNU_SOURCE
+#include <unistd.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <poll.h>
+#include <sys/uio.h>
+
+#include "merge.h"
+#include "stats.h"
+
+#define MERGE_IOV 64 // Отрезков на один writev
+
+int mg_init(struct merge *m, int n, size_t window, int out_fd)
+{
+    memset(m, 0, sizeof(*m));
+    m->n = n;
+    m->window = window ? window : MERGE_DEFAULT_WINDOW;
+    m->buf_limit = m->window / (size_t)n; // Вместе буферы не больше окна
+    if (m->buf_limit < MERGE_MIN_BUFFER)
+        m->buf_limit = MERGE_MIN_BUFFER;
+    m->out_fd = out_fd;
+    m->st_wait = st_entry("wait.merge"); // Ожидание вывода обработчиков после конца ввода
+    m->ret = calloc((size_t)n, sizeof(*m->ret));
+    if (!m->ret)
+        return -1;
+    for (int i = 0; i < n; ++i)
+        m->ret[i].fd = -1;
+    return 0;
+}
+
+void mg_free(struct merge *m)
+{
+    for (int i = 0; i < m->n; ++i)
+    {
+        if (m->ret[i].fd < 0)
+            continue;
+        close(m->ret[i].fd);
+        lr_free(&m->ret[i]);
+    }
+    free(m->ret);
+    free(m->q);
+    m->ret = NULL;
+    m->q = NULL;
+}
+
+int mg_attach(struct merge *m, int i, int fd)
+{
+    return lr_init(&m->ret[i], fd, 0);
+}
+
+/* seg_at: k-й отрезок от головы очереди */
+static struct merge_seg *seg_at(struct merge *m, size_t k)
+{
+    return &m->q[(m->qhead + k) % m->qcap];
+}
+
+int mg_note(struct merge *m, int worker, size_t bytes)
+{
+    m->inflight += bytes;
+    if (m->qlen > 0) // Тому же обработчику подряд - продолжение последнего отрезка
+    {
+        struct merge_seg *last = seg_at(m, m->qlen - 1);
+        if (last->worker == worker)
+        {
+            last->bytes += bytes;
+            return 0;
+        }
+    }
+    if (m->qlen == m->qcap) // Кольцо заполнено - удваиваем, разворачивая в начало
+    {
+        size_t ncap = m->qcap ? m->qcap * 2 : 1024;
+        struct merge_seg *nq = malloc(ncap * sizeof(*nq));
+        if (!nq)
+            return -1;
+        for (size_t k = 0; k < m->qlen; ++k)
+            nq[k] = *seg_at(m, k);
+        free(m->q);
+        m->q = nq;
+        m->qcap = ncap;
+        m->qhead = 0;
+    }
+    m->q[(m->qhead + m->qlen) % m->qcap] = (struct merge_seg){worker, bytes};
+    m->qlen++;
+    return 0;
+}
+
+int mg_want(const struct merge *m, int i)
+{
+    const struct line_reader *r = &m->ret[i];
+    if (r->fd < 0 || r->eof)
+        return 0;
+    if (m->qlen > 0 && m->q[m->qhead].worker == i) // Его вывод ждут прямо сейчас
+        return 1;
+    return lr_buffered(r) < m->buf_limit; // Остальные - пока не упёрлись в предел
+}
+
+int mg_read(struct merge *m, int i)
+{
+    return lr_fill(&m->ret[i]) < 0 ? -1 : 0;
+}
+
+/* writev_all: записывает все iovec целиком */
+static int writev_all(int fd, struct iovec *iov, int cnt)
+{
+    while (cnt > 0)
+    {
+        ssize_t w = st_writev(fd, iov, cnt);
+        if (w < 0)
+        {
+            if (errno == EINTR)
+                continue;
+            return -1;
+        }
+        while (cnt > 0 && (size_t)w >= iov->iov_len)
+        {
+            w -= (ssize_t)iov->iov_len;
+            iov++;
+            cnt--;
+        }
+        if (cnt > 0)
+        {
+            iov->iov_base = (char *)iov->iov_base + w;
+            iov->iov_len -= (size_t)w;
+        }
+    }
+    return 0;
+}
+
+int mg_pump(struct merge *m)
+{
+    int rc = 0;
+    while (m->qlen > 0)
+    {
+        /* Собираем подряд готовые отрезки в один writev. Данные одного обработчика в разных
+           отрезках идут друг за другом в его буфере: took - сколько из него уже взято. */
+        struct iovec iov[MERGE_IOV];
+        size_t took[m->n];
+        memset(took, 0, sizeof(took));
+        int cnt = 0;
+        size_t k = 0;          // Отрезков выведено целиком
+        size_t part = 0;       // Выведено из следующего за ними (не целиком)
+        while (k < m->qlen && cnt < MERGE_IOV)
+        {
+            struct merge_seg *s = seg_at(m, k);
+            struct line_reader *r = &m->ret[s->worker];
+            size_t avail = lr_buffered(r) - took[s->worker];
+            if (avail == 0 && r->eof) // Обработчик завершился раньше - его остаток не придёт
+            {
+                m->lost = 1;
+                m->inflight -= s->bytes;
+                s->bytes = 0;
+                k++;
+                continue;
+            }
+            size_t take = avail < s->bytes ? avail : s->bytes;
+            if (take > 0)
+                iov[cnt++] = (struct iovec){lr_data(r) + took[s->worker], take};
+            took[s->worker] += take;
+            if (take < s->bytes) // Дальше по порядку выводить нельзя
+            {
+                part = take;
+                break;
+            }
+            k++;
+        }
+        if (cnt == 0 && k == 0) // Голова очереди ещё не готова
+            break;
+        if (cnt > 0 && m->out_fd >= 0 && writev_all(m->out_fd, iov, cnt) < 0)
+        {
+            m->out_fd = -1; // Дальше данные только снимаются с очереди
+            rc = -1;
+        }
+        for (int i = 0; i < m->n; ++i) // Выведенное - из буферов
+        {
+            lr_consume(&m->ret[i], took[i]);
+            m->inflight -= took[i];
+        }
+        for (size_t j = 0; j < k; ++j) // Выведенные отрезки - из очереди
+        {
+            m->qhead = (m->qhead + 1) % m->qcap;
+            m->qlen--;
+        }
+        if (part > 0)
+        {
+            m->q[m->qhead].bytes -= part;
+            break; // Голова ждёт данных
+        }
+    }
+    return rc;
+}
+
+int mg_drain(struct merge *m)
+{
+    int rc = 0;
+    struct pollfd pfd[m->n];
+    int idx[m->n];
+    while (1)
+    {
+        if (mg_pump(m) < 0)
+            rc = -1;
+        if (m->qlen == 0) // Всё выведено
+            return rc;
+        int np = 0;
+        for (int i = 0; i < m->n; ++i)
+        {
+            if (!mg_want(m, i))
+                continue;
+            pfd[np] = (struct pollfd){mg_fd(m, i), POLLIN, 0};
+            idx[np++] = i;
+        }
+        if (np == 0) // Читать нечего: все каналы закрыты (остаток снимет mg_pump)
+            continue;
+        uint64_t t0 = st_now();
+        int pr = poll(pfd, (nfds_t)np, -1);
+        st_account(m->st_wait, t0, 0);
+        if (pr < 0)
+        {
+            if (errno == EINTR)
+                continue;
+            return -1;
+        }
+        for (int k = 0; k < np; ++k)
+            if (pfd[k].revents && mg_read(m, idx[k]) < 0)
+                return -1;
+    }
+}
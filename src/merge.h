@@ -0,0 +1,79 @@
+#ifndef MERGE_H
+#define MERGE_H
+
+#include <sys/types.h>
+#include <stddef.h>
+
+#include "line_reader.h"
+
+#define MERGE_DEFAULT_WINDOW (16 * 1024 * 1024) // Окно переупорядочивания по умолчанию (байт в пути)
+#define MERGE_MAX_SEGS (1024 * 1024)            // Предел очереди отрезков (строк разным обработчикам)
+#define MERGE_MIN_BUFFER (64 * 1024)            // Наименьший предел буфера вывода одного обработчика
+
+/* Режим --ordered: stdout обработчиков - каналы возврата в родителя, а родитель выводит
+   их данные одним потоком в порядке ввода.
+   Номер записи не передаётся: родитель помнит порядок раздачи как очередь отрезков
+   "обработчик, байт", а обработчик выводит записи в порядке получения и той же длины
+   (разворот длину не меняет). Поэтому следующий отрезок вывода - это ровно столько байт
+   из канала возврата указанного обработчика.
+   Память ограничена: отстающий обработчик задерживает вывод остальных, их данные копятся
+   в буферах родителя до предела, затем каналы возврата не читаются, обработчики встают,
+   а раздача останавливается, когда в пути больше окна. */
+
+/* merge_seg: подряд идущие записи одному обработчику */
+struct merge_seg
+{
+    int worker;   // Обработчик
+    size_t bytes; // Сколько байт его вывода ещё не выведено
+};
+
+struct merge
+{
+    int n;                  // Число обработчиков
+    struct line_reader *ret; // Буферы каналов возврата (как поток байтов, без разбора строк)
+    struct merge_seg *q;    // Кольцо отрезков в порядке ввода
+    size_t qcap, qhead, qlen;
+    size_t window;          // Предел байт в пути (раздано и ещё не выведено)
+    size_t inflight;        // Сейчас в пути
+    size_t buf_limit;       // Предел буфера одного обработчика, который не в голове очереди
+    int out_fd;             // Куда выводить (stdout родителя; -1 - после ошибки)
+    int lost;               // Обработчик завершился, не выдав свой вывод целиком
+    int st_wait;            // Запись статистики "wait.merge" (stats.h)
+};
+
+/* mg_init: очередь для n обработчиков с окном window байт (0 - по умолчанию). 0 или -1. */
+int mg_init(struct merge *m, int n, size_t window, int out_fd);
+void mg_free(struct merge *m);
+
+/* mg_attach: канал возврата обработчика i (конец чтения) */
+int mg_attach(struct merge *m, int i, int fd);
+
+/* mg_note: записи на bytes байт ушли обработчику worker (в порядке ввода). 0 или -1. */
+int mg_note(struct merge *m, int worker, size_t bytes);
+
+/* mg_full: окно заполнено - раздачу нужно придержать до вывода */
+static inline int mg_full(const struct merge *m)
+{
+    return m->inflight >= m->window || m->qlen >= MERGE_MAX_SEGS;
+}
+
+/* mg_want: стоит читать канал возврата обработчика i (его вывод нужен сейчас или есть место) */
+int mg_want(const struct merge *m, int i);
+
+/* mg_fd: канал возврата обработчика i */
+static inline int mg_fd(const struct merge *m, int i)
+{
+    return m->ret[i].fd;
+}
+
+/* mg_read: один read() из готового канала возврата. 0 или -1 при ошибке. */
+int mg_read(struct merge *m, int i);
+
+/* mg_pump: выводит всё, что уже можно вывести по порядку. 0 или -1 при ошибке вывода. */
+int mg_pump(struct merge *m);
+
+/* mg_drain: после конца ввода - читает каналы возврата и выводит, пока очередь не опустеет
+   и обработчики не закроют каналы. 0 или -1. */
+int mg_drain(struct merge *m);
+
+#endif
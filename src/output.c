@@ -0,0 +1,608 @@
+#define _GNU_SOURCE
+#include <unistd.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/uio.h>
+#include <sys/stat.h>
+#include <limits.h>
+
+#include "output.h"
+#include "frame.h" // now_ns
+#include "stats.h"
+
+/* writev_all: записывает все iovec целиком (с повтором после частичной записи) */
+static int writev_all(int fd, struct iovec *iov, int cnt)
+{
+    while (cnt > 0)
+    {
+        ssize_t w = st_writev(fd, iov, cnt);
+        if (w < 0)
+        {
+            if (errno == EINTR) // Прервано сигналом - повторяем
+                continue;
+            return -1;
+        }
+        while (cnt > 0 && (size_t)w >= iov->iov_len) // Пропускаем записанные целиком
+        {
+            w -= (ssize_t)iov->iov_len;
+            iov++;
+            cnt--;
+        }
+        if (cnt > 0) // И записанную часть следующего
+        {
+            iov->iov_base = (char *)iov->iov_base + w;
+            iov->iov_len -= (size_t)w;
+        }
+    }
+    return 0;
+}
+
+/* seg_len: длина первой порции p[0..n) не длиннее limit, заканчивающейся на границе строки.
+   Строка длиннее limit уходит целиком (атомарной её запись всё равно не сделать). */
+static size_t seg_len(const char *p, size_t n, size_t limit)
+{
+    if (n <= limit)
+        return n;
+    const char *nl = memrchr(p, '\n', limit); // Последний конец строки, который помещается
+    if (!nl)
+        nl = memchr(p + limit, '\n', n - limit); // Строка длиннее limit
+    return nl ? (size_t)(nl - p) + 1 : n;
+}
+
+/* write_lines: запись в общий для обработчиков канал порциями не больше PIPE_BUF по границам
+   строк - такие записи атомарны, и строки соседей не перемешиваются */
+static int write_lines(int fd, const struct iovec *iov, int cnt)
+{
+    for (int i = 0; i < cnt; ++i) // Каждый элемент - целые строки
+    {
+        const char *p = iov[i].iov_base;
+        size_t left = iov[i].iov_len;
+        while (left > 0)
+        {
+            struct iovec seg = {(void *)p, seg_len(p, left, PIPE_BUF)};
+            size_t n = seg.iov_len;
+            if (writev_all(fd, &seg, 1) < 0)
+                return -1;
+            p += n;
+            left -= n;
+        }
+    }
+    return 0;
+}
+
+/* is_kind: fd - открыт и указанного типа (S_IFIFO, S_IFREG) */
+static int is_kind(int fd, mode_t kind)
+{
+    struct stat st;
+    return fd >= 0 && fstat(fd, &st) == 0 && (st.st_mode & S_IFMT) == kind;
+}
+
+int ow_init(struct out_writer *ow, int out_fd, int file_fd, size_t cap, int deadline_ms, int use_tee)
+{
+    memset(ow, 0, sizeof(*ow));
+    ow->out_fd = out_fd;
+    ow->file_fd = file_fd;
+    ow->cap = cap ? cap : OUT_DEFAULT_BYTES;
+    ow->deadline_ns = (uint64_t)(deadline_ms >= 0 ? deadline_ms : OUT_DEFAULT_DEADLINE_MS) * 1000000ull;
+    ow->tee_pipe[0] = ow->tee_pipe[1] = -1;
+    ow->buf = malloc(ow->cap);
+    if (!ow->buf)
+        return -1;
+    ow->out_pipe = is_kind(out_fd, S_IFIFO); // stdout - общий канал всех обработчиков
+    /* tee() работает только между каналами, splice() - из канала в файл */
+    if (use_tee && is_kind(out_fd, S_IFIFO) && is_kind(file_fd, S_IFREG) &&
+        pipe2(ow->tee_pipe, O_CLOEXEC) == 0)
+    {
+        fcntl(ow->tee_pipe[1], F_SETPIPE_SZ, (int)ow->cap); // Весь буфер за один проход (если разрешено)
+        /* Запись неблокирующая: больше ёмкости канала за раз не кладём, читатель - мы сами */
+        fcntl(ow->tee_pipe[1], F_SETFL, O_NONBLOCK);
+    }
+    return 0;
+}
+
+/* tee_off: выключает режим tee (внутренний канал пуст) */
+static void tee_off(struct out_writer *ow)
+{
+    close(ow->tee_pipe[0]);
+    close(ow->tee_pipe[1]);
+    ow->tee_pipe[0] = ow->tee_pipe[1] = -1;
+}
+
+void ow_free(struct out_writer *ow)
+{
+    if (ow->io) // Буферы режима io_uring (buf - один из них)
+        for (int i = 0; i < OUT_URING_BUFS; ++i)
+            free(ow->bufs[i].data);
+    else
+        free(ow->buf);
+    ow->buf = NULL;
+    if (ow_tee(ow))
+        tee_off(ow);
+}
+
+/* pipe_consume: извлекает n байт из внутреннего канала - в файл, а если файл отключён, в никуда */
+static int pipe_consume(struct out_writer *ow, size_t n)
+{
+    int err = 0;
+    char sink[4096];
+    while (n > 0)
+    {
+        ssize_t s;
+        if (ow->file_fd >= 0)
+        {
+            s = splice(ow->tee_pipe[0], NULL, ow->file_fd, NULL, n, SPLICE_F_MOVE);
+            if (s < 0 && errno == EINTR)
+                continue;
+            if (s <= 0) // Файл не принимает - дальше только stdout
+            {
+                err |= OUT_ERR_FILE;
+                ow->file_fd = -1;
+                continue;
+            }
+        }
+        else
+        {
+            s = read(ow->tee_pipe[0], sink, n < sizeof(sink) ? n : sizeof(sink));
+            if (s < 0 && errno == EINTR)
+                continue;
+            if (s <= 0)
+                break;
+        }
+        n -= (size_t)s;
+    }
+    return err;
+}
+
+static int ow_send(struct out_writer *ow, struct iovec *iov, int cnt);
+
+/* tee_send: режим tee. Данные копируются во внутренний канал один раз (порциями до его
+   ёмкости); tee() дублирует их в stdout, не извлекая, а pipe_consume() переносит те же байты
+   в файл. tee() не атомарен, поэтому stdout не должен быть общим с другими писателями. */
+static int tee_send(struct out_writer *ow, struct iovec *iov, int cnt)
+{
+    int err = 0;
+    for (int i = 0; i < cnt; ++i)
+    {
+        const char *p = iov[i].iov_base;
+        size_t left = iov[i].iov_len;
+        while (left > 0)
+        {
+            ssize_t w = write(ow->tee_pipe[1], p, left); // Канал пуст: примет до своей ёмкости
+            if (w < 0)
+            {
+                if (errno == EINTR)
+                    continue;
+                tee_off(ow); // Внутренний канал пуст - остаток обычным writev
+                struct iovec rest[2] = {{(void *)p, left}};
+                int nrest = 1;
+                if (i + 1 < cnt)
+                    rest[nrest++] = iov[i + 1];
+                return err | ow_send(ow, rest, nrest);
+            }
+            size_t round = (size_t)w;
+            while (round > 0) // Опустошаем внутренний канал
+            {
+                size_t t = round;
+                if (ow->out_fd >= 0)
+                {
+                    ssize_t r = tee(ow->tee_pipe[0], ow->out_fd, round, 0); // Частично, если stdout заполнен
+                    if (r < 0 && errno == EINTR)
+                        continue;
+                    if (r <= 0) // stdout больше не принимает
+                    {
+                        err |= OUT_ERR_STDOUT;
+                        ow->out_fd = -1;
+                    }
+                    else
+                        t = (size_t)r;
+                }
+                err |= pipe_consume(ow, t); // Ровно то, что ушло в stdout, - в файл
+                p += t;
+                round -= t;
+                left -= t;
+            }
+        }
+    }
+    if (ow->file_fd < 0) // Дублировать больше некуда
+        tee_off(ow);
+    return err;
+}
+
+/* gz_send: iovec - в конвейер сжатия; после ошибки он отключается */
+static int gz_send(struct out_writer *ow, const struct iovec *iov, int cnt)
+{
+    for (int i = 0; i < cnt; ++i)
+        if (gzw_write(ow->gz, iov[i].iov_base, iov[i].iov_len) < 0)
+        {
+            ow->gz = NULL;
+            return OUT_ERR_FILE;
+        }
+    return 0;
+}
+
+void ow_use_gzip(struct out_writer *ow, struct gzip_writer *gz)
+{
+    ow->gz = gz;
+}
+
+/* sink_send: iovec - в слой файла; после ошибки он отключается */
+static int sink_send(struct out_writer *ow, const struct iovec *iov, int cnt)
+{
+    for (int i = 0; i < cnt; ++i)
+        if (fs_write(ow->sink, iov[i].iov_base, iov[i].iov_len) < 0)
+        {
+            ow->sink = NULL;
+            return OUT_ERR_FILE;
+        }
+    return 0;
+}
+
+void ow_use_sink(struct out_writer *ow, struct file_sink *sink)
+{
+    ow->sink = sink;
+}
+
+/* ow_send: отправляет iovec во все приёмники; приёмник с ошибкой отключается */
+static int ow_send(struct out_writer *ow, struct iovec *iov, int cnt)
+{
+    if (ow_tee(ow))
+        return tee_send(ow, iov, cnt);
+    int err = 0;
+    if (ow->out_fd >= 0)
+    {
+        int r;
+        if (ow->out_pipe)
+            r = write_lines(ow->out_fd, iov, cnt);
+        else
+        {
+            struct iovec copy[2];
+            memcpy(copy, iov, sizeof(*iov) * (size_t)cnt); // writev_all сдвигает iovec
+            r = writev_all(ow->out_fd, copy, cnt);
+        }
+        if (r < 0)
+        {
+            err |= OUT_ERR_STDOUT;
+            ow->out_fd = -1;
+        }
+    }
+    if (ow->file_fd >= 0 && writev_all(ow->file_fd, iov, cnt) < 0)
+    {
+        err |= OUT_ERR_FILE;
+        ow->file_fd = -1;
+    }
+    if (ow->gz) // Файл пишется сжатым: данные копируются в блок конвейера
+        err |= gz_send(ow, iov, cnt);
+    else if (ow->sink)
+        err |= sink_send(ow, iov, cnt);
+    return err;
+}
+
+/* ---- Режим io_uring ---- */
+
+#define OUT_BUF_OF(op, field) ((struct out_buf *)((char *)(op) - offsetof(struct out_buf, field)))
+
+/* prep_write: запись части буфера b (WRITE_FIXED, если буферы зарегистрированы) */
+static void prep_write(struct out_writer *ow, struct io_uring_sqe *sqe, int fd, struct out_buf *b,
+                       size_t pos, size_t len, uint64_t off)
+{
+    sqe->opcode = ow->fixed ? IORING_OP_WRITE_FIXED : IORING_OP_WRITE;
+    sqe->fd = fd;
+    sqe->addr = (uint64_t)(uintptr_t)(b->data + pos);
+    sqe->len = (unsigned)len;
+    sqe->off = off;
+    if (ow->fixed)
+        sqe->buf_index = (uint16_t)(b - ow->bufs);
+}
+
+/* room: есть место под n записей. Вне колбэков - ждём его (при отказе кольца приёмник
+   отключается: без этого ow_close ждал бы вечно). */
+static int room(struct out_writer *ow, unsigned n, int blocking, int sink)
+{
+    if (!blocking)
+        return uring_room(ow->io, n);
+    if (uring_reserve(ow->io, n) == 0)
+        return 1;
+    ow->async_err |= sink;
+    if (sink == OUT_ERR_FILE)
+        ow->file_fd = -1;
+    else
+        ow->out_fd = -1;
+    return 0;
+}
+
+/* file_write: ставит запись в файл недописанного остатка буфера */
+static void file_write(struct out_writer *ow, struct out_buf *b)
+{
+    struct io_uring_sqe *sqe = uring_sqe(ow->io, &b->file_op);
+    prep_write(ow, sqe, ow->file_fd, b, b->file_done, b->len - b->file_done,
+               (uint64_t)(b->file_off + (off_t)b->file_done));
+    b->file_busy = 1;
+}
+
+/* out_chain: ставит цепочку записей остатка буфера в канал stdout порциями до PIPE_BUF по
+   границам строк. Записи связаны IOSQE_IO_LINK: ядро выполняет их по порядку, а после короткой
+   записи отменяет остальные - тогда цепочка продолжается с записанного места. 0 - нет места. */
+static int out_chain(struct out_writer *ow, struct out_buf *b, int blocking)
+{
+    size_t seg[OUT_URING_CHAIN];
+    unsigned n = 0;
+    for (size_t pos = b->out_done; pos < b->len && n < OUT_URING_CHAIN; pos += seg[n++])
+        seg[n] = seg_len(b->data + pos, b->len - pos, PIPE_BUF);
+    if (!room(ow, n, blocking, OUT_ERR_STDOUT)) // Цепочка уходит в ядро только целиком
+        return 0;
+    size_t pos = b->out_done;
+    for (unsigned i = 0; i < n; ++i)
+    {
+        struct io_uring_sqe *sqe = uring_sqe(ow->io, &b->out_op);
+        prep_write(ow, sqe, ow->out_fd, b, pos, seg[i], (uint64_t)-1); // Текущая позиция stdout
+        if (i + 1 < n)
+            sqe->flags |= IOSQE_IO_LINK;
+        pos += seg[i];
+    }
+    b->out_inflight = n;
+    return 1;
+}
+
+/* release: освобождает буферы, записанные в оба приёмника */
+static void release(struct out_writer *ow)
+{
+    for (int i = 0; i < OUT_URING_BUFS; ++i)
+    {
+        struct out_buf *b = &ow->bufs[i];
+        if (b->busy && !b->file_busy && !b->out_queued && (ow->file_fd < 0 || b->file_done == b->len))
+            b->busy = 0;
+    }
+}
+
+/* kick: ставит назревшие записи: дозапись файла после короткой записи и цепочку stdout для
+   головы очереди. blocking - можно ждать места в кольце (не из колбэка). */
+static void kick(struct out_writer *ow, int blocking)
+{
+    ow->kicking = 1; // Колбэки, сработавшие при ожидании места, только обновляют счётчики
+    for (int i = 0; i < OUT_URING_BUFS; ++i)
+    {
+        struct out_buf *b = &ow->bufs[i];
+        if (b->busy && !b->file_busy && ow->file_fd >= 0 && b->file_done < b->len &&
+            room(ow, 1, blocking, OUT_ERR_FILE))
+            file_write(ow, b);
+    }
+    struct out_buf *b;
+    while ((b = ow->out_head) && b->out_inflight == 0)
+    {
+        if (ow->out_fd >= 0 && b->out_done < b->len) // Цепочка не начата или прервана
+        {
+            out_chain(ow, b, blocking);
+            break;
+        }
+        ow->out_head = b->next; // Записан (или stdout отключён) - следующий по очереди
+        if (!ow->out_head)
+            ow->out_tail = NULL;
+        b->out_queued = 0;
+    }
+    release(ow);
+    ow->kicking = 0;
+}
+
+/* progress: после завершения записи */
+static void progress(struct out_writer *ow)
+{
+    if (ow->kicking)
+        release(ow);
+    else
+        kick(ow, 0);
+}
+
+static void file_done(struct uring_op *op, int res)
+{
+    struct out_buf *b = OUT_BUF_OF(op, file_op);
+    struct out_writer *ow = b->ow;
+    b->file_busy = 0;
+    if (res > 0)
+        b->file_done += (size_t)res; // Короткая запись - остаток допишет kick
+    else if (res != -EINTR && res != -EAGAIN && ow->file_fd >= 0) // Файл не принимает
+    {
+        ow->async_err |= OUT_ERR_FILE;
+        ow->file_fd = -1;
+    }
+    progress(ow);
+}
+
+static void out_done(struct uring_op *op, int res)
+{
+    struct out_buf *b = OUT_BUF_OF(op, out_op);
+    struct out_writer *ow = b->ow;
+    b->out_inflight--;
+    if (res > 0)
+        b->out_done += (size_t)res;
+    else if (res != -ECANCELED && res != -EINTR && res != -EAGAIN && ow->out_fd >= 0)
+    {
+        ow->async_err |= OUT_ERR_STDOUT;
+        ow->out_fd = -1;
+    }
+    if (b->out_inflight == 0) // Цепочка завершена - продолжение или следующий буфер
+        progress(ow);
+}
+
+/* take_err: забирает накопленные ошибки завершившихся записей */
+static int take_err(struct out_writer *ow)
+{
+    int err = ow->async_err;
+    ow->async_err = 0;
+    return err;
+}
+
+/* any_busy: есть буферы, отданные ядру */
+static int any_busy(const struct out_writer *ow)
+{
+    for (int i = 0; i < OUT_URING_BUFS; ++i)
+        if (ow->bufs[i].busy)
+            return 1;
+    return 0;
+}
+
+/* wait_progress: ставит назревшие записи и ждёт завершения хотя бы одной */
+static void wait_progress(struct out_writer *ow)
+{
+    kick(ow, 1);
+    if (uring_submit(ow->io, 1) < 0) // Кольцо отказало - дальше писать некуда
+    {
+        ow->async_err |= (ow->out_fd >= 0 ? OUT_ERR_STDOUT : 0) | (ow->file_fd >= 0 ? OUT_ERR_FILE : 0);
+        ow->out_fd = ow->file_fd = -1;
+        for (int i = 0; i < OUT_URING_BUFS; ++i)
+            ow->bufs[i].busy = ow->bufs[i].out_queued = 0;
+        ow->out_head = ow->out_tail = NULL;
+    }
+}
+
+/* uring_flush: отдаёт заполненный буфер ядру и переходит к свободному */
+static int uring_flush(struct out_writer *ow)
+{
+    struct out_buf *b = ow->cur;
+    b->len = ow->len;
+    b->file_off = ow->file_off;
+    b->file_done = b->out_done = 0;
+    b->busy = 1;
+    ow->file_off += (off_t)ow->len;
+    ow->len = 0;
+    if (ow->gz) // Сжимается копия - буфер отдаётся ядру только для stdout
+    {
+        struct iovec iov[1] = {{b->data, b->len}};
+        ow->async_err |= gz_send(ow, iov, 1);
+    }
+    if (ow->out_fd >= 0 && !ow->out_pipe)
+    {
+        /* stdout - файл или терминал, общий с соседями: io_uring пишет по общей позиции файла
+           без блокировки, которую берёт write(), и записи обработчиков затирали бы друг друга */
+        struct iovec iov[1] = {{b->data, b->len}};
+        if (writev_all(ow->out_fd, iov, 1) < 0)
+        {
+            ow->async_err |= OUT_ERR_STDOUT;
+            ow->out_fd = -1;
+        }
+    }
+    else if (ow->out_fd >= 0) // В очередь на stdout
+    {
+        b->out_queued = 1;
+        b->next = NULL;
+        if (ow->out_tail)
+            ow->out_tail->next = b;
+        else
+            ow->out_head = b;
+        ow->out_tail = b;
+    }
+    kick(ow, 1);
+    if (uring_submit(ow->io, 0) < 0) // В ядро сразу, не дожидаясь заполнения следующего
+        wait_progress(ow);
+    while (1) // Следующий свободный буфер; все заняты - ждём, пока ядро допишет какой-нибудь
+    {
+        for (int i = 0; i < OUT_URING_BUFS; ++i)
+            if (!ow->bufs[i].busy)
+            {
+                ow->cur = &ow->bufs[i];
+                ow->buf = ow->cur->data;
+                return take_err(ow);
+            }
+        wait_progress(ow);
+    }
+}
+
+int ow_use_uring(struct out_writer *ow, struct uring *io)
+{
+    off_t pos = 0;
+    if (ow->file_fd >= 0 && (pos = lseek(ow->file_fd, 0, SEEK_CUR)) < 0) // Нужна запись по смещению
+        return -1;
+    struct iovec iov[OUT_URING_BUFS];
+    for (int i = 0; i < OUT_URING_BUFS; ++i)
+    {
+        struct out_buf *b = &ow->bufs[i];
+        memset(b, 0, sizeof(*b));
+        b->ow = ow;
+        b->file_op.done = file_done;
+        b->out_op.done = out_done;
+        b->data = i == 0 ? ow->buf : malloc(ow->cap); // Первый - уже выделенный буфер
+        if (!b->data)
+        {
+            while (--i > 0)
+                free(ow->bufs[i].data);
+            return -1;
+        }
+        iov[i] = (struct iovec){b->data, ow->cap};
+    }
+    if (ow_tee(ow))
+        tee_off(ow);
+    ow->io = io;
+    ow->cur = &ow->bufs[0];
+    ow->file_off = pos;
+    ow->fixed = uring_register_buffers(io, iov, OUT_URING_BUFS) == 0; // Иначе (лимит memlock) - обычный WRITE
+    return 0;
+}
+
+int ow_close(struct out_writer *ow)
+{
+    int err = ow_flush(ow);
+    if (!ow->io)
+        return err;
+    while (any_busy(ow))
+        wait_progress(ow);
+    return err | take_err(ow);
+}
+
+int ow_flush(struct out_writer *ow)
+{
+    if (ow->len == 0)
+        return 0;
+    if (ow->io)
+        return uring_flush(ow);
+    struct iovec iov[1] = {{ow->buf, ow->len}};
+    ow->len = 0;
+    return ow_send(ow, iov, 1);
+}
+
+/* uring_add: ow_add в режиме io_uring. Строка всегда копируется: буферы живут, пока ядро
+   их пишет, а буфер источника переиспользуется сразу. Большая строка - по частям. */
+static int uring_add(struct out_writer *ow, const char *rec, size_t len)
+{
+    int err = 0;
+    if (ow->len + len > ow->cap && ow->len > 0) // Не помещается - сначала отдаём буфер
+        err = uring_flush(ow);
+    while (len > 0)
+    {
+        if (ow->len == 0)
+            ow->first_ns = now_ns();
+        size_t n = ow->cap - ow->len < len ? ow->cap - ow->len : len;
+        memcpy(ow->buf + ow->len, rec, n);
+        ow->len += n;
+        rec += n;
+        len -= n;
+        if (ow->len == ow->cap)
+            err |= uring_flush(ow);
+    }
+    if (ow->len > 0 && now_ns() - ow->first_ns >= ow->deadline_ns) // Пора
+        err |= uring_flush(ow);
+    return err | take_err(ow);
+}
+
+int ow_add(struct out_writer *ow, const char *rec, size_t len)
+{
+    if (ow->io)
+        return uring_add(ow, rec, len);
+    if (len >= ow->cap / 2) // Большая строка - без копирования, вместе с накопленным
+    {
+        struct iovec iov[2] = {{ow->buf, ow->len}, {(void *)rec, len}};
+        int first = ow->len == 0;
+        ow->len = 0;
+        return ow_send(ow, iov + first, 2 - first);
+    }
+    int err = 0;
+    if (ow->len + len > ow->cap) // Не помещается - сначала отправляем буфер
+        err = ow_flush(ow);
+    if (ow->len == 0)
+        ow->first_ns = now_ns();
+    memcpy(ow->buf + ow->len, rec, len);
+    ow->len += len;
+    if (ow->len == ow->cap || now_ns() - ow->first_ns >= ow->deadline_ns) // Заполнен или пора
+        err |= ow_flush(ow);
+    return err;
+}
@@ -0,0 +1,115 @@
+#ifndef OUTPUT_H
+#define OUTPUT_H
+
+#include <sys/types.h>
+#include <stdint.h>
+#include <stddef.h>
+
+#include "uring.h"
+#include "gzip_writer.h"
+#include "file_sink.h"
+
+#define OUT_DEFAULT_BYTES (256 * 1024) // Буфер вывода обработчика по умолчанию
+#define OUT_DEFAULT_DEADLINE_MS 10     // Наибольшая задержка строки в буфере по умолчанию
+
+/* Ошибки вывода (битовая маска): после ошибки приёмник отключается, второй продолжает работать */
+#define OUT_ERR_STDOUT 0x1
+#define OUT_ERR_FILE 0x2
+
+#define OUT_URING_BUFS 4   // Буферов в режиме io_uring: один заполняется, остальные пишутся
+#define OUT_URING_CHAIN 32 // Наибольшая цепочка записей в stdout за раз
+
+struct out_writer;
+
+/* out_buf: буфер режима io_uring. Отданный ядру буфер пишется в файл по своему смещению
+   (записи разных буферов идут параллельно) и в канал stdout - цепочкой IOSQE_IO_LINK; цепочки
+   разных буферов идут строго по очереди, чтобы порядок строк в stdout сохранялся.
+   stdout, который не канал, пишется синхронно (см. uring_flush).
+   Буфер снова свободен, когда записан в оба приёмника. */
+struct out_buf
+{
+    struct out_writer *ow;   // Владелец (для колбэков)
+    struct uring_op file_op; // Запись в файл
+    struct uring_op out_op;  // Записи цепочки в stdout
+    char *data;
+    size_t len;              // Сколько отдано ядру
+    off_t file_off;          // Смещение буфера в файле
+    size_t file_done;        // Записано в файл
+    size_t out_done;         // Записано в stdout
+    unsigned out_inflight;   // Записей цепочки в полёте
+    int file_busy;           // Запись в файл в полёте
+    int out_queued;          // Буфер в очереди на stdout
+    int busy;                // Отдан ядру
+    struct out_buf *next;    // Следующий в очереди на stdout
+};
+
+/* out_writer: вывод обработчика в stdout и выходной файл.
+   Строки копируются в один буфер и уходят одним writev на приёмник, когда буфер заполнен,
+   строка ждёт дольше дедлайна, ввод временно иссяк (ow_flush) или данные закончились.
+   Строка не меньше половины буфера не копируется: она уходит вместе с буфером одним writev.
+   stdout общий для всех обработчиков: если это канал, запись в него идёт по границам строк
+   порциями не больше PIPE_BUF (атомарно), чтобы строки разных обработчиков не перемешивались.
+   В режиме tee (stdout - канал, файл - обычный файл) данные попадают во внутренний канал
+   один раз: tee() дублирует их в stdout, splice() переносит в файл. tee() не атомарен,
+   поэтому режим годится, только когда stdout принадлежит одному обработчику. */
+struct out_writer
+{
+    int out_fd;         // stdout (-1 - отключён после ошибки)
+    int file_fd;        // Выходной файл (-1 - нет или отключён)
+    char *buf;          // Накопленные строки
+    size_t cap;         // Ёмкость буфера
+    size_t len;         // Занято байт
+    uint64_t first_ns;  // Когда в пустой буфер попала первая строка
+    uint64_t deadline_ns; // Дедлайн отправки
+    int out_pipe;       // stdout - канал: пишем по границам строк порциями до PIPE_BUF
+    int tee_pipe[2];    // Режим tee: внутренний канал (-1 - режим выключен)
+    struct gzip_writer *gz; // Файл пишется сжатым (ow_use_gzip); NULL - как есть или отключён
+    struct file_sink *sink; // Файл пишется через слой file_sink (ow_use_sink); NULL - writev в file_fd
+    /* Режим io_uring (ow_use_uring) */
+    struct uring *io;   // NULL - синхронные writev
+    struct out_buf bufs[OUT_URING_BUFS];
+    struct out_buf *cur;              // Заполняемый буфер (buf == cur->data)
+    struct out_buf *out_head, *out_tail; // Очередь на stdout
+    off_t file_off;     // Смещение следующего буфера в файле
+    int fixed;          // Буферы зарегистрированы - WRITE_FIXED
+    int kicking;        // Идёт kick(): колбэки новые записи не ставят
+    int async_err;      // Ошибки завершившихся записей (OUT_ERR_*)
+};
+
+/* ow_init: cap - размер буфера (0 - по умолчанию), deadline_ms - задержка (<0 - по умолчанию),
+   use_tee - пробовать режим tee (если приёмники не подходят, остаётся writev).
+   Возвращает 0 или -1 при нехватке памяти. */
+int ow_init(struct out_writer *ow, int out_fd, int file_fd, size_t cap, int deadline_ms, int use_tee);
+
+/* ow_add: добавляет строку. Возвращает маску OUT_ERR_* (0 - без ошибок). */
+int ow_add(struct out_writer *ow, const char *rec, size_t len);
+
+/* ow_flush: отправляет накопленное. Возвращает маску OUT_ERR_*. */
+int ow_flush(struct out_writer *ow);
+
+/* ow_use_uring: дальше буферы пишутся через io_uring: заполнение следующего буфера идёт,
+   пока ядро пишет предыдущие. Режим tee выключается. -1 - режим недоступен (нехватка памяти
+   или файл без позиционной записи), вывод остаётся синхронным. */
+int ow_use_uring(struct out_writer *ow, struct uring *io);
+
+/* ow_use_gzip: файловая сторона вывода идёт в конвейер сжатия gz вместо file_fd (см. gzip_writer.h).
+   Вызывается сразу после ow_init с file_fd = -1; gz закрывает вызывающий после ow_close. */
+void ow_use_gzip(struct out_writer *ow, struct gzip_writer *gz);
+
+/* ow_use_sink: файловая сторона вывода идёт в sink вместо writev в file_fd (см. file_sink.h).
+   Вызывается сразу после ow_init с file_fd = -1; sink закрывает вызывающий после ow_close. */
+void ow_use_sink(struct out_writer *ow, struct file_sink *sink);
+
+/* ow_close: отправляет накопленное и дожидается всех записей. Возвращает маску OUT_ERR_*. */
+int ow_close(struct out_writer *ow);
+
+/* ow_tee: включён ли режим tee */
+static inline int ow_tee(const struct out_writer *ow)
+{
+    return ow->tee_pipe[0] >= 0;
+}
+
+/* ow_free: освобождает буфер и внутренний канал (приёмники не закрываются) */
+void ow_free(struct out_writer *ow);
+
+#endif
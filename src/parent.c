@@ -4,8 +4,35 @@
 #include <string.h>
 #include <sys/wait.h>
 #include <errno.h>
+#include <poll.h>
+#include <getopt.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <sys/epoll.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <limits.h>
+#include <pthread.h>
+#include <signal.h>
+#include <spawn.h>
+#include <sys/socket.h>
+#include <sys/un.h>
 
-#define BUF_CHUNK 1024
+#include "line_reader.h"
+#include "frame.h"
+#include "transport.h"
+#include "line_index.h"
+#include "merge.h"
+#include "stats.h"
+#include "worker_core.h"
+#include "reverse.h"
+#include "jobs.h"
+#include "gzip_writer.h"
+#include "file_sink.h"
+#include "rev_pool.h"
+#include "transform.h"
+#include "line_cache.h"
+#include "topology.h"
 
 /* write_all: безопасная обёртка для write (пишет все байты) */
 static ssize_t write_all(int fd, const void *buf, size_t count)
@@ -27,228 +54,2158 @@ static ssize_t write_all(int fd, const void *buf, size_t count)
     return (ssize_t)count; // Возвращаем количество записанных байт
 }
 
-/* read_line_from_fd: читает из fd до '\n' (включительно) или до EOF.
-   Возвращает длину прочитанных байт и помещает pointer в *out (malloc — нужно free).
-   Возвращает 0 и *out=NULL на EOF (если ничего не прочитано).
-   Возвращает -1 при ошибке. */
-static ssize_t read_line_from_fd(int fd, char **out)
+/* eprint: вывод ошибки в stderr через write */
+static void eprint(const char *s)
+{
+    if (s)                          // Если строка не NULL
+        write_all(2, s, strlen(s)); // Выводим её в stderr (файловый дескриптор 2)
+}
+
+/* read_filename: читает строку из lr и возвращает её копию без '\n' (malloc — нужно free).
+   Возвращает NULL на EOF или при ошибке. */
+static char *read_filename(struct line_reader *lr)
+{
+    char *line;
+    ssize_t len = lr_next(lr, &line); // Строка указывает внутрь буфера читателя
+    if (len <= 0)
+        return NULL;
+    if (line[len - 1] == '\n') // Отбрасываем символ новой строки
+        len--;
+    return strndup(line, (size_t)len); // Копия нужна: буфер читателя будет переиспользован
+}
+
+#define MAX_WORKERS 64 // Предел числа дочерних процессов
+
+#define DEFAULT_QUEUE_KB 4096 // Предел очереди исходящих фреймов одного обработчика по умолчанию
+#define DEFAULT_PIPE_KB 1024   // Ёмкость канала к обработчику по умолчанию (F_SETPIPE_SZ)
+
+/* Режим распределения строк между обработчиками */
+enum dispatch_mode
+{
+    DISPATCH_RR,    // По кругу по номеру строки (детерминированно)
+    DISPATCH_LEAST, // Каждый новый фрейм - наименее загруженному обработчику
+    DISPATCH_HASH,  // По хешу содержимого строки: одинаковые строки - одному обработчику
+};
+
+/* Длинные параметры без короткого эквивалента */
+enum
+{
+    OPT_OUT_BUFFER = 256,
+    OPT_OUT_DEADLINE,
+    OPT_TEE,
+    OPT_IO_URING,
+    OPT_INPUT,
+    OPT_ORDERED,
+    OPT_STATS,
+    OPT_THREADS,
+    OPT_DAEMON,
+    OPT_CONNECT,
+    OPT_GZIP,
+    OPT_GZIP_THREADS,
+    OPT_DIRECT,
+    OPT_SYNC,
+    OPT_WRITEBACK,
+    OPT_SPILL,
+    OPT_REV_THREADS,
+    OPT_TRANSFORM,
+    OPT_CACHE,
+    OPT_PLACEMENT,
+};
+
+/* options: параметры командной строки родителя */
+struct options
+{
+    int nworkers;            // Число обработчиков
+    const char *tmpl;        // Шаблон имён выходных файлов
+    enum dispatch_mode mode; // Режим распределения строк
+    const char *route_path;  // Журнал распределения строк
+    size_t frame_bytes;      // Предел размера фрейма
+    uint32_t frame_records;  // Предел числа записей во фрейме
+    int deadline_ms;         // Дедлайн отправки неполного фрейма
+    enum transport_kind transport; // Транспорт к обработчикам
+    int transport_set;       // Транспорт задан явно
+    size_t queue_limit;      // Предел очереди исходящих фреймов (pipe) или размер кольца (shm), байт
+    size_t chunk_size;       // Режим фрагментов: целевой размер фрагмента (0 - построчный режим)
+    int pipe_size;           // Желаемая ёмкость канала (байт)
+    int pipe_size_set;       // Ёмкость задана явно (тогда о неудаче сообщаем)
+    int utf8;                // Обработчики разворачивают строки по символам UTF-8
+    const char *xform;       // Цепочка преобразований обработчиков (transform.h); NULL - разворот
+    const char *out_kb;      // Буфер вывода обработчиков, КиБ (NULL - по умолчанию)
+    const char *out_ms;      // Задержка строки в буфере вывода, мс (NULL - по умолчанию)
+    int tee;                 // Обработчики дублируют вывод в stdout через tee()
+    int io_uring;            // Обработчики читают и пишут через io_uring
+    const char *input;       // Входной файл (режим описателей, см. line_index.h); NULL - stdin
+    int ordered;             // Вывод обработчиков собирается родителем в порядке ввода (merge.h)
+    size_t order_window;     // Окно переупорядочивания, байт (0 - по умолчанию)
+    int stats;               // Отчёт статистики при выходе
+    const char *stats_path;  // Куда писать отчёты (NULL - stderr)
+    int threads;             // Обработчики - потоки родителя, а не процессы (worker_core.h)
+    const char *daemon;      // Режим демона: сокет, на котором принимаются задания (jobs.h)
+    const char *connect;     // Режим клиента: сокет демона, которому отдаётся задание
+    int gzip_level;          // Обработчики сжимают файлы gzip (1..9); 0 - пишут как есть
+    int gzip_threads;        // Предел потоков сжатия у обработчика (<0 - по числу процессоров)
+    struct fs_conf file;     // Запись выходных файлов обработчиками (file_sink.h)
+    const char *sync;        // Политика sync как задана (NULL - none)
+    const char *writeback;   // Окно фоновой записи, МиБ (NULL - выключено)
+    const char *spill;       // Строку длиннее стольких МиБ обработчик собирает во временном файле (NULL - по умолчанию)
+    int cache_mb;            // Кэш результатов обработчика, МиБ (<0 - по умолчанию: только в режиме hash)
+    int rev_threads;         // Предел помощников разворота длинных строк у обработчика (<0 - по числу процессоров)
+    enum tp_policy placement; // Размещение родителя и обработчиков по процессорам (topology.h)
+};
+
+/* worker: состояние одного дочернего процесса-обработчика */
+struct worker
+{
+    pid_t pid;          // PID дочернего процесса
+    char *filename;     // Выходной файл обработчика
+    struct channel ch;  // Транспорт к нему (см. transport.h)
+    uint32_t events;    // События, на которые его дескриптор сейчас подписан в epoll
+    uint64_t out_off;   // Режим --input: смещение следующей строки в его выходном файле
+    uint64_t out_size;  // Режим --input: итоговый размер файла, если известен заранее (0 - нет)
+    int ret_fd;         // Режим --ordered: канал возврата (его stdout), конец чтения
+    uint32_t ret_events; // Подписка канала возврата в epoll
+    struct tp_place place; // Режим --placement: его процессоры и узел NUMA (пустой набор - без размещения)
+    /* Режим --threads */
+    pthread_t thread;        // Поток обработчика
+    int idx;                 // Его номер (с 1) - слот статистики
+    char name[16];           // "childN"
+    struct worker_conf conf; // Параметры worker_run
+    int ret_wr;              // Конец записи канала возврата: поток закрывает его по окончании
+    /* Режим --daemon */
+    int job_sock;            // Сокет заданий обработчика пула
+};
+
+/* Статистика: слот 0 - родитель, слот i - обработчик i (см. stats.h). Слоты в общей памяти;
+   если её нет - в обычной, тогда обработчики-процессы ведут счётчики только у себя */
+static struct stats *st_slots;
+static int st_nslots;
+static int st_memfd = -1;        // -1 - слоты в обычной памяти
+static int st_fd = 2;          // Куда пишутся отчёты
+
+/* dump_stats: общий отчёт (по SIGUSR1 и при выходе) */
+static void dump_stats(void)
+{
+    st_cpu();
+    st_dump(st_fd, st_slots, st_nslots);
+}
+
+/* seal_expired: завершает фреймы, ждущие дольше дедлайна (или все при force).
+   Возвращает время в мс до ближайшего дедлайна или -1, если несобранных фреймов нет. */
+static int seal_expired(struct worker *w, int n, int deadline_ms, int force)
+{
+    uint64_t now = now_ns();
+    int timeout = -1;
+    for (int i = 0; i < n; ++i)
+    {
+        int age_ms = chan_idle_ms(&w[i].ch, now); // Сколько ждёт самая старая запись
+        if (age_ms < 0)
+            continue;
+        if (force || age_ms >= deadline_ms) // Дедлайн истёк - отправляем
+        {
+            chan_seal(&w[i].ch);
+            continue;
+        }
+        int left = deadline_ms - age_ms;
+        if (timeout < 0 || left < timeout)
+            timeout = left;
+    }
+    return timeout;
+}
+
+/* expand_template: подставляет номер обработчика (с 1) вместо "%d" в шаблоне имени файла.
+   Возвращает новую строку (malloc) или NULL, если в шаблоне нет "%d". */
+static char *expand_template(const char *tmpl, int idx)
+{
+    const char *pos = strstr(tmpl, "%d"); // Место подстановки
+    if (!pos)
+        return NULL;
+    char num[16];
+    int nlen = snprintf(num, sizeof(num), "%d", idx);
+    size_t pre = (size_t)(pos - tmpl);
+    size_t post = strlen(pos + 2);
+    char *name = malloc(pre + (size_t)nlen + post + 1);
+    if (!name)
+        return NULL;
+    memcpy(name, tmpl, pre);                        // Часть до "%d"
+    memcpy(name + pre, num, (size_t)nlen);          // Номер
+    memcpy(name + pre + nlen, pos + 2, post + 1);   // Часть после "%d" вместе с '\0'
+    return name;
+}
+
+/* place_workers: режим --placement - размещает родителя по топологии процессоров и выбирает
+   процессоры обработчиков w[0, n) (обработчик занимает их сам при запуске). Без топологии -
+   предупреждение, и процессоры по-прежнему выбирает планировщик. */
+static void place_workers(const struct options *opt, struct worker *w, int n)
+{
+    static struct topology topo;
+    if (opt->placement == TP_NONE)
+        return;
+    struct tp_place self, *plan = calloc((size_t)n, sizeof(*plan));
+    if (!plan || tp_read(&topo) < 0)
+    {
+        eprint(plan ? "CPU topology unavailable, placement disabled\n" : "Out of memory\n");
+        free(plan);
+        return;
+    }
+    tp_plan(&topo, opt->placement, n, &self, plan);
+    for (int i = 0; i < n; ++i)
+        w[i].place = plan[i];
+    free(plan);
+    if (sched_setaffinity(0, sizeof(self.cpus), &self.cpus) < 0)
+    {
+        eprint("sched_setaffinity failed\n");
+        return;
+    }
+    char list[ST_CPUS];
+    tp_format(&self.cpus, list, sizeof(list));
+    st_place(list, self.node);
+}
+
+/* place_ring: кольцо shm, которое читает обработчик w, - на его узел NUMA */
+static void place_ring(struct worker *w)
+{
+    if (w->ch.kind == TRANSPORT_SHM && CPU_COUNT(&w->place.cpus) > 0 && w->place.node >= 0)
+        tp_bind(w->ch.ring.h, w->ch.ring.map_len, w->place.node); // Нет NUMA - неважно, где
+}
+
+/* spawn_worker: создаёт транспорт и дочерний процесс-обработчик с номером idx (с 1).
+   Обработчик получает argv[0] = "childN". Возвращает 0 или -1. */
+static int spawn_worker(struct worker *w, int idx, const struct options *opt)
+{
+    if (chan_create(&w->ch, opt->transport, opt->chunk_size != 0, opt->frame_bytes, opt->frame_records,
+                    opt->queue_limit, opt->pipe_size) < 0)
+    {
+        eprint(opt->transport == TRANSPORT_SHM ? "shm ring failed\n" : "pipe failed\n");
+        return -1;
+    }
+    place_ring(w);
+    if (opt->pipe_size_set && opt->transport == TRANSPORT_PIPE &&
+        fcntl(w->ch.fd, F_GETPIPE_SZ) < opt->pipe_size)
+        eprint("F_SETPIPE_SZ failed, using default pipe size\n");
+    int ret[2] = {-1, -1}; // Режим --ordered: stdout обработчика - канал в родителя
+    if (opt->ordered && pipe2(ret, O_CLOEXEC) < 0)
+    {
+        eprint("pipe failed\n");
+        chan_close(&w->ch);
+        return -1;
+    }
+
+    char name[32];
+    snprintf(name, sizeof(name), "child%d", idx); // Имя обработчика для сообщений
+
+    w->pid = fork(); // fork() создаёт копию процесса
+    if (w->pid < 0)  // Если fork() вернул ошибку
+    {
+        eprint("fork failed\n");
+        chan_close(&w->ch);
+        if (ret[0] >= 0)
+        {
+            close(ret[0]);
+            close(ret[1]);
+        }
+        return -1;
+    }
+
+    if (w->pid == 0) // Код выполняется только в дочернем процессе
+    {
+        const char *spec = chan_child_setup(&w->ch); // Подключаем транспорт
+        if (ret[1] >= 0 && dup2(ret[1], 1) < 0) // stdout - в канал возврата
+        {
+            eprint("dup2 failed\n");
+            _exit(1);
+        }
+        if (!spec && opt->transport == TRANSPORT_PIPE && !opt->chunk_size)
+        {
+            eprint("dup2 failed\n");
+            _exit(1); // _exit() не вызывает обработчики atexit()
+        }
+
+        /* Заменяем текущий процесс на программу-обработчик.
+           -T: как читать вход (фреймы или кольцо); в режиме фрагментов - обычные строки из stdin */
+        char *args[40];
+        char map_spec[64 + PATH_MAX];
+        char stats_spec[32];
+        char place_spec[16 + TP_LIST_MAX];
+        int na = 0;
+        args[na++] = name;
+        if (spec)
+        {
+            args[na++] = "-T";
+            args[na++] = (char *)spec;
+        }
+        if (opt->utf8) // Разворот по символам UTF-8
+            args[na++] = "-u";
+        if (opt->xform) // Цепочка преобразований (см. transform.h)
+        {
+            args[na++] = "-x";
+            args[na++] = (char *)opt->xform;
+        }
+        if (opt->out_kb) // Параметры вывода (см. output.h)
+        {
+            args[na++] = "-B";
+            args[na++] = (char *)opt->out_kb;
+        }
+        if (opt->out_ms)
+        {
+            args[na++] = "-L";
+            args[na++] = (char *)opt->out_ms;
+        }
+        if (opt->tee)
+            args[na++] = "-t";
+        if (opt->io_uring)
+            args[na++] = "-I";
+        char gz_level[16], gz_threads[16];
+        if (opt->gzip_level) // Сжатие файла (см. gzip_writer.h)
+        {
+            snprintf(gz_level, sizeof(gz_level), "%d", opt->gzip_level);
+            snprintf(gz_threads, sizeof(gz_threads), "%d", opt->gzip_threads);
+            args[na++] = "-z";
+            args[na++] = gz_level;
+            args[na++] = "-Z";
+            args[na++] = gz_threads;
+        }
+        char size_hint[32];
+        if (opt->file.size_hint) // Запись файла (см. file_sink.h)
+        {
+            snprintf(size_hint, sizeof(size_hint), "%llu", (unsigned long long)opt->file.size_hint);
+            args[na++] = "-H";
+            args[na++] = size_hint;
+        }
+        if (opt->file.direct)
+            args[na++] = "-O";
+        if (opt->writeback)
+        {
+            args[na++] = "-W";
+            args[na++] = (char *)opt->writeback;
+        }
+        if (opt->sync)
+        {
+            args[na++] = "-Y";
+            args[na++] = (char *)opt->sync;
+        }
+        if (opt->spill) // Сборка длинных строк (см. spill.h)
+        {
+            args[na++] = "-G";
+            args[na++] = (char *)opt->spill;
+        }
+        char rev_threads[16]; // Помощники разворота длинных строк (см. rev_pool.h)
+        snprintf(rev_threads, sizeof(rev_threads), "%d", opt->rev_threads);
+        args[na++] = "-R";
+        args[na++] = rev_threads;
+        char cache_mb[16]; // Кэш результатов (см. line_cache.h)
+        if (opt->cache_mb > 0)
+        {
+            snprintf(cache_mb, sizeof(cache_mb), "%d", opt->cache_mb);
+            args[na++] = "-K";
+            args[na++] = cache_mb;
+        }
+        if (CPU_COUNT(&w->place.cpus) > 0) // Процессоры обработчика (см. topology.h)
+        {
+            int pl = snprintf(place_spec, sizeof(place_spec), "%d:", w->place.node);
+            tp_format(&w->place.cpus, place_spec + pl, sizeof(place_spec) - (size_t)pl);
+            args[na++] = "-A";
+            args[na++] = place_spec;
+        }
+        if (opt->input) // Строки - описатели во входном файле; выходной файл отображается
+        {
+            snprintf(map_spec, sizeof(map_spec), "%llu:%s", (unsigned long long)w->out_size, opt->input);
+            args[na++] = "-M";
+            args[na++] = map_spec;
+        }
+        if (st_memfd >= 0 && fcntl(st_memfd, F_SETFD, 0) == 0) // Слот статистики - общая память переживает exec
+        {
+            snprintf(stats_spec, sizeof(stats_spec), "%d:%d", st_memfd, idx);
+            args[na++] = "-S";
+            args[na++] = stats_spec;
+        }
+        args[na++] = "--";
+        args[na++] = w->filename;
+        args[na] = NULL;
+        execv("./worker", args);
+        /* Если execv() вернул управление, значит произошла ошибка */
+        eprint("execv worker failed\n");
+        _exit(1); // Завершаем дочерний процесс
+    }
+
+    chan_parent_setup(&w->ch); // Закрываем сторону обработчика
+    w->ret_fd = ret[0];
+    char entry[ST_NAME];
+    if (w->ch.kind == TRANSPORT_PIPE) // Кольцо пишется без системных вызовов
+    {
+        snprintf(entry, sizeof(entry), "child%d.pipe", idx);
+        st_watch(w->ch.fd, ST_WR, entry);
+    }
+    if (w->ret_fd >= 0)
+    {
+        snprintf(entry, sizeof(entry), "child%d.ret", idx);
+        st_watch(w->ret_fd, ST_RD, entry);
+    }
+    if (ret[1] >= 0)
+        close(ret[1]); // Пишет в него только обработчик: его завершение даст EOF
+    return 0;
+}
+
+/* thread_main: обработчик-поток (режим --threads) - тот же worker_run, что и у процесса */
+static void *thread_main(void *arg)
+{
+    struct worker *w = arg;
+    st_init(w->name, &st_slots[w->idx]);
+    if (CPU_COUNT(&w->place.cpus) > 0) // Поток создан уже на своих процессорах
+    {
+        char list[ST_CPUS];
+        tp_format(&w->place.cpus, list, sizeof(list));
+        st_place(list, w->place.node);
+    }
+    worker_run(&w->conf);
+    if (w->ret_wr >= 0)
+        close(w->ret_wr); // Вывод закончен - EOF в канале возврата, как при выходе процесса
+    return NULL;
+}
+
+/* spawn_thread: режим --threads - кольцо SPSC в памяти процесса и поток-обработчик с номером idx.
+   Файл и stdout те же, что у процесса-обработчика; в режиме --ordered stdout потока - канал
+   возврата. Возвращает 0 или -1. */
+static int spawn_thread(struct worker *w, int idx, const struct options *opt)
+{
+    if (chan_create(&w->ch, TRANSPORT_SHM, 0, opt->frame_bytes, opt->frame_records, opt->queue_limit, 0) < 0)
+    {
+        eprint("shm ring failed\n");
+        return -1;
+    }
+    place_ring(w);
+    const char *spec = chan_thread_setup(&w->ch);
+    int ret[2] = {-1, -1};
+    if (!spec || (opt->ordered && pipe2(ret, O_CLOEXEC) < 0))
+    {
+        eprint("pipe failed\n");
+        chan_close(&w->ch);
+        return -1;
+    }
+    w->idx = idx;
+    snprintf(w->name, sizeof(w->name), "child%d", idx);
+    w->ret_fd = ret[0];
+    w->ret_wr = ret[1];
+    w->conf = (struct worker_conf){
+        .name = w->name,
+        .spec = spec,
+        .out_file = w->filename,
+        .out_fd = ret[1] >= 0 ? ret[1] : 1,
+        .utf8 = opt->utf8,
+        .xform = opt->xform,
+        .out_bytes = opt->out_kb ? (size_t)strtoul(opt->out_kb, NULL, 10) * 1024 : 0,
+        .out_deadline_ms = opt->out_ms ? atoi(opt->out_ms) : -1,
+        .tee = opt->tee,
+        .io_uring = opt->io_uring,
+        .map_path = opt->input,
+        .map_size = w->out_size,
+        .gzip_level = opt->gzip_level,
+        .gzip_threads = opt->gzip_threads,
+        .file = opt->file,
+        .spill_limit = opt->spill ? (size_t)strtoull(opt->spill, NULL, 10) * 1024 * 1024 : 0,
+        .rev_threads = opt->rev_threads,
+        .cache_bytes = (size_t)opt->cache_mb << 20,
+    };
+    /* SIGUSR1 обрабатывает основной поток: поток наследует маску, в которой он заблокирован */
+    pthread_attr_t attr;
+    pthread_attr_init(&attr);
+    if (CPU_COUNT(&w->place.cpus) > 0)
+        pthread_attr_setaffinity_np(&attr, sizeof(w->place.cpus), &w->place.cpus);
+    st_block(1);
+    int err = pthread_create(&w->thread, &attr, thread_main, w);
+    st_block(0);
+    pthread_attr_destroy(&attr);
+    if (err)
+    {
+        eprint("pthread_create failed\n");
+        chan_close(&w->ch);
+        return -1;
+    }
+    if (w->ret_fd >= 0)
+    {
+        char entry[ST_NAME];
+        snprintf(entry, sizeof(entry), "child%d.ret", idx);
+        st_watch(w->ret_fd, ST_RD, entry);
+    }
+    return 0;
+}
+
+/* hash_target: обработчик режима hash для строки s[0, n). Длинная строка приходит кусками, и
+   длина первого куска зависит от того, сколько успел прочитать читатель (но не меньше
+   LR_PIECE), - поэтому хешируется только начало строки длиной LR_PIECE: одинаковые строки
+   попадают к одному обработчику при любой нарезке. */
+static int hash_target(const char *s, size_t n, int nworkers)
+{
+    return lc_shard(lc_hash(s, n < LR_PIECE ? n : LR_PIECE), nworkers);
+}
+
+/* pick_least_loaded: выбирает обработчика с наименьшей нагрузкой - данными, которые он ещё
+   не прочитал (для канала - FIONREAD плюс очередь в родителе, для кольца - его заполненность).
+   Обработчики с заполненной очередью пропускаются. Возвращает -1, если заполнены все. */
+static int pick_least_loaded(const struct worker *w, int n)
+{
+    int best = -1;
+    size_t best_load = 0;
+    for (int i = 0; i < n; ++i)
+    {
+        if (chan_full(&w[i].ch)) // Очередь заполнена - не кандидат
+            continue;
+        size_t load = chan_load(&w[i].ch);
+        if (best < 0 || load < best_load)
+        {
+            best = i;
+            best_load = load;
+        }
+    }
+    return best;
+}
+
+/* route_log: журнал распределения строк - по нему можно восстановить, в какой файл попала строка.
+   Формат: по строке на серию подряд идущих строк ввода одному обработчику
+   "<номер первой строки> <число строк> <номер обработчика>\n" (нумерация с 1). */
+struct route_log
+{
+    FILE *f;             // Файл журнала (NULL - журнал выключен)
+    unsigned long first; // Первая строка текущей серии
+    unsigned long count; // Длина текущей серии
+    int worker;          // Обработчик текущей серии
+};
+
+/* route_flush: записывает накопленную серию в журнал */
+static void route_flush(struct route_log *rl)
+{
+    if (rl->f && rl->count > 0)
+        fprintf(rl->f, "%lu %lu %d\n", rl->first, rl->count, rl->worker + 1);
+    rl->count = 0;
+}
+
+/* route_note: отмечает, что строка line_no (с 1) отправлена обработчику worker */
+static void route_note(struct route_log *rl, unsigned long line_no, int worker)
+{
+    if (!rl->f)
+        return;
+    if (rl->count > 0 && rl->worker == worker && rl->first + rl->count == line_no) // Продолжение серии
+    {
+        rl->count++;
+        return;
+    }
+    route_flush(rl); // Новая серия
+    rl->first = line_no;
+    rl->count = 1;
+    rl->worker = worker;
+}
+
+/* set_events: меняет подписку fd в epoll, только если набор событий изменился */
+static void set_events(int ep, int fd, uint32_t *cur, uint32_t want, uint64_t tag)
+{
+    if (*cur == want)
+        return;
+    struct epoll_event ev = {.events = want, .data.u64 = tag};
+    epoll_ctl(ep, EPOLL_CTL_MOD, fd, &ev);
+    *cur = want;
+}
+
+/* run_loop: событийный цикл родителя. Читает stdin, пока у обработчика, которому достаётся
+   следующая строка, есть место в очереди; пишет в каналы, когда они готовы принять данные.
+   Медленный обработчик задерживает ввод, только когда его очередь заполнена.
+   idx - режим --input: вместо строк stdin раздаются описатели строк из индекса.
+   mg - режим --ordered: вывод обработчиков читается из каналов возврата и выводится по порядку;
+   раздача ждёт, пока в пути больше окна.
+   Строка длиннее LR_PIECE раздаётся кусками по мере чтения - целиком она не хранится нигде;
+   все куски идут тому же обработчику, окно --ordered начало строки не задерживает её продолжение.
+   Возвращает 0 или -1 при ошибке. */
+static int run_loop(const struct options *opt, struct worker *w, struct line_reader *in,
+                    const struct line_index *idx, struct merge *mg, struct route_log *route)
+{
+    int n = opt->nworkers;
+    int ep = epoll_create1(EPOLL_CLOEXEC);
+    if (ep < 0)
+    {
+        eprint("epoll_create1 failed\n");
+        return -1;
+    }
+
+    /* Метка 0 - stdin (в режиме демона - stdin клиента), метка i+1 - канал обработчика i, метка n+i+1 - его канал возврата.
+       Подписки заводятся пустыми, нужные события включаются по состоянию на каждой итерации */
+    struct epoll_event ev = {.events = EPOLLIN, .data.u64 = 0};
+    /* Обычный файл epoll не поддерживает (EPERM): он всегда готов к чтению */
+    int in_pollable = epoll_ctl(ep, EPOLL_CTL_ADD, in->fd, &ev) == 0;
+    int in_watched = in_pollable; // stdin сейчас в epoll
+    ev.events = 0;
+    for (int i = 0; i < n; ++i)
+    {
+        ev.data.u64 = (uint64_t)i + 1;
+        epoll_ctl(ep, EPOLL_CTL_ADD, chan_wait_fd(&w[i].ch), &ev);
+        w[i].events = 0;
+        if (mg)
+        {
+            ev.data.u64 = (uint64_t)(n + i) + 1;
+            epoll_ctl(ep, EPOLL_CTL_ADD, mg_fd(mg, i), &ev);
+            w[i].ret_events = 0;
+        }
+    }
+
+    /* Ожидания в epoll по причине: ввод, заполненная очередь обработчика, окно --ordered,
+       досылка очередей после конца ввода */
+    int wait_input = st_entry("wait.input");
+    int wait_queue = st_entry("wait.queue");
+    int wait_window = st_entry("wait.window");
+    int wait_drain = st_entry("wait.drain");
+
+    in->max_line = LR_PIECE; // Длинная строка - кусками, буфер читателя не растёт до её размера
+
+    int rc = 0;
+    unsigned long line_no = 0; // Счётчик строк (для распределения между процессами)
+    int cur = 0;               // Обработчик, которому собирается текущий фрейм (режим least)
+    int in_line = 0;           // Отдан кусок строки - продолжение идёт тому же обработчику
+    int line_to = 0;           // Кому
+    size_t line_len = 0;       // Длина строки в уже отданных кусках
+    char *carry = NULL;        // Неотправленный остаток строки (транспорт принял её не целиком)
+    size_t carry_len = 0;
+    int carry_to = 0; // Обработчик, которому принадлежит остаток
+    int carry_more = 0; // Остаток - кусок строки
+    struct line_desc desc; // Режим --input: описатель текущей строки (остаток может ссылаться на него)
+    while (1)
+    {
+        int in_eof = idx ? 1 : in->eof; // Индекс готов целиком - читать больше нечего
+
+        /* 0. Выводим по порядку то, что уже вернули обработчики */
+        if (mg && mg_pump(mg) < 0)
+            eprint("Error writing to stdout\n");
+        /* 1. Раздаём строки, уже лежащие в буфере читателя */
+        int blocked = 0;     // Очередь обработчика следующей строки заполнена
+        int blocked_on = -1; // Чья именно (для остатка строки - -1: ждём его транспорт)
+        int window_full = 0; // Режим --ordered: ждём вывода, новых строк пока не будет
+        if (carry_len > 0) // Сначала - остаток длинной строки (буфер читателя не обновлялся)
+        {
+            ssize_t sent = chan_send(&w[carry_to].ch, carry, carry_len, carry_more);
+            if (sent < 0)
+            {
+                eprint("Out of memory\n");
+                rc = -1;
+                goto out;
+            }
+            carry += sent;
+            carry_len -= (size_t)sent;
+            blocked = carry_len > 0;
+        }
+        while (!blocked)
+        {
+            /* Режим rr: строки раздаются по кругу: 1-я - child1, 2-я - child2, ..., (N+1)-я - снова child1.
+               При N=2 это прежнее правило: нечётные в child1, чётные в child2 */
+            int target;
+            if (in_line)
+                target = line_to;
+            else if (opt->mode == DISPATCH_RR)
+                target = (int)(line_no % (unsigned long)n);
+            else if (opt->mode == DISPATCH_HASH)
+            {
+                /* Режим hash: по содержимому строки. Строка индекса известна заранее, а строку
+                   stdin сначала нужно взять из буфера читателя (ниже) */
+                target = -1;
+                if (idx && line_no < idx->count)
+                    target = hash_target(idx->data + li_start(idx, line_no), li_len(idx, line_no), n);
+            }
+            else
+            {
+                /* Фрейм собирается для одного обработчика; как только он ушёл в очередь (заполнился
+                   или истёк дедлайн), следующий фрейм достаётся наименее загруженному */
+                if (!chan_building(&w[cur].ch))
+                {
+                    int best = pick_least_loaded(w, n);
+                    if (best >= 0)
+                        cur = best;
+                }
+                target = cur;
+            }
+            if (target >= 0 && chan_full(&w[target].ch)) // Обратное давление
+            {
+                blocked = 1;
+                blocked_on = target;
+                break;
+            }
+            if (mg && mg_full(mg) && !in_line) // Окно заполнено: ждём вывода отстающего обработчика
+            {
+                blocked = window_full = 1;
+                break;
+            }
+
+            char *line = NULL; // Указатель на очередную строку (внутри буфера читателя)
+            ssize_t rl;
+            if (idx) // Описатель строки вместо неё самой
+            {
+                if (line_no == idx->count)
+                    break;
+                desc = (struct line_desc){li_start(idx, line_no), w[target].out_off,
+                                          (uint32_t)li_len(idx, line_no), 0};
+                w[target].out_off += desc.len;
+                line = (char *)&desc;
+                rl = sizeof(desc);
+            }
+            else
+                rl = lr_take(in, &line); // Берём строку из уже прочитанных данных
+            if (rl == 0)                 // Полной строки в буфере нет
+                break;
+            if (target < 0) // Режим hash: обработчик - по содержимому взятой строки
+            {
+                target = hash_target(line, (size_t)rl, n);
+                if (chan_full(&w[target].ch)) // Его очередь заполнена - строка остаётся в буфере
+                {
+                    lr_untake(in, (size_t)rl);
+                    blocked = 1;
+                    blocked_on = target;
+                    break;
+                }
+            }
+            int more = !idx && in->more; // Кусок: строка продолжается
+            if (!in_line)
+            {
+                line_no++;                                   // Увеличиваем номер строки
+                route_note(route, line_no, target);          // Запоминаем, куда ушла строка
+            }
+            line_len += idx ? desc.len : (size_t)rl;
+            if (!more)
+            {
+                st_line(line_len);
+                line_len = 0;
+            }
+            in_line = more;
+            line_to = target;
+            if (mg && mg_note(mg, target, idx ? desc.len : (size_t)rl) < 0) // Порядок вывода
+            {
+                eprint("Out of memory\n");
+                rc = -1;
+                goto out;
+            }
+            ssize_t sent = chan_send(&w[target].ch, line, (size_t)rl, more); // Отдаём строку транспорту
+            if (sent < 0)
+            {
+                eprint("Out of memory\n");
+                rc = -1;
+                goto out;
+            }
+            if (sent < rl) // Места не хватило - остаток уйдёт, когда обработчик его освободит
+            {
+                carry = line + sent;
+                carry_len = (size_t)(rl - sent);
+                carry_to = target;
+                carry_more = more;
+                blocked = 1;
+            }
+        }
+
+        /* 2. Неполные фреймы уходят в очередь по дедлайну, а после EOF или при заполненном
+           окне - все сразу (иначе вывод, которого ждёт окно, застрял бы в них до дедлайна) */
+        int timeout = seal_expired(w, n, opt->deadline_ms,
+                                   (idx ? line_no == idx->count : in_eof) || window_full);
+
+        /* 3. Пишем очереди во все каналы, сколько они примут */
+        int pending = 0; // Остались неотправленные данные
+        for (int i = 0; i < n; ++i)
+        {
+            if (chan_write(&w[i].ch) < 0)
+            {
+                eprint("Error writing to pipe\n");
+                rc = -1;
+                goto out;
+            }
+            if (chan_pending(&w[i].ch))
+                pending = 1;
+            set_events(ep, chan_wait_fd(&w[i].ch), &w[i].events, chan_wait_events(&w[i].ch),
+                       (uint64_t)i + 1);
+            if (mg)
+                set_events(ep, mg_fd(mg, i), &w[i].ret_events, mg_want(mg, i) ? EPOLLIN : 0,
+                           (uint64_t)(n + i) + 1);
+        }
+
+        /* Обработчик успел прочитать всё, пока мы писали: очередь уже не заполнена, и ждать
+           готовности канала бессмысленно (подписки на запись больше нет) - раздаём дальше */
+        if (blocked_on >= 0 && !chan_full(&w[blocked_on].ch))
+            continue;
+
+        /* 4. Ввод исчерпан и всё отправлено - выходим */
+        int in_left = idx ? line_no < idx->count : lr_buffered(in) > 0; // Ещё не розданный ввод
+        if (in_eof && !pending && !in_left && carry_len == 0)
+        {
+            if (in_line) // Последний кусок оказался концом ввода
+                st_line(line_len);
+            break;
+        }
+
+        /* 5. Читаем stdin, если он не исчерпан и есть куда класть строки */
+        int want_input = !in_eof && !blocked;
+        if (want_input && !in_pollable) // Обычный файл: чтение не заблокирует надолго
+        {
+            if (lr_fill(in) < 0)
+            {
+                eprint("Error reading line\n");
+                rc = -1;
+                goto out;
+            }
+            continue;
+        }
+        /* stdin снимается с epoll целиком, а не маскируется: EPOLLHUP приходит и при пустой маске */
+        if (in_pollable && in_watched != want_input)
+        {
+            ev.events = EPOLLIN;
+            ev.data.u64 = 0;
+            epoll_ctl(ep, want_input ? EPOLL_CTL_ADD : EPOLL_CTL_DEL, in->fd, &ev);
+            in_watched = want_input;
+        }
+
+        /* 6. Ждём готовности stdin, каналов или ближайшего дедлайна */
+        struct epoll_event evs[2 * MAX_WORKERS + 1];
+        uint64_t t0 = st_now();
+        int ne = epoll_wait(ep, evs, 2 * n + 1, timeout);
+        st_account(window_full ? wait_window : blocked ? wait_queue : want_input ? wait_input : wait_drain, t0, 0);
+        if (ne < 0 && errno != EINTR)
+        {
+            eprint("epoll_wait failed\n");
+            rc = -1;
+            goto out;
+        }
+        for (int k = 0; k < ne; ++k)
+        {
+            if (evs[k].data.u64 > (uint64_t)n) // Канал возврата: вывод выйдет на шаге 0
+            {
+                int i = (int)(evs[k].data.u64 - (uint64_t)n - 1);
+                if (mg_read(mg, i) < 0)
+                {
+                    eprint("Error reading worker output\n");
+                    rc = -1;
+                    goto out;
+                }
+                if (mg->ret[i].eof) // Обработчик закрыл канал: EPOLLHUP приходит и при пустой маске
+                {
+                    epoll_ctl(ep, EPOLL_CTL_DEL, mg_fd(mg, i), NULL);
+                    w[i].ret_events = 0;
+                }
+                continue;
+            }
+            if (evs[k].data.u64 != 0) // Каналы дописываются на шаге 3 следующей итерации
+            {
+                if (evs[k].events & EPOLLERR) // Обработчик закрыл свой конец канала
+                {
+                    eprint("Worker closed its pipe\n");
+                    rc = -1;
+                    goto out;
+                }
+                chan_ack(&w[evs[k].data.u64 - 1].ch);
+                continue;
+            }
+            if (lr_fill(in) < 0) // stdin готов: один read() не заблокирует
+            {
+                eprint("Error reading line\n");
+                rc = -1;
+                goto out;
+            }
+        }
+    }
+out:
+    close(ep);
+    return rc;
+}
+
+/* chunk_len: длина фрагмента в начале data[0, len), оканчивающегося на '\n', ближайший к target.
+   Возвращает 0, если в data нет ни одного '\n'. */
+static size_t chunk_len(const char *data, size_t len, size_t target)
+{
+    size_t back_len = target < len ? target : len;
+    const char *back = memrchr(data, '\n', back_len);                        // Последний '\n' до target
+    const char *fwd = len > target ? memchr(data + target, '\n', len - target) // Первый '\n' после
+                                   : NULL;
+    size_t b = back ? (size_t)(back - data) + 1 : 0;
+    size_t f = fwd ? (size_t)(fwd - data) + 1 : 0;
+    if (!b)
+        return f;
+    if (!f)
+        return b;
+    return (target - b <= f - target) ? b : f; // Ближайшая к target граница
+}
+
+/* wait_writable: ждёт, пока неблокирующий канал сможет принять данные */
+static int wait_writable(int fd)
+{
+    struct pollfd pfd = {fd, POLLOUT, 0};
+    uint64_t t0 = st_now();
+    while (poll(&pfd, 1, -1) < 0)
+    {
+        if (errno != EINTR)
+            return -1;
+    }
+    st_account(st_entry("wait.queue"), t0, 0); // Канал обработчика заполнен
+    if (pfd.revents & POLLERR) // Обработчик закрыл свой конец канала
+    {
+        errno = EPIPE;
+        return -1;
+    }
+    return 0;
+}
+
+/* send_all: пишет все байты в неблокирующий канал, дожидаясь места в нём */
+static int send_all(int fd, const char *buf, size_t len)
+{
+    while (len > 0)
+    {
+        ssize_t wr = st_write(fd, buf, len);
+        if (wr < 0)
+        {
+            if (errno == EINTR)
+                continue;
+            if ((errno != EAGAIN && errno != EWOULDBLOCK) || wait_writable(fd) < 0)
+                return -1;
+            continue;
+        }
+        buf += wr;
+        len -= (size_t)wr;
+    }
+    return 0;
+}
+
+/* splice_all: переносит len байт файла stdin со смещения *off в канал без копирования
+   через пространство пользователя. Если splice не поддерживается, пишет из отображения map. */
+static int splice_all(int fd, off_t *off, size_t len, const char *map)
+{
+    while (len > 0)
+    {
+        ssize_t r = splice(0, off, fd, NULL, len, SPLICE_F_MOVE | SPLICE_F_NONBLOCK);
+        if (r < 0)
+        {
+            if (errno == EINTR)
+                continue;
+            if (errno == EAGAIN) // Канал заполнен
+            {
+                if (wait_writable(fd) < 0)
+                    return -1;
+                continue;
+            }
+            if (errno == EINVAL) // Файловая система не поддерживает splice
+            {
+                if (send_all(fd, map + *off, len) < 0)
+                    return -1;
+                *off += (off_t)len;
+                return 0;
+            }
+            return -1;
+        }
+        len -= (size_t)r; // splice сам сдвигает *off
+    }
+    return 0;
+}
+
+/* chunk_target: обработчик для фрагмента k */
+static int chunk_target(const struct options *opt, const struct worker *w, unsigned long k)
+{
+    if (opt->mode == DISPATCH_LEAST)
+    {
+        int best = pick_least_loaded(w, opt->nworkers);
+        if (best >= 0)
+            return best;
+    }
+    return (int)(k % (unsigned long)opt->nworkers);
+}
+
+/* run_chunks: режим фрагментов. Строки не разбираются по одной: родитель лишь ищет границу строки
+   рядом с целевым размером и отправляет обработчику целый многострочный фрагмент.
+   Фрагменты раздаются по кругу (или наименее загруженному), порядок внутри обработчика сохраняется.
+   Если stdin - обычный файл, фрагменты переносятся в каналы через splice без копирования,
+   а граница ищется в отображении файла (mmap). Иначе данные читаются в буфер и пишутся фрагментами. */
+static int run_chunks(const struct options *opt, struct worker *w, struct line_reader *in)
+{
+    unsigned long k = 0; // Номер фрагмента
+    struct stat st;
+    off_t pos = lseek(0, 0, SEEK_CUR); // Позиция stdin (для обычного файла)
+    if (fstat(0, &st) == 0 && S_ISREG(st.st_mode) && pos >= 0 && st.st_size > 0)
+    {
+        size_t size = (size_t)st.st_size;
+        char *map = mmap(NULL, size, PROT_READ, MAP_SHARED, 0, 0);
+        if (map != MAP_FAILED)
+        {
+            madvise(map, size, MADV_SEQUENTIAL); // Просматриваем файл один раз подряд
+            /* Часть файла уже прочитана вместе с именами файлов, но не выдана - начинаем с неё */
+            pos -= (off_t)lr_buffered(in);
+            lr_consume(in, lr_buffered(in));
+            int rc = 0;
+            while ((size_t)pos < size)
+            {
+                size_t left = size - (size_t)pos;
+                size_t len = chunk_len(map + pos, left, opt->chunk_size);
+                if (len == 0) // Хвост без '\n' - последний фрагмент
+                    len = left;
+                st_self->bytes += len; // Строки во фрагменте не считаются
+                if (splice_all(w[chunk_target(opt, w, k)].ch.fd, &pos, len, map) < 0)
+                {
+                    eprint("Error writing to pipe\n");
+                    rc = -1;
+                    break;
+                }
+                k++;
+            }
+            munmap(map, size);
+            return rc;
+        }
+    }
+
+    /* Канал или терминал: накапливаем в буфере читателя не меньше целевого размера.
+       Строка длиннее фрагмента не копится целиком: она уходит кусками тому же обработчику */
+    int piece_to = -1; // Обработчик, которому ушёл кусок незаконченной строки
+    while (1)
+    {
+        size_t avail = lr_buffered(in);
+        size_t len = 0;
+        if (avail >= opt->chunk_size || in->eof)
+            len = chunk_len(lr_data(in), avail, opt->chunk_size);
+        int piece = len == 0 && !in->eof && avail >= opt->chunk_size; // В буфере ни одного '\n'
+        if (len == 0 && (in->eof || piece)) // Остаток ввода (возможно, без '\n') или кусок строки
+            len = avail;
+        if (len > 0)
+        {
+            int target = piece_to >= 0 ? piece_to : chunk_target(opt, w, k);
+            st_self->bytes += len;
+            if (send_all(w[target].ch.fd, lr_data(in), len) < 0)
+            {
+                eprint("Error writing to pipe\n");
+                return -1;
+            }
+            lr_consume(in, len);
+            piece_to = piece ? target : -1;
+            if (!piece)
+                k++;
+            continue;
+        }
+        if (in->eof)
+            return 0;
+        if (lr_fill(in) < 0)
+        {
+            eprint("Error reading line\n");
+            return -1;
+        }
+    }
+}
+
+/* map_input: режим --input - отображает входной файл и строит индекс его строк.
+   Для режима rr заранее известно, какие строки достанутся обработчику, - считаем размеры
+   выходных файлов, чтобы обработчики выделили их сразу. Возвращает 0 или -1. */
+static int map_input(const struct options *opt, struct worker *w, struct line_index *idx)
+{
+    int fd = open(opt->input, O_RDONLY | O_CLOEXEC);
+    struct stat st;
+    if (fd < 0 || fstat(fd, &st) < 0 || !S_ISREG(st.st_mode))
+    {
+        eprint("Failed to open input file\n");
+        if (fd >= 0)
+            close(fd);
+        return -1;
+    }
+    size_t size = (size_t)st.st_size;
+    const char *map = NULL;
+    if (size > 0)
+    {
+        map = mmap(NULL, size, PROT_READ, MAP_SHARED, fd, 0);
+        if (map == MAP_FAILED)
+        {
+            eprint("mmap input failed\n");
+            close(fd);
+            return -1;
+        }
+        madvise((void *)map, size, MADV_SEQUENTIAL); // Индекс строится одним проходом
+    }
+    close(fd); // Отображению дескриптор не нужен
+    if (li_build(idx, map, size) < 0)
+    {
+        eprint("Out of memory\n");
+        return -1;
+    }
+    int n = opt->nworkers;
+    for (size_t k = 0; k < idx->count; ++k)
+    {
+        size_t len = li_len(idx, k);
+        if (len > UINT32_MAX) // Длина в описателе - 32 бита
+        {
+            eprint("Input line too long for --input\n");
+            return -1;
+        }
+        if (opt->mode == DISPATCH_RR)
+            w[k % (size_t)n].out_size += len;
+        else if (opt->mode == DISPATCH_HASH) // Хеш строки тоже известен заранее
+            w[hash_target(map + li_start(idx, k), len, n)].out_size += len;
+    }
+    return 0;
+}
+
+/* Режим --daemon: пул обработчиков запускается один раз и выполняет задание за заданием.
+   Задание - stdin, stdout и открытые выходные файлы клиента (parent --connect), переданные
+   через SCM_RIGHTS (jobs.h); строки раздаются тем же run_loop, что и без демона. */
+
+#define POOL_JOB_FD 3   // Сокет заданий у обработчика пула
+#define POOL_STATS_FD 4 // Общая память статистики у обработчика пула
+
+static volatile sig_atomic_t daemon_stop; // SIGTERM/SIGINT: завершить после текущего задания
+
+static void on_stop(int sig)
+{
+    (void)sig;
+    daemon_stop = 1;
+}
+
+/* spawn_pool_worker: обработчик пула с номером idx (с 1). posix_spawn не копирует таблицы
+   страниц родителя (в отличие от fork) - запуск не дорожает с его размером. mask - маска
+   сигналов обработчика (у демона SIGTERM/SIGINT заблокированы вне ожидания задания).
+   Возвращает 0 или -1. */
+static int spawn_pool_worker(struct worker *w, int idx, const struct options *opt, const sigset_t *mask)
+{
+    int sv[2];
+    if (socketpair(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0, sv) < 0)
+    {
+        eprint("socketpair failed\n");
+        return -1;
+    }
+    /* Источники dup2 - выше POOL_STATS_FD: иначе первое действие затрёт второй источник,
+       а dup2 на тот же номер не снимает O_CLOEXEC */
+    int job_fd = fcntl(sv[1], F_DUPFD_CLOEXEC, 10);
+    close(sv[1]);
+    int st_src = st_memfd >= 0 ? fcntl(st_memfd, F_DUPFD_CLOEXEC, 10) : -1;
+
+    char name[16], job_spec[16], stats_spec[32];
+    snprintf(name, sizeof(name), "child%d", idx);
+    snprintf(job_spec, sizeof(job_spec), "%d", POOL_JOB_FD);
+    snprintf(stats_spec, sizeof(stats_spec), "%d:%d", POOL_STATS_FD, idx);
+    char *args[32];
+    int na = 0;
+    args[na++] = name;
+    args[na++] = "-J";
+    args[na++] = job_spec;
+    if (opt->out_kb) // Параметры вывода (см. output.h); -u приходит с каждым заданием
+    {
+        args[na++] = "-B";
+        args[na++] = (char *)opt->out_kb;
+    }
+    if (opt->out_ms)
+    {
+        args[na++] = "-L";
+        args[na++] = (char *)opt->out_ms;
+    }
+    if (opt->io_uring)
+        args[na++] = "-I";
+    char gz_level[16], gz_threads[16];
+    if (opt->gzip_level)
+    {
+        snprintf(gz_level, sizeof(gz_level), "%d", opt->gzip_level);
+        snprintf(gz_threads, sizeof(gz_threads), "%d", opt->gzip_threads);
+        args[na++] = "-z";
+        args[na++] = gz_level;
+        args[na++] = "-Z";
+        args[na++] = gz_threads;
+    }
+    if (opt->file.direct) // Размер файлов заданий не известен заранее - место выделяется шагами
+        args[na++] = "-O";
+    if (opt->writeback)
+    {
+        args[na++] = "-W";
+        args[na++] = (char *)opt->writeback;
+    }
+    if (opt->sync)
+    {
+        args[na++] = "-Y";
+        args[na++] = (char *)opt->sync;
+    }
+    if (opt->spill)
+    {
+        args[na++] = "-G";
+        args[na++] = (char *)opt->spill;
+    }
+    char rev_threads[16];
+    snprintf(rev_threads, sizeof(rev_threads), "%d", opt->rev_threads);
+    args[na++] = "-R";
+    args[na++] = rev_threads;
+    char cache_mb[16];
+    if (opt->cache_mb > 0)
+    {
+        snprintf(cache_mb, sizeof(cache_mb), "%d", opt->cache_mb);
+        args[na++] = "-K";
+        args[na++] = cache_mb;
+    }
+    char place_spec[16 + TP_LIST_MAX];
+    if (CPU_COUNT(&w->place.cpus) > 0)
+    {
+        int pl = snprintf(place_spec, sizeof(place_spec), "%d:", w->place.node);
+        tp_format(&w->place.cpus, place_spec + pl, sizeof(place_spec) - (size_t)pl);
+        args[na++] = "-A";
+        args[na++] = place_spec;
+    }
+    if (opt->xform)
+    {
+        args[na++] = "-x";
+        args[na++] = (char *)opt->xform;
+    }
+    if (st_src >= 0)
+    {
+        args[na++] = "-S";
+        args[na++] = stats_spec;
+    }
+    args[na] = NULL;
+
+    int err = job_fd < 0;
+    if (!err)
+    {
+        posix_spawn_file_actions_t fa;
+        posix_spawnattr_t attr;
+        posix_spawn_file_actions_init(&fa);
+        posix_spawnattr_init(&attr);
+        posix_spawn_file_actions_adddup2(&fa, job_fd, POOL_JOB_FD);
+        if (st_src >= 0)
+            posix_spawn_file_actions_adddup2(&fa, st_src, POOL_STATS_FD);
+        posix_spawnattr_setsigmask(&attr, mask);
+        posix_spawnattr_setflags(&attr, POSIX_SPAWN_SETSIGMASK);
+        err = posix_spawn(&w->pid, "./worker", &fa, &attr, args, environ);
+        posix_spawnattr_destroy(&attr);
+        posix_spawn_file_actions_destroy(&fa);
+    }
+    if (job_fd >= 0)
+        close(job_fd);
+    if (st_src >= 0)
+        close(st_src);
+    if (err)
+    {
+        eprint("posix_spawn worker failed\n");
+        close(sv[0]);
+        return -1;
+    }
+    w->job_sock = sv[0];
+    return 0;
+}
+
+/* restart_pool_worker: обработчик не ответил на задание - заменяем его новым */
+static void restart_pool_worker(struct worker *w, int idx, const struct options *opt, const sigset_t *mask)
 {
-    size_t cap = BUF_CHUNK;  // Начальная ёмкость буфера
-    size_t len = 0;          // Текущая длина прочитанных данных
-    char *buf = malloc(cap); // Выделяем память для буфера
-    if (!buf)                // Если не удалось выделить память
-        return -1;           // Возвращаем ошибку
-    char tmp[BUF_CHUNK];     // Временный буфер для чтения
+    eprint("Worker lost, restarting\n");
+    close(w->job_sock);
+    w->job_sock = -1;
+    kill(w->pid, SIGKILL); // Мог и не завершиться, а лишь нарушить протокол
+    waitpid(w->pid, NULL, 0);
+    spawn_pool_worker(w, idx, opt, mask); // Не вышло - задания будут отклоняться (job_sock < 0)
+}
 
-    while (1) // Бесконечный цикл чтения
+/* pool_send: создаёт транспорт задания и отдаёт обработчику пула JOB_WORK: его конец транспорта,
+   stdout задания (канал возврата в режиме --ordered) и выходной файл (file_fd < 0 - нет).
+   Обработчик, не принявший задание, заменяется новым. Возвращает 0 или -1. */
+static int pool_send(const struct options *opt, struct worker *w, int idx, int out_fd, int file_fd,
+                     const sigset_t *mask)
+{
+    if (w->job_sock < 0)
+        return -1;
+    if (chan_create(&w->ch, opt->transport, 0, opt->frame_bytes, opt->frame_records, opt->queue_limit,
+                    opt->pipe_size) < 0)
+    {
+        eprint(opt->transport == TRANSPORT_SHM ? "shm ring failed\n" : "pipe failed\n");
+        return -1;
+    }
+    place_ring(w);
+    int ret[2] = {-1, -1};
+    if (opt->ordered && pipe2(ret, O_CLOEXEC) < 0)
+    {
+        eprint("pipe failed\n");
+        chan_close(&w->ch);
+        return -1;
+    }
+    struct job_hdr h = {.magic = JOB_MAGIC, .kind = JOB_WORK, .flags = opt->utf8 ? JOB_UTF8 : 0};
+    int fds[5];
+    int nfds = chan_pass_fds(&w->ch, fds);
+    if (w->ch.kind == TRANSPORT_SHM)
+        h.flags |= JOB_SHM;
+    fds[nfds++] = ret[1] >= 0 ? ret[1] : out_fd;
+    if (file_fd >= 0)
     {
-        ssize_t r = read(fd, tmp, sizeof(tmp)); // Читаем порцию данных
-        if (r < 0)                              // Если произошла ошибка чтения
+        h.flags |= JOB_FILE;
+        fds[nfds++] = file_fd;
+    }
+    if (job_send(w->job_sock, &h, fds, nfds) < 0)
+    {
+        chan_close(&w->ch);
+        if (ret[0] >= 0)
         {
-            if (errno == EINTR) // Если чтение прервано сигналом
-                continue;       // Повторяем попытку
-            free(buf);          // Освобождаем память
-            return -1;          // Возвращаем ошибку
+            close(ret[0]);
+            close(ret[1]);
+        }
+        restart_pool_worker(w, idx, opt, mask);
+        return -1;
+    }
+    chan_parent_setup(&w->ch);
+    w->ret_fd = ret[0];
+    if (ret[1] >= 0)
+        close(ret[1]); // Копия у обработчика: по окончании задания он её закроет - EOF
+    char entry[ST_NAME];
+    if (w->ch.kind == TRANSPORT_PIPE)
+    {
+        snprintf(entry, sizeof(entry), "child%d.pipe", idx);
+        st_watch(w->ch.fd, ST_WR, entry);
+    }
+    if (w->ret_fd >= 0)
+    {
+        snprintf(entry, sizeof(entry), "child%d.ret", idx);
+        st_watch(w->ret_fd, ST_RD, entry);
+    }
+    return 0;
+}
+
+/* daemon_job: выполняет задание клиента: строки его stdin (in_fd) раздаются первым n
+   обработчикам пула, их вывод идёт в его stdout (out_fd) и файлы. Возвращает код для клиента. */
+static int daemon_job(const struct options *opt, struct worker *w, int n, int in_fd, int out_fd,
+                      const int *file_fd, const sigset_t *mask)
+{
+    int status = 0;
+    int sent = 0; // Обработчики, получившие задание
+    for (; sent < n; ++sent)
+    {
+        if (pool_send(opt, &w[sent], sent + 1, out_fd, file_fd[sent], mask) < 0)
+        {
+            eprint("Failed to start job\n");
+            status = 1;
+            break;
         }
-        else if (r == 0) // Если достигнут конец файла (EOF)
+    }
+
+    struct merge mg;
+    struct line_reader in;
+    int ordered = 0; // Слияние создано (mg_free нужен и после неудачи)
+    if (opt->ordered && status == 0)
+    {
+        int ok = mg_init(&mg, n, opt->order_window, out_fd) == 0;
+        for (int i = 0; ok && i < n; ++i)
+            ok = mg_attach(&mg, i, w[i].ret_fd) == 0;
+        if (!ok)
         {
-            if (len == 0) // Если ничего не было прочитано
-            {
-                free(buf);   // Освобождаем память
-                *out = NULL; // Устанавливаем выходной указатель в NULL
-                return 0;    // Возвращаем 0 (EOF)
-            }
-            *out = buf;          // Иначе возвращаем прочитанные данные
-            return (ssize_t)len; // Возвращаем длину
+            eprint("Out of memory\n");
+            status = 1;
         }
-        else // Если данные успешно прочитаны
+        ordered = mg.ret != NULL;
+    }
+    if (status == 0 && lr_init(&in, in_fd, 0) == 0)
+    {
+        struct route_log route = {NULL, 0, 0, 0};
+        st_watch(in_fd, ST_RD, "stdin.read");
+        if (run_loop(opt, w, &in, NULL, ordered ? &mg : NULL, &route) < 0)
+            status = 1;
+        st_unwatch(in_fd);
+        lr_free(&in);
+    }
+    else if (status == 0)
+    {
+        eprint("Out of memory\n");
+        status = 1;
+    }
+
+    /* Конец данных; в режиме --ordered - остаток вывода, затем ответы обработчиков */
+    for (int i = 0; i < sent; ++i)
+    {
+        if (w[i].ch.kind == TRANSPORT_PIPE)
+            st_unwatch(w[i].ch.fd);
+        chan_close(&w[i].ch);
+    }
+    if (ordered && status == 0 && mg_drain(&mg) < 0)
+    {
+        eprint("Error collecting worker output\n");
+        status = 1;
+    }
+    if (ordered && status == 0 && mg.lost)
+    {
+        eprint("Worker output ended early\n");
+        status = 1;
+    }
+    for (int i = 0; i < sent; ++i)
+    {
+        if (w[i].ret_fd < 0)
+            continue;
+        st_unwatch(w[i].ret_fd);
+        if (!ordered || mg.ret[i].fd != w[i].ret_fd) // Слиянию не передан - закрываем сами
+            close(w[i].ret_fd);
+        w[i].ret_fd = -1;
+    }
+    if (ordered) // Закрытые каналы возврата не дадут обработчикам застрять на записи
+        mg_free(&mg);
+    for (int i = 0; i < sent; ++i)
+    {
+        struct job_hdr h;
+        int nfds = 0;
+        if (job_recv(w[i].job_sock, &h, NULL, 0, &nfds) <= 0 || h.kind != JOB_DONE)
         {
-            for (ssize_t i = 0; i < r; ++i) // Обрабатываем каждый прочитанный байт
-            {
-                if (len + 1 >= cap) // Если буфер заполнен
-                {
-                    cap *= 2;                     // Удваиваем размер буфера
-                    char *nb = realloc(buf, cap); // Перевыделяем память
-                    if (!nb)                      // Если не удалось перевыделить
-                    {
-                        free(buf); // Освобождаем старый буфер
-                        return -1; // Возвращаем ошибку
-                    }
-                    buf = nb; // Обновляем указатель на буфер
-                }
-                buf[len++] = tmp[i]; // Копируем байт в буфер
-                if (tmp[i] == '\n')  // Если встретили символ новой строки
-                {
-                    *out = buf;          // Возвращаем буфер
-                    return (ssize_t)len; // Возвращаем длину строки
-                }
-            }
+            restart_pool_worker(&w[i], i + 1, opt, mask);
+            status = 1;
         }
+        else if (h.status != 0)
+            status = 1;
     }
+    return status;
 }
 
-/* eprint: вывод ошибки в stderr через write */
-static void eprint(const char *s)
+/* serve_client: принимает JOB_RUN от клиента c, выполняет его и отвечает JOB_DONE */
+static void serve_client(const struct options *opt, struct worker *w, int c, const sigset_t *mask)
 {
-    if (s)                          // Если строка не NULL
-        write_all(2, s, strlen(s)); // Выводим её в stderr (файловый дескриптор 2)
+    struct job_hdr h;
+    int fds[JOB_MAX_FDS];
+    int nfds = 0;
+    if (job_recv(c, &h, fds, JOB_MAX_FDS, &nfds) <= 0)
+        return;
+    int n = (int)h.nfiles;
+    int status = 1;
+    int file_fd[MAX_WORKERS];
+    int k = 2; // fds: stdin, stdout, затем файлы по маске
+    for (int i = 0; i < n && i < MAX_WORKERS; ++i)
+        file_fd[i] = (h.files >> i & 1) && k < nfds ? fds[k++] : -1;
+    if (h.kind != JOB_RUN || n < 1 || n > opt->nworkers || nfds < 2 || k != nfds)
+        eprint("Bad job request\n");
+    else
+    {
+        struct options jo = *opt; // Число обработчиков и -u - свои у каждого задания
+        jo.nworkers = n;
+        jo.utf8 = (h.flags & JOB_UTF8) != 0;
+        status = daemon_job(&jo, w, n, fds[0], fds[1], file_fd, mask);
+    }
+    /* Дескрипторы клиента закрываем до ответа: получив его, клиент завершится, и читатель его
+       stdout увидит EOF */
+    for (int i = 0; i < nfds; ++i)
+        close(fds[i]);
+    h = (struct job_hdr){.magic = JOB_MAGIC, .kind = JOB_DONE, .status = status};
+    job_send(c, &h, NULL, 0);
 }
 
-int main(void)
+/* stop_pool: закрытый сокет заданий - сигнал обработчику пула завершиться; ждём n первых */
+static void stop_pool(struct worker *w, int n)
 {
-    /* Запрашиваем имя файла для первого дочернего процесса */
-    write_all(1, "Enter filename for child1: ", 27); // Выводим приглашение в stdout
-    char *filename1 = NULL;                          // Указатель для имени файла
-    ssize_t len1 = read_line_from_fd(0, &filename1); // Читаем строку из stdin (fd=0)
-    if (len1 <= 0)                                   // Если не удалось прочитать
+    for (int i = 0; i < n; ++i)
     {
-        eprint("Failed to read filename for child1\n"); // Выводим ошибку
-        return 1;                                       // Завершаем программу с ошибкой
+        if (w[i].job_sock >= 0)
+            close(w[i].job_sock);
+        waitpid(w[i].pid, NULL, 0);
     }
-    if (filename1[len1 - 1] == '\n') // Если в конце есть символ новой строки
-        filename1[len1 - 1] = '\0';  // Заменяем его на нулевой терминатор
+}
 
-    /* Запрашиваем имя файла для второго дочернего процесса */
-    write_all(1, "Enter filename for child2: ", 27); // Выводим приглашение
-    char *filename2 = NULL;                          // Указатель для второго имени
-    ssize_t len2 = read_line_from_fd(0, &filename2); // Читаем вторую строку
-    if (len2 <= 0)                                   // Если не удалось прочитать
+/* run_daemon: режим --daemon - пул из opt->nworkers обработчиков и приём заданий на сокете
+   opt->daemon, по одному за раз. Завершается по SIGTERM/SIGINT после текущего задания. */
+static int run_daemon(const struct options *opt)
+{
+    struct sockaddr_un sa = {.sun_family = AF_UNIX};
+    if (strlen(opt->daemon) >= sizeof(sa.sun_path))
+    {
+        eprint("Socket path too long\n");
+        return 1;
+    }
+    strcpy(sa.sun_path, opt->daemon);
+    int ls = socket(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0);
+    unlink(opt->daemon); // Сокет от прошлого запуска
+    if (ls < 0 || bind(ls, (struct sockaddr *)&sa, sizeof(sa)) < 0 || listen(ls, 16) < 0)
     {
-        eprint("Failed to read filename for child2\n"); // Выводим ошибку
-        free(filename1);                                // Освобождаем первое имя
-        return 1;                                       // Завершаем программу
+        eprint("Failed to listen on socket\n");
+        return 1;
     }
-    if (filename2[len2 - 1] == '\n') // Убираем символ новой строки
-        filename2[len2 - 1] = '\0';
 
-    /* Создаём два канала (pipe) для межпроцессного взаимодействия */
-    int pipe1[2], pipe2[2]; // pipe1[0] - чтение, pipe1[1] - запись
+    /* SIGTERM/SIGINT доставляются только в ожидании задания (ppoll): начатое задание
+       доводится до конца. Закрытый клиентом stdout - ошибка задания, а не конец демона */
+    sigset_t stop, mask;
+    sigemptyset(&stop);
+    sigaddset(&stop, SIGTERM);
+    sigaddset(&stop, SIGINT);
+    sigprocmask(SIG_BLOCK, &stop, &mask);
+    struct sigaction sa_stop;
+    memset(&sa_stop, 0, sizeof(sa_stop));
+    sa_stop.sa_handler = on_stop;
+    sigemptyset(&sa_stop.sa_mask);
+    sigaction(SIGTERM, &sa_stop, NULL);
+    sigaction(SIGINT, &sa_stop, NULL);
+    signal(SIGPIPE, SIG_IGN);
 
-    if (pipe(pipe1) < 0) // Создаём первый канал
+    int n = opt->nworkers;
+    struct worker *w = calloc((size_t)n, sizeof(*w));
+    if (!w)
+        eprint("Out of memory\n");
+    else
+        place_workers(opt, w, n);
+    for (int i = 0; w && i < n; ++i)
     {
-        eprint("pipe1 failed\n"); // Если не удалось создать канал
-        free(filename1);          // Освобождаем память
-        free(filename2);
-        return 1; // Завершаем программу
+        w[i].ret_fd = -1;
+        if (spawn_pool_worker(&w[i], i + 1, opt, &mask) < 0) // Уже запущенные - завершаем
+        {
+            stop_pool(w, i);
+            free(w);
+            w = NULL;
+        }
     }
-    if (pipe(pipe2) < 0) // Создаём второй канал
+    if (!w) // Сокет не должен остаться ни открытым, ни в файловой системе
     {
-        eprint("pipe2 failed\n");
-        free(filename1);
-        free(filename2);
+        close(ls);
+        unlink(opt->daemon);
         return 1;
     }
 
-    /* Создаём первый дочерний процесс */
-    pid_t pid1 = fork(); // fork() создаёт копию процесса
-    if (pid1 < 0)        // Если fork() вернул ошибку
+    while (!daemon_stop)
     {
-        eprint("fork child1 failed\n");
-        free(filename1);
-        free(filename2);
-        return 1;
+        struct pollfd p = {.fd = ls, .events = POLLIN};
+        if (ppoll(&p, 1, NULL, &mask) < 0)
+        {
+            if (errno == EINTR)
+                continue;
+            eprint("ppoll failed\n");
+            break;
+        }
+        int c = accept4(ls, NULL, NULL, SOCK_CLOEXEC);
+        if (c < 0)
+            continue; // Клиент мог уйти, не дождавшись приёма
+        serve_client(opt, w, c, &mask);
+        close(c);
     }
 
-    if (pid1 == 0) // Код выполняется только в дочернем процессе child1
+    close(ls);
+    unlink(opt->daemon);
+    stop_pool(w, n);
+    free(w);
+    if (opt->stats)
     {
-        /* Закрываем ненужные дескрипторы */
-        close(pipe1[1]); // Закрываем конец записи первого канала (child1 только читает)
-        close(pipe2[0]); // Закрываем второй канал (child1 его не использует)
-        close(pipe2[1]);
+        st_block(1);
+        dump_stats();
+        st_block(0);
+    }
+    return 0;
+}
 
-        /* Перенаправляем stdin на чтение из pipe1 */
-        if (dup2(pipe1[0], 0) == -1) // Делаем pipe1[0] новым stdin (fd=0)
+/* read_name_raw: имя файла со stdin по одному байту - клиент не должен забрать ни байта строк,
+   stdin целиком уходит демону. Возвращает копию (malloc) или NULL на EOF или при ошибке. */
+static char *read_name_raw(void)
+{
+    char name[PATH_MAX];
+    size_t len = 0;
+    while (1)
+    {
+        char c;
+        ssize_t r = read(0, &c, 1);
+        if (r < 0 && errno == EINTR)
+            continue;
+        if (r <= 0) // Как и read_filename: последняя строка без '\n' - тоже имя
         {
-            eprint("dup2 child1 failed\n");
-            _exit(1); // _exit() не вызывает обработчики atexit()
+            if (r < 0 || len == 0)
+                return NULL;
+            break;
         }
-        close(pipe1[0]); // Закрываем старый дескриптор (теперь он дублирован в stdin)
-
-        /* Заменяем текущий процесс на программу child1 */
-        execl("./child1", "child1", filename1, (char *)NULL); // Передаём имя файла как аргумент
-        /* Если execl() вернул управление, значит произошла ошибка */
-        eprint("execl child1 failed\n");
-        _exit(1); // Завершаем дочерний процесс
+        if (c == '\n')
+            break;
+        if (len == sizeof(name) - 1)
+            return NULL;
+        name[len++] = c;
     }
+    return strndup(name, len);
+}
 
-    /* Создаём второй дочерний процесс */
-    pid_t pid2 = fork(); // Снова создаём копию родительского процесса
-    if (pid2 < 0)        // Проверяем на ошибку
+/* run_client: режим --connect - открывает выходные файлы (имена разрешаются здесь, в каталоге
+   клиента), отдаёт демону stdin, stdout и файлы и ждёт конца задания. Возвращает код выхода. */
+static int run_client(const struct options *opt, char **files, int nfiles)
+{
+    struct sockaddr_un sa = {.sun_family = AF_UNIX};
+    if (strlen(opt->connect) >= sizeof(sa.sun_path))
+    {
+        eprint("Socket path too long\n");
+        return 1;
+    }
+    strcpy(sa.sun_path, opt->connect);
+    int s = socket(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0);
+    if (s < 0 || connect(s, (struct sockaddr *)&sa, sizeof(sa)) < 0)
     {
-        eprint("fork child2 failed\n");
-        free(filename1);
-        free(filename2);
+        eprint("Failed to connect to daemon\n");
         return 1;
     }
 
-    if (pid2 == 0) // Код выполняется только в дочернем процессе child2
+    int n = opt->nworkers;
+    struct job_hdr h = {.magic = JOB_MAGIC, .kind = JOB_RUN, .flags = opt->utf8 ? JOB_UTF8 : 0,
+                        .nfiles = (uint32_t)n};
+    int fds[2 + MAX_WORKERS] = {0, 1};
+    int nfds = 2;
+    int rc = 1;
+    for (int i = 0; i < n; ++i)
     {
-        /* Закрываем ненужные дескрипторы */
-        close(pipe2[1]); // Закрываем конец записи второго канала
-        close(pipe1[0]); // Закрываем первый канал (child2 его не использует)
-        close(pipe1[1]);
+        char *name;
+        if (opt->tmpl)
+            name = expand_template(opt->tmpl, i + 1);
+        else if (nfiles > 0)
+            name = strdup(files[i]);
+        else
+        {
+            char prompt[64];
+            int plen = snprintf(prompt, sizeof(prompt), "Enter filename for child%d: ", i + 1);
+            write_all(1, prompt, (size_t)plen);
+            name = read_name_raw();
+        }
+        if (!name)
+        {
+            char msg[64];
+            snprintf(msg, sizeof(msg), "Failed to get filename for child%d\n", i + 1);
+            eprint(msg);
+            goto out;
+        }
+        int fd = open(name, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+        free(name);
+        if (fd < 0) // Как у обработчика: без файла - только stdout
+        {
+            char msg[64];
+            snprintf(msg, sizeof(msg), "child%d: open failed\n", i + 1);
+            eprint(msg);
+            continue;
+        }
+        fds[nfds++] = fd;
+        h.files |= 1ull << i;
+    }
 
-        /* Перенаправляем stdin на чтение из pipe2 */
-        if (dup2(pipe2[0], 0) == -1) // Делаем pipe2[0] новым stdin
+    write_all(1, "Enter lines (Ctrl+D to finish):\n", 33);
+    int nr = 0;
+    if (job_send(s, &h, fds, nfds) < 0 || job_recv(s, &h, NULL, 0, &nr) <= 0 || h.kind != JOB_DONE)
+        eprint("Daemon connection lost\n");
+    else
+        rc = h.status;
+out:
+    for (int i = 2; i < nfds; ++i)
+        close(fds[i]);
+    close(s);
+    return rc;
+}
+
+/* usage: краткая справка по параметрам командной строки */
+static void usage(void)
+{
+    eprint("Usage: parent [-j N] [-o TEMPLATE] [-D rr|least|hash] [-r ROUTELOG] [-b KiB] [-m records] [-d ms]\n"
+           "              [-q KiB] [-P KiB] [-C KiB] [-T pipe|shm] [-u]\n"
+           "              [--out-buffer=KiB] [--out-deadline=ms] [--tee] [--io-uring]\n"
+           "              [--input=INFILE] [--ordered[=KiB]] [--stats[=FILE]] [--threads]\n"
+           "              [--gzip[=LEVEL]] [--gzip-threads=N] [--direct] [--sync=POLICY]\n"
+           "              [--writeback=MiB] [--spill=MiB] [--rev-threads=N] [--transform=CHAIN]\n"
+           "              [--cache=MiB] [--placement=l3|spread] [FILE...]\n"
+           "       parent --daemon=SOCK [-j N] [pipeline options]\n"
+           "       parent --connect=SOCK [-j N] [-o TEMPLATE] [-u] [FILE...]\n"
+           "  -j N         number of worker processes (default 2)\n"
+           "  -o TEMPLATE  output file name, %d is replaced by the worker number (1..N)\n"
+           "  FILE...      N output file names (otherwise asked on stdin)\n"
+           "  -D rr        round-robin by line number: line k goes to worker (k-1)%N+1 (default)\n"
+           "  -D least     each new frame goes to the worker with the emptiest pipe\n"
+           "  -D hash      by a hash of the line content: identical lines always go to the same\n"
+           "               worker, which serves repeats from its result cache (see --cache);\n"
+           "               lines longer than 1 MiB are routed by their first MiB\n"
+           "  -r ROUTELOG  record \"first_line count worker\" for every run of lines sent to one worker\n"
+           "  -b KiB       max frame payload sent to a worker (default 64)\n"
+           "  -m records   max records per frame (default 1024)\n"
+           "  -d ms        flush deadline for a partially filled frame (default 10)\n"
+           "  -q KiB       per-worker queue of unsent frames, or ring size with shm; input stalls only\n"
+           "               when it is full (default 4096)\n"
+           "  -P KiB       pipe capacity set with F_SETPIPE_SZ (default 1024)\n"
+           "  -C KiB       chunk mode: send multi-line chunks of about KiB each (splice from a regular file)\n"
+           "  -T pipe      --transport=pipe: frames over a pipe per worker (default)\n"
+           "  -T shm       --transport=shm: shared-memory ring per worker, read in place by the worker\n"
+           "  -u           --utf8: reverse by UTF-8 characters instead of bytes\n"
+           "  --out-buffer=KiB    worker output buffer, flushed with one writev per sink (default 256)\n"
+           "  --out-deadline=ms   max time a line waits in the output buffer (default 10)\n"
+           "  --tee        with -j 1: the worker writes the file once and duplicates it to stdout\n"
+           "               with tee() when stdout is a pipe\n"
+           "  --io-uring   workers read input ahead and keep several output buffers in flight with\n"
+           "               io_uring (falls back to read/writev when the kernel does not allow it)\n"
+           "  --input=INFILE  read lines from INFILE instead of stdin: the file is mapped and indexed,\n"
+           "               workers get (offset, length) descriptors and reverse lines straight into\n"
+           "               their memory-mapped output files\n"
+           "  --ordered[=KiB]  stdout in input order: workers return output to the parent, which\n"
+           "               merges it; at most KiB bytes are in flight (default 16384)\n"
+           "  --stats[=FILE]  write a JSON report of parent and worker counters (lines, bytes, CPU,\n"
+           "               syscalls and time blocked per fd, line length histogram) at exit to FILE\n"
+           "               or stderr; SIGUSR1 writes the same report at any time\n"
+           "  --threads    run the workers as threads of the parent, fed through in-memory SPSC\n"
+           "               rings (implies -T shm); output files and stdout are the same as with\n"
+           "               worker processes\n"
+           "  --gzip[=LEVEL]  workers write their output files gzip-compressed (level 1..9, default 6)\n"
+           "               as a series of independently compressed 256 KiB members; gzip -d restores\n"
+           "               exactly the uncompressed output\n"
+           "  --gzip-threads=N  compression threads per worker, started only when lines arrive faster\n"
+           "               than one thread compresses; 0 compresses in the worker itself (default:\n"
+           "               CPUs divided among the workers)\n"
+           "  --direct     write output files with O_DIRECT in 1 MiB aligned blocks (page cache is\n"
+           "               used where the filesystem does not support it)\n"
+           "  --sync=POLICY  when output files must be on disk: none (default), close (fdatasync\n"
+           "               before exit) or periodic[:MiB] (fdatasync every MiB written, default 64)\n"
+           "  --writeback=MiB  start writeback of every MiB of output at once and drop the previous\n"
+           "               window from the page cache, so multi-GB outputs do not fill memory\n"
+           "  --spill=MiB  lines are forwarded to workers in 1 MiB pieces; a worker assembles a line\n"
+           "               of up to MiB in memory (default 64) and a longer one in an unnamed file\n"
+           "               in $TMPDIR (or /tmp), which it reads back from the end to reverse\n"
+           "  --rev-threads=N  extra threads per worker that reverse a line of 4 MiB or more in\n"
+           "               parallel segments; shorter lines are reversed by the worker alone\n"
+           "               (default: CPUs divided among the workers, minus the worker itself)\n"
+           "  --transform=CHAIN  what workers do with each line instead of reversing it: steps\n"
+           "               separated by commas, applied in order - reverse, trim, lower, upper,\n"
+           "               filter:TEXT (keep only lines containing TEXT), drop:TEXT (skip them).\n"
+           "               The chain is fused into in-place passes over the line buffer; trim,\n"
+           "               filter and drop change line lengths and cannot be combined with\n"
+           "               --ordered or --input, and only a plain reverse chain allows --spill\n"
+           "  --cache=MiB  per-worker cache of transformed lines (up to 16 KiB each) keyed by their\n"
+           "               content; repeats skip the transform. 0 disables it (default: 16 with\n"
+           "               -D hash, otherwise 0); hits and misses are reported by --stats\n"
+           "  --placement=l3  pin the parent and the workers to CPUs of one L3 cache domain (sysfs\n"
+           "               topology): one core each first, spare CPUs go to the workers' helpers\n"
+           "  --placement=spread  pin them across all cores, alternating packages\n"
+           "               With either policy a worker's shm ring is placed on its NUMA node, and\n"
+           "               --stats reports each process's \"cpus\" and \"node\"\n"
+           "  --daemon=SOCK  keep a pool of N workers (started with posix_spawn) and serve jobs\n"
+           "               from clients on the Unix socket SOCK one at a time; SIGTERM stops it\n"
+           "               after the current job\n"
+           "  --connect=SOCK  run as a client of the daemon: output files are opened here, stdin,\n"
+           "               stdout and the files are handed to the daemon, which reverses the lines\n"
+           "               with the first N workers of its pool\n");
+}
+
+int main(int argc, char *argv[])
+{
+    struct options o = {
+        .nworkers = 2,
+        .mode = DISPATCH_RR,
+        .frame_bytes = FRAME_DEFAULT_BYTES,
+        .frame_records = FRAME_DEFAULT_RECORDS,
+        .deadline_ms = FRAME_DEFAULT_DEADLINE_MS,
+        .queue_limit = (size_t)DEFAULT_QUEUE_KB * 1024,
+        .pipe_size = DEFAULT_PIPE_KB * 1024,
+        .gzip_threads = -1,
+        .rev_threads = -1,
+        .cache_mb = -1,
+    };
+    static const struct option long_opts[] = {
+        {"transport", required_argument, NULL, 'T'},
+        {"utf8", no_argument, NULL, 'u'},
+        {"out-buffer", required_argument, NULL, OPT_OUT_BUFFER},
+        {"out-deadline", required_argument, NULL, OPT_OUT_DEADLINE},
+        {"tee", no_argument, NULL, OPT_TEE},
+        {"io-uring", no_argument, NULL, OPT_IO_URING},
+        {"input", required_argument, NULL, OPT_INPUT},
+        {"ordered", optional_argument, NULL, OPT_ORDERED},
+        {"stats", optional_argument, NULL, OPT_STATS},
+        {"threads", no_argument, NULL, OPT_THREADS},
+        {"daemon", required_argument, NULL, OPT_DAEMON},
+        {"connect", required_argument, NULL, OPT_CONNECT},
+        {"gzip", optional_argument, NULL, OPT_GZIP},
+        {"gzip-threads", required_argument, NULL, OPT_GZIP_THREADS},
+        {"direct", no_argument, NULL, OPT_DIRECT},
+        {"sync", required_argument, NULL, OPT_SYNC},
+        {"writeback", required_argument, NULL, OPT_WRITEBACK},
+        {"spill", required_argument, NULL, OPT_SPILL},
+        {"rev-threads", required_argument, NULL, OPT_REV_THREADS},
+        {"transform", required_argument, NULL, OPT_TRANSFORM},
+        {"cache", required_argument, NULL, OPT_CACHE},
+        {"placement", required_argument, NULL, OPT_PLACEMENT},
+        {"help", no_argument, NULL, 'h'},
+        {NULL, 0, NULL, 0},
+    };
+    int opt;
+    while ((opt = getopt_long(argc, argv, "j:o:D:r:b:m:d:q:P:C:T:uh", long_opts, NULL)) != -1)
+    {
+        switch (opt)
         {
-            eprint("dup2 child2 failed\n");
-            _exit(1);
+        case 'j':
+            o.nworkers = atoi(optarg);
+            break;
+        case 'o':
+            o.tmpl = optarg;
+            break;
+        case 'D':
+            if (strcmp(optarg, "rr") == 0)
+                o.mode = DISPATCH_RR;
+            else if (strcmp(optarg, "least") == 0)
+                o.mode = DISPATCH_LEAST;
+            else if (strcmp(optarg, "hash") == 0)
+                o.mode = DISPATCH_HASH;
+            else
+            {
+                usage();
+                return 1;
+            }
+            break;
+        case 'r':
+            o.route_path = optarg;
+            break;
+        case 'b':
+            o.frame_bytes = (size_t)strtoul(optarg, NULL, 10) * 1024;
+            break;
+        case 'm':
+            o.frame_records = (uint32_t)strtoul(optarg, NULL, 10);
+            break;
+        case 'd':
+            o.deadline_ms = atoi(optarg);
+            break;
+        case 'q':
+            o.queue_limit = (size_t)strtoul(optarg, NULL, 10) * 1024;
+            break;
+        case 'P':
+            o.pipe_size = atoi(optarg) * 1024;
+            o.pipe_size_set = 1;
+            break;
+        case 'T':
+            o.transport_set = 1;
+            if (strcmp(optarg, "pipe") == 0)
+                o.transport = TRANSPORT_PIPE;
+            else if (strcmp(optarg, "shm") == 0)
+                o.transport = TRANSPORT_SHM;
+            else
+            {
+                usage();
+                return 1;
+            }
+            break;
+        case 'C':
+            o.chunk_size = (size_t)strtoul(optarg, NULL, 10) * 1024;
+            if (o.chunk_size == 0)
+            {
+                usage();
+                return 1;
+            }
+            break;
+        case 'u':
+            o.utf8 = 1;
+            break;
+        case OPT_OUT_BUFFER:
+            o.out_kb = optarg;
+            if (atoi(optarg) <= 0)
+            {
+                usage();
+                return 1;
+            }
+            break;
+        case OPT_OUT_DEADLINE:
+            o.out_ms = optarg;
+            if (atoi(optarg) < 0)
+            {
+                usage();
+                return 1;
+            }
+            break;
+        case OPT_TEE:
+            o.tee = 1;
+            break;
+        case OPT_IO_URING:
+            o.io_uring = 1;
+            break;
+        case OPT_INPUT:
+            o.input = optarg;
+            break;
+        case OPT_ORDERED:
+            o.ordered = 1;
+            if (optarg && (o.order_window = (size_t)strtoul(optarg, NULL, 10) * 1024) == 0)
+            {
+                usage();
+                return 1;
+            }
+            break;
+        case OPT_THREADS:
+            o.threads = 1;
+            break;
+        case OPT_STATS:
+            o.stats = 1;
+            o.stats_path = optarg;
+            break;
+        case OPT_DAEMON:
+            o.daemon = optarg;
+            break;
+        case OPT_CONNECT:
+            o.connect = optarg;
+            break;
+        case OPT_GZIP:
+            o.gzip_level = optarg ? atoi(optarg) : GZW_DEFAULT_LEVEL;
+            if (o.gzip_level < 1 || o.gzip_level > 9)
+            {
+                usage();
+                return 1;
+            }
+            break;
+        case OPT_GZIP_THREADS:
+            o.gzip_threads = atoi(optarg);
+            if (o.gzip_threads < 0 || o.gzip_threads > GZW_MAX_THREADS)
+            {
+                usage();
+                return 1;
+            }
+            break;
+        case OPT_DIRECT:
+            o.file.direct = 1;
+            break;
+        case OPT_SYNC:
+            o.sync = optarg;
+            if (fs_parse_sync(optarg, &o.file) < 0)
+            {
+                usage();
+                return 1;
+            }
+            break;
+        case OPT_SPILL:
+            o.spill = optarg;
+            if (atoi(optarg) <= 0)
+            {
+                usage();
+                return 1;
+            }
+            break;
+        case OPT_PLACEMENT:
+            if (strcmp(optarg, "l3") == 0)
+                o.placement = TP_L3;
+            else if (strcmp(optarg, "spread") == 0)
+                o.placement = TP_SPREAD;
+            else
+            {
+                usage();
+                return 1;
+            }
+            break;
+        case OPT_CACHE:
+            o.cache_mb = atoi(optarg);
+            if (o.cache_mb < 0 || o.cache_mb > 4096)
+            {
+                usage();
+                return 1;
+            }
+            break;
+        case OPT_TRANSFORM:
+            o.xform = optarg;
+            break;
+        case OPT_REV_THREADS:
+            o.rev_threads = atoi(optarg);
+            if (o.rev_threads < 0 || o.rev_threads > REV_MAX_THREADS)
+            {
+                usage();
+                return 1;
+            }
+            break;
+        case OPT_WRITEBACK:
+            o.writeback = optarg;
+            if ((o.file.writeback_bytes = strtoull(optarg, NULL, 10) * 1024 * 1024) == 0)
+            {
+                usage();
+                return 1;
+            }
+            break;
+        default:
+            usage();
+            return opt == 'h' ? 0 : 1;
         }
-        close(pipe2[0]); // Закрываем старый дескриптор
+    }
+    if (o.threads && !o.transport_set) // Потоки читают кольцо в памяти процесса
+        o.transport = TRANSPORT_SHM;
+    int nworkers = o.nworkers;
+    int nfiles = argc - optind; // Имена файлов, переданные аргументами
+    /* Цепочку разбираем и здесь: ошибка видна сразу, а не у каждого обработчика */
+    struct xform xf;
+    int xf_bad = o.xform && xf_parse(&xf, o.xform, o.utf8) < 0;
+    int resize = o.xform && !xf_bad && !xf_same_length(&xf); // Длина строк меняется
+    if (nworkers < 1 || nworkers > MAX_WORKERS || o.frame_bytes == 0 || o.frame_records == 0 ||
+        o.deadline_ms < 0 || o.queue_limit == 0 || o.pipe_size <= 0 ||
+        (nfiles > 0 && (o.tmpl || nfiles != nworkers)) ||
+        (o.tee && nworkers != 1) || // tee() в общий stdout не атомарен - строки перемешаются
+        (o.tee && o.io_uring) ||    // Вывод через io_uring идёт из своих буферов, без tee()
+        (o.chunk_size && o.route_path) || // Фрагменты не разбираются на строки - журнала по строкам нет
+        (o.chunk_size && o.input) || // Фрагменты - это байты stdin, описатели - строки файла
+        (o.chunk_size && o.ordered) || // Фрагменты пишутся блокирующе, без чтения каналов возврата
+        (o.chunk_size && o.transport != TRANSPORT_PIPE) || // splice возможен только в канал
+        (o.chunk_size && o.mode == DISPATCH_HASH) || // Фрагмент - много строк с разными хешами
+        (o.threads && o.transport != TRANSPORT_SHM) ||     // Потокам строки идут только через кольцо
+        (o.gzip_level && (o.input || o.tee)) || // Файл пишется через отображение или splice - как есть
+        xf_bad ||
+        (resize && (o.ordered || o.input)) || // Слияние и отображение полагаются на исходную длину строк
+        (o.spill && o.xform && !xf_bad && !xf_spillable(&xf)) || // Такую строку обработчик собирает в памяти
+        /* Параметры записи файла - для слоя file_sink, мимо которого пишут отображение, tee() и io_uring */
+        ((o.file.direct || o.sync || o.writeback) && (o.input || o.tee || (o.io_uring && !o.gzip_level))) ||
+        /* Демон: задания - строки stdin клиента; файлы называет клиент */
+        (o.daemon && (o.connect || o.tmpl || nfiles > 0 || o.route_path || o.chunk_size || o.input ||
+                      o.threads || o.tee)) ||
+        /* Клиент: остальные параметры задаются при запуске демона */
+        (o.connect && (o.route_path || o.chunk_size || o.input || o.threads || o.tee || o.io_uring ||
+                       o.ordered || o.stats || o.transport_set || o.out_kb || o.out_ms || o.gzip_level ||
+                       o.file.direct || o.sync || o.writeback || o.spill || o.rev_threads >= 0 || o.xform ||
+                       o.cache_mb >= 0 || o.placement != TP_NONE)))
+    {
+        usage();
+        return 1;
+    }
+
+    if (o.connect) // Задание выполнит демон
+        return run_client(&o, argv + optind, nfiles);
 
-        /* Заменяем процесс на программу child2 */
-        execl("./child2", "child2", filename2, (char *)NULL); // Передаём имя файла
-        eprint("execl child2 failed\n");
-        _exit(1);
+    /* Потоки сжатия по умолчанию - процессоры поровну между обработчиками (помощники
+       запускаются, только когда сжатие не успевает, так что это лишь предел) */
+    if (o.gzip_level && o.gzip_threads < 0)
+    {
+        long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+        o.gzip_threads = cpus > nworkers ? (int)(cpus / nworkers) : 1;
     }
 
-    /* Родительский процесс: закрываем концы чтения каналов */
-    close(pipe1[0]); // Родитель не будет читать из pipe1
-    close(pipe2[0]); // Родитель не будет читать из pipe2
+    /* Кэш результатов по умолчанию - там, где повторы собираются у одного обработчика */
+    if (o.cache_mb < 0)
+        o.cache_mb = o.mode == DISPATCH_HASH ? (int)(LC_DEFAULT_BYTES >> 20) : 0;
 
-    /* Выводим приглашение для ввода строк */
-    write_all(1, "Enter lines (Ctrl+D to finish):\n", 33);
+    /* Помощники разворота - тоже доля процессоров обработчика; сам обработчик разворачивает
+       наравне с ними, поэтому их на один меньше (запускаются только при первой длинной строке) */
+    if (o.rev_threads < 0)
+    {
+        long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+        o.rev_threads = cpus > nworkers ? (int)(cpus / nworkers) - 1 : 0;
+        if (o.rev_threads > REV_MAX_THREADS)
+            o.rev_threads = REV_MAX_THREADS;
+    }
+
+    /* Подсказка размера файла: stdin - обычный файл, а разворот сохраняет длину строк,
+       так что каждый обработчик запишет около своей доли остатка stdin (trim и фильтры -
+       неизвестно сколько) */
+    struct stat in_st;
+    off_t in_pos;
+    if (!o.daemon && !o.input && !o.gzip_level && !resize && fstat(0, &in_st) == 0 && S_ISREG(in_st.st_mode) &&
+        (in_pos = lseek(0, 0, SEEK_CUR)) >= 0 && in_st.st_size > in_pos)
+        o.file.size_hint = (uint64_t)(in_st.st_size - in_pos) / (uint64_t)nworkers;
+
+    /* Статистика: слоты родителя и обработчиков в общей памяти (без неё - только родитель) */
+    st_nslots = nworkers + 1;
+    st_slots = st_shared(st_nslots, &st_memfd);
+    if (!st_slots && !(st_slots = calloc((size_t)st_nslots, sizeof(*st_slots))))
+    {
+        eprint("Out of memory\n");
+        return 1;
+    }
+    st_init("parent", st_slots);
+    if (o.stats_path && (st_fd = open(o.stats_path, O_WRONLY | O_CREAT | O_TRUNC | O_APPEND | O_CLOEXEC, 0644)) < 0)
+    {
+        eprint("Failed to open stats file\n");
+        return 1;
+    }
+    st_on_signal(dump_stats);
+    st_watch(0, ST_RD, "stdin.read");
+    st_watch(1, ST_WR, "stdout.write");
+    if (o.daemon)
+        return run_daemon(&o);
+
+    struct worker *w = calloc((size_t)nworkers, sizeof(*w)); // Состояние обработчиков
+    /* Один читатель на stdin для всего сеанса: имена файлов и строки идут из одного буфера,
+       поэтому данные, пришедшие вместе с именем файла, не теряются */
+    struct line_reader in;
+    if (!w || lr_init(&in, 0, 0) < 0) // Выделяем буфер читателя
+    {
+        eprint("Out of memory\n");
+        return 1;
+    }
 
-    int line_no = 0; // Счётчик строк (для распределения между процессами)
-    while (1)        // Бесконечный цикл чтения строк
+    /* Имена выходных файлов: из шаблона, из аргументов или запросом на stdin */
+    for (int i = 0; i < nworkers; ++i)
     {
-        char *line = NULL;                        // Указатель для очередной строки
-        ssize_t rl = read_line_from_fd(0, &line); // Читаем строку из stdin
-        if (rl < 0)                               // Если произошла ошибка чтения
+        if (o.tmpl)
+            w[i].filename = expand_template(o.tmpl, i + 1);
+        else if (nfiles > 0)
+            w[i].filename = strdup(argv[optind + i]);
+        else
         {
-            eprint("Error reading line\n");
-            break; // Выходим из цикла
+            char prompt[64];
+            int plen = snprintf(prompt, sizeof(prompt), "Enter filename for child%d: ", i + 1);
+            write_all(1, prompt, (size_t)plen);   // Выводим приглашение в stdout
+            w[i].filename = read_filename(&in);   // Читаем строку из stdin (fd=0)
         }
-        if (rl == 0) // Если достигнут конец ввода (EOF, Ctrl+D)
+        if (!w[i].filename) // Если не удалось получить имя
         {
-            free(line); // Освобождаем память
-            break;      // Выходим из цикла
+            char msg[64];
+            snprintf(msg, sizeof(msg), "Failed to get filename for child%d\n", i + 1);
+            eprint(msg);
+            return 1; // Завершаем программу с ошибкой
         }
+    }
+
+    /* Режим --input: индекс строк нужен до запуска обработчиков (размеры их файлов) */
+    struct line_index idx;
+    if (o.input && map_input(&o, w, &idx) < 0)
+        return 1;
+
+    /* Создаём обработчики - дочерние процессы или потоки, по каналу (кольцу) на каждый */
+    place_workers(&o, w, nworkers);
+    if (o.threads)
+        reverse_kernel(); // Ядро разворота выбирается один раз - до потоков, без гонки
+    for (int i = 0; i < nworkers; ++i)
+    {
+        if ((o.threads ? spawn_thread(&w[i], i + 1, &o) : spawn_worker(&w[i], i + 1, &o)) < 0)
+            return 1;
+    }
 
-        line_no++; // Увеличиваем номер строки
-        /* Определяем, в какой канал отправить строку */
-        int dest = (line_no % 2 == 1) ? pipe1[1] : pipe2[1]; // Нечётные в pipe1, чётные в pipe2
-        if (write_all(dest, line, (size_t)rl) < 0)           // Отправляем строку в канал
+    /* Режим --ordered: вывод обработчиков собирается из каналов возврата в один поток */
+    struct merge mg;
+    if (o.ordered)
+    {
+        int ok = mg_init(&mg, nworkers, o.order_window, 1) == 0;
+        for (int i = 0; ok && i < nworkers; ++i)
+            ok = mg_attach(&mg, i, w[i].ret_fd) == 0;
+        if (!ok)
         {
-            eprint("Error writing to pipe\n");
-            free(line);
-            break;
+            eprint("Out of memory\n");
+            return 1;
         }
-        free(line); // Освобождаем память после отправки
     }
 
-    /* Закрываем концы записи каналов */
-    close(pipe1[1]); // Сигнализируем child1, что больше данных не будет
-    close(pipe2[1]); // Сигнализируем child2, что больше данных не будет
+    struct route_log route = {NULL, 0, 0, 0};
+    if (o.route_path && !(route.f = fopen(o.route_path, "w"))) // Журнал распределения
+    {
+        eprint("Failed to open route log\n");
+        return 1;
+    }
+
+    /* Выводим приглашение для ввода строк (в режиме --input строки берутся из файла) */
+    if (!o.input)
+        write_all(1, "Enter lines (Ctrl+D to finish):\n", 33);
+
+    int rc = 0; // Код завершения: 1 - вывод неполон (ошибка раздачи или сбора --ordered)
+    if (o.chunk_size)
+        rc = run_chunks(&o, w, &in) < 0; // Фрагменты целиком: stdin -> каналы
+    else
+        rc = run_loop(&o, w, &in, o.input ? &idx : NULL, o.ordered ? &mg : NULL,
+                      &route) < 0; // Основной цикл: stdin -> фреймы -> каналы
+
+    route_flush(&route); // Дописываем последнюю серию
+    if (route.f)
+        fclose(route.f);
+
+    /* Сообщаем обработчикам о конце данных */
+    for (int i = 0; i < nworkers; ++i)
+        chan_close(&w[i].ch);
+
+    /* Режим --ordered: дожидаемся и выводим остаток вывода обработчиков */
+    if (o.ordered)
+    {
+        if (mg_drain(&mg) < 0)
+        {
+            eprint("Error collecting worker output\n");
+            rc = 1;
+        }
+        if (mg.lost)
+        {
+            eprint("Worker output ended early\n");
+            rc = 1;
+        }
+        mg_free(&mg);
+    }
 
     /* Ожидаем завершения дочерних процессов */
-    int status;                // Переменная для хранения статуса завершения
-    waitpid(pid1, &status, 0); // Ждём завершения child1
-    waitpid(pid2, &status, 0); // Ждём завершения child2
+    int status; // Переменная для хранения статуса завершения
+    for (int i = 0; i < nworkers; ++i)
+    {
+        if (o.threads)
+            pthread_join(w[i].thread, NULL);
+        else
+            waitpid(w[i].pid, &status, 0); // Ждём завершения обработчика
+        free(w[i].filename);           // Освобождаем имя файла
+    }
+
+    /* Итоговый отчёт: обработчики завершились и дописали свои слоты */
+    if (o.stats)
+    {
+        st_block(1); // Не вперемешку с отчётом по сигналу
+        dump_stats();
+        st_block(0);
+    }
 
     /* Освобождаем выделенную память */
-    free(filename1);
-    free(filename2);
+    free(w);
+    lr_free(&in);
+    if (o.input)
+    {
+        if (idx.data)
+            munmap((void *)idx.data, idx.size);
+        li_free(&idx);
+    }
 
-    return 0; // Успешное завершение программы
+    return rc;
 }
@@ -0,0 +1,156 @@
+#define _GNU_SOURCE
+#include <unistd.h>
+#include <string.h>
+#include <signal.h>
+
+#include "rev_pool.h"
+#include "reverse.h"
+#include "stats.h"
+
+/* part: разобранная часть прохода */
+struct part
+{
+    int phase;
+    size_t from, to; // Пары [from, to) или байты [from, to)
+};
+
+/* claim: берёт следующую часть текущего прохода (0 - частей не осталось). Вызывается под mu. */
+static int claim(struct rev_pool *p, struct part *pt)
+{
+    if (p->phase == 1 && p->next < p->n / 2)
+    {
+        pt->from = p->next;
+        pt->to = p->n / 2 - pt->from > REV_PART ? pt->from + REV_PART : p->n / 2;
+    }
+    else if (p->phase == 2 && p->next < p->n)
+    {
+        pt->from = p->next;
+        pt->to = p->n - pt->from > REV_PART ? reverse_fix_cut(p->s, p->n, pt->from + REV_PART) : p->n;
+    }
+    else
+        return 0;
+    pt->phase = p->phase;
+    p->next = pt->to;
+    return 1;
+}
+
+/* run_part: выполняет часть без блокировки */
+static void run_part(char *s, size_t n, enum case_fold fold, const struct part *pt)
+{
+    if (pt->phase == 1) // Пары [from, to) с левого края и их отражение с правого
+        reverse_swap(s + pt->from, s + n - pt->from, pt->to - pt->from, fold);
+    else
+        reverse_utf8_fix(s + pt->from, pt->to - pt->from);
+}
+
+/* helper: поток-помощник - выполняет части, пока не остановят */
+static void *helper(void *arg)
+{
+    struct rev_pool *p = arg;
+    pthread_mutex_lock(&p->mu);
+    while (!p->stop)
+    {
+        struct part pt;
+        if (!claim(p, &pt))
+        {
+            pthread_cond_wait(&p->work, &p->mu);
+            continue;
+        }
+        char *s = p->s;
+        size_t n = p->n;
+        enum case_fold fold = p->fold;
+        p->busy++;
+        pthread_mutex_unlock(&p->mu);
+        run_part(s, n, fold, &pt);
+        pthread_mutex_lock(&p->mu);
+        if (--p->busy == 0)
+            pthread_cond_signal(&p->done);
+    }
+    pthread_mutex_unlock(&p->mu);
+    return NULL;
+}
+
+void rp_init(struct rev_pool *p, int threads)
+{
+    memset(p, 0, sizeof(*p));
+    if (threads < 0)
+    {
+        long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+        threads = cpus > 1 ? (int)cpus - 1 : 0; // Вызывающий поток разворачивает наравне с ними
+    }
+    p->max_threads = threads < REV_MAX_THREADS ? threads : REV_MAX_THREADS;
+    p->st_wait = st_entry("rev.wait");
+    pthread_mutex_init(&p->mu, NULL);
+    pthread_cond_init(&p->work, NULL);
+    pthread_cond_init(&p->done, NULL);
+}
+
+/* start_helpers: запускает помощников до предела (при первой длинной строке) */
+static void start_helpers(struct rev_pool *p)
+{
+    /* Сигналы (SIGUSR1 - отчёт статистики) обрабатывает не помощник: у него нет слота */
+    sigset_t all, old;
+    sigfillset(&all);
+    pthread_sigmask(SIG_BLOCK, &all, &old);
+    while (p->nthreads < p->max_threads && pthread_create(&p->tid[p->nthreads], NULL, helper, p) == 0)
+        p->nthreads++;
+    if (p->nthreads < p->max_threads) // Не вышло - больше не пытаемся, строки разберут те, что есть
+        p->max_threads = p->nthreads;
+    pthread_sigmask(SIG_SETMASK, &old, NULL);
+}
+
+/* run_phase: открывает проход, сам разбирает части и ждёт, пока помощники закончат свои.
+   Вызывается под mu. */
+static void run_phase(struct rev_pool *p, int phase)
+{
+    p->phase = phase;
+    p->next = 0;
+    pthread_cond_broadcast(&p->work);
+    struct part pt;
+    while (claim(p, &pt))
+    {
+        pthread_mutex_unlock(&p->mu);
+        run_part(p->s, p->n, p->fold, &pt);
+        pthread_mutex_lock(&p->mu);
+    }
+    uint64_t t0 = st_now();
+    while (p->busy > 0) // Барьер: второй проход читает байты, которые переставил первый
+        pthread_cond_wait(&p->done, &p->mu);
+    st_account(p->st_wait, t0, 0);
+}
+
+void rp_reverse(struct rev_pool *p, char *s, size_t n, int utf8, enum case_fold fold)
+{
+    if (n < REV_PAR_MIN || p->max_threads == 0)
+    {
+        reverse_fold(s, n, utf8, fold); // Векторное ядро, выбранное по возможностям процессора
+        return;
+    }
+    if (p->nthreads == 0)
+        start_helpers(p);
+    pthread_mutex_lock(&p->mu);
+    p->s = s;
+    p->n = n;
+    p->fold = fold;
+    run_phase(p, 1);
+    if (n & 1) // Средний байт в обмен не входит
+        fold_case(s + n / 2, 1, fold);
+    if (utf8)
+        run_phase(p, 2);
+    p->phase = 0;
+    pthread_mutex_unlock(&p->mu);
+}
+
+void rp_free(struct rev_pool *p)
+{
+    pthread_mutex_lock(&p->mu);
+    p->stop = 1;
+    pthread_cond_broadcast(&p->work);
+    pthread_mutex_unlock(&p->mu);
+    for (int i = 0; i < p->nthreads; ++i)
+        pthread_join(p->tid[i], NULL);
+    p->nthreads = 0;
+    pthread_mutex_destroy(&p->mu);
+    pthread_cond_destroy(&p->work);
+    pthread_cond_destroy(&p->done);
+}
@@ -0,0 +1,50 @@
+#ifndef REV_POOL_H
+#define REV_POOL_H
+
+#include <sys/types.h>
+#include <stddef.h>
+#include <pthread.h>
+
+#include "reverse.h"
+
+/* Параллельный разворот очень длинных строк. Строка не короче REV_PAR_MIN делится на части:
+   в первом проходе каждая часть - REV_PART пар байтов с левого края и их отражение с правого,
+   которые поток меняет местами на месте (reverse_swap); для UTF-8 после общего барьера второй
+   проход возвращает порядок байтов внутри символов по кускам, разрезанным между символами
+   (reverse_fix_cut). Части разбирают помощники и сам вызывающий поток. Помощники запускаются
+   при первой длинной строке; строки короче порога разворачиваются последовательно, как раньше. */
+
+#define REV_PAR_MIN (4u * 1024 * 1024) // Строки короче разворачиваются без помощников
+#define REV_PART (256 * 1024)          // Часть работы: пар байтов или байтов второго прохода
+#define REV_MAX_THREADS 8              // Предел числа помощников
+
+/* rev_pool: помощники обработчика и текущая строка */
+struct rev_pool
+{
+    int max_threads;      // Предел помощников (0 - всё последовательно)
+    pthread_mutex_t mu;   // Защищает поля ниже
+    pthread_cond_t work;  // Появилась работа или пора завершаться
+    pthread_cond_t done;  // Помощник закончил часть
+    pthread_t tid[REV_MAX_THREADS];
+    int nthreads;         // Запущено помощников
+    int busy;             // Из них заняты частью
+    int stop;
+    char *s;              // Разворачиваемая строка
+    size_t n;
+    enum case_fold fold;  // Смена регистра при обмене пар
+    int phase;            // 0 - нет работы, 1 - обмен пар, 2 - порядок байтов UTF-8
+    size_t next;          // Начало первой неразобранной части прохода
+    int st_wait;          // Запись статистики: ожидание помощников на барьере (stats.h)
+};
+
+/* rp_init: threads - предел помощников (<0 - по числу процессоров без одного) */
+void rp_init(struct rev_pool *p, int threads);
+
+/* rp_reverse: разворачивает s[0, n) так же, как reverse_fold (utf8 - по символам, fold - со
+   сменой регистра); длинную строку - вместе с помощниками */
+void rp_reverse(struct rev_pool *p, char *s, size_t n, int utf8, enum case_fold fold);
+
+/* rp_free: останавливает помощников */
+void rp_free(struct rev_pool *p);
+
+#endif
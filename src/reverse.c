@@ -0,0 +1,470 @@
+#include <stdint.h>
+#include <string.h>
+
+#include "reverse.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#define REVERSE_X86 1
+#include <immintrin.h>
+#endif
+
+/* kernel: реализация разворота для одного набора инструкций */
+struct kernel
+{
+    const char *name;
+    void (*swap)(char *a, char *b, size_t n); // a[i] <-> b[-1 - i] для i < n (см. reverse_swap)
+    void (*fix_utf8)(unsigned char *s, size_t n); // Возврат символов UTF-8 в исходный порядок байтов
+    void (*swap_fold)(char *a, char *b, size_t n, unsigned char lo); // swap со сменой регистра букв [lo, lo + 26)
+    void (*fold)(char *s, size_t n, unsigned char lo); // Смена регистра букв [lo, lo + 26)
+};
+
+/* fold_lo: первая буква диапазона, у которого меняется бит регистра 0x20 */
+static unsigned char fold_lo(enum case_fold fold)
+{
+    return fold == FOLD_LOWER ? 'A' : 'a';
+}
+
+/* fold1: смена регистра одного байта */
+static inline char fold1(char c, unsigned char lo)
+{
+    return (unsigned char)((unsigned char)c - lo) < 26 ? (char)(c ^ 0x20) : c;
+}
+
+/* fold64: смена регистра в слове из 8 байт (SWAR: сравнение каждого байта - перенос в его
+   старший бит; младшие 7 бит складываются без переноса в соседний байт, байты >= 0x80 не меняются) */
+static inline uint64_t fold64(uint64_t w, unsigned char lo)
+{
+    const uint64_t ones = 0x0101010101010101ull, high = ones * 0x80;
+    uint64_t t = w & ~high;
+    uint64_t ge = t + ones * (uint64_t)(0x80 - lo);       // Старший бит: t >= lo
+    uint64_t ge_end = t + ones * (uint64_t)(0x80 - lo - 26); // t >= lo + 26
+    return w ^ ((ge & ~ge_end & ~w & high) >> 2);         // 0x80 >> 2 - бит регистра
+}
+
+/* swap_bytes_tail: побайтный обмен - хвост для всех ядер */
+static void swap_bytes_tail(char *a, char *b, size_t n)
+{
+    while (n-- > 0) // b указывает за последний байт
+    {
+        char t = *a;
+        *a++ = *--b;
+        *b = t;
+    }
+}
+
+/* swap_scalar: по 8 байт с каждого края за шаг (bswap меняет порядок байтов в слове) */
+static void swap_scalar(char *a, char *b, size_t n)
+{
+    for (; n >= 8; n -= 8)
+    {
+        uint64_t x, y;
+        memcpy(&x, a, 8); // memcpy - невыровненный доступ без нарушения правил алиасинга
+        memcpy(&y, b - 8, 8);
+        x = __builtin_bswap64(x);
+        y = __builtin_bswap64(y);
+        memcpy(a, &y, 8);
+        memcpy(b - 8, &x, 8);
+        a += 8;
+        b -= 8;
+    }
+    swap_bytes_tail(a, b, n);
+}
+
+/* swap_fold_tail: побайтный обмен со сменой регистра */
+static void swap_fold_tail(char *a, char *b, size_t n, unsigned char lo)
+{
+    while (n-- > 0)
+    {
+        char t = *a;
+        *a++ = fold1(*--b, lo);
+        *b = fold1(t, lo);
+    }
+}
+
+/* swap_fold_scalar: swap_scalar со сменой регистра слов перед записью */
+static void swap_fold_scalar(char *a, char *b, size_t n, unsigned char lo)
+{
+    for (; n >= 8; n -= 8)
+    {
+        uint64_t x, y;
+        memcpy(&x, a, 8);
+        memcpy(&y, b - 8, 8);
+        x = fold64(__builtin_bswap64(x), lo);
+        y = fold64(__builtin_bswap64(y), lo);
+        memcpy(a, &y, 8);
+        memcpy(b - 8, &x, 8);
+        a += 8;
+        b -= 8;
+    }
+    swap_fold_tail(a, b, n, lo);
+}
+
+static void fold_scalar(char *s, size_t n, unsigned char lo)
+{
+    for (; n >= 8; n -= 8, s += 8)
+    {
+        uint64_t w;
+        memcpy(&w, s, 8);
+        w = fold64(w, lo);
+        memcpy(s, &w, 8);
+    }
+    for (; n > 0; n--, s++)
+        *s = fold1(*s, lo);
+}
+
+/* skip_ascii: первый не-ASCII байт, начиная с i (по 8 байт: старший бит ни в одном байте не установлен) */
+static size_t skip_ascii(const unsigned char *s, size_t i, size_t n)
+{
+    for (; i + 8 <= n; i += 8)
+    {
+        uint64_t w;
+        memcpy(&w, s + i, 8);
+        if (w & 0x8080808080808080ull)
+            break;
+    }
+    while (i < n && s[i] < 0x80)
+        i++;
+    return i;
+}
+
+/* utf8_seq_len: длина последовательности по ведущему байту (0 - не ведущий байт) */
+static size_t utf8_seq_len(unsigned char c)
+{
+    if (c >= 0xc0 && c < 0xe0)
+        return 2;
+    if (c >= 0xe0 && c < 0xf0)
+        return 3;
+    if (c >= 0xf0 && c < 0xf8)
+        return 4;
+    return 0;
+}
+
+/* fix_step: обрабатывает развёрнутые байты, начиная с не-ASCII байта s[i].
+   После разворота символ выглядит как байты продолжения (10xxxxxx), за которыми идёт
+   ведущий байт; такая группа возвращается в исходный порядок. Возвращает следующую позицию. */
+static size_t fix_step(unsigned char *s, size_t i, size_t n)
+{
+    if ((s[i] & 0xc0) != 0x80) // Ведущий байт без продолжения - одиночный байт
+        return i + 1;
+    size_t j = i + 1;
+    while (j < n && (s[j] & 0xc0) == 0x80) // Серия байтов продолжения
+        j++;
+    if (j == n) // Продолжения без ведущего байта - остаются как есть
+        return n;
+    size_t need = utf8_seq_len(s[j]);
+    if (need && j - i >= need - 1) // Ближайшие need-1 байтов продолжения - хвост символа
+        swap_bytes_tail((char *)s + j - (need - 1), (char *)s + j + 1, need / 2);
+    return j + 1; // Лишние продолжения или оборванный символ остаются развёрнутыми побайтно
+}
+
+static void fix_scalar(unsigned char *s, size_t n)
+{
+    size_t i = 0;
+    while ((i = skip_ascii(s, i, n)) < n)
+        i = fix_step(s, i, n);
+}
+
+#ifdef REVERSE_X86
+/* swap_ssse3: по 16 байт с каждого края; pshufb с обратной маской разворачивает вектор */
+__attribute__((target("ssse3"))) static void swap_ssse3(char *a, char *b, size_t n)
+{
+    const __m128i m = _mm_setr_epi8(15, 14, 13, 12, 11, 10, 9, 8, 7, 6, 5, 4, 3, 2, 1, 0);
+    for (; n >= 16; n -= 16)
+    {
+        __m128i x = _mm_loadu_si128((const __m128i *)a);
+        __m128i y = _mm_loadu_si128((const __m128i *)(b - 16));
+        _mm_storeu_si128((__m128i *)a, _mm_shuffle_epi8(y, m));
+        _mm_storeu_si128((__m128i *)(b - 16), _mm_shuffle_epi8(x, m));
+        a += 16;
+        b -= 16;
+    }
+    swap_scalar(a, b, n); // Меньше 16 пар
+}
+
+/* fold16: смена регистра 16 байт. Сравнение знаковое: байты >= 0x80 отрицательные и в диапазон
+   не попадают. */
+__attribute__((target("ssse3"))) static inline __m128i fold16(__m128i x, unsigned char lo)
+{
+    __m128i m = _mm_and_si128(_mm_cmpgt_epi8(x, _mm_set1_epi8((char)(lo - 1))),
+                              _mm_cmplt_epi8(x, _mm_set1_epi8((char)(lo + 26))));
+    return _mm_xor_si128(x, _mm_and_si128(m, _mm_set1_epi8(0x20)));
+}
+
+__attribute__((target("ssse3"))) static void swap_fold_ssse3(char *a, char *b, size_t n, unsigned char lo)
+{
+    const __m128i m = _mm_setr_epi8(15, 14, 13, 12, 11, 10, 9, 8, 7, 6, 5, 4, 3, 2, 1, 0);
+    for (; n >= 16; n -= 16)
+    {
+        __m128i x = _mm_loadu_si128((const __m128i *)a);
+        __m128i y = _mm_loadu_si128((const __m128i *)(b - 16));
+        _mm_storeu_si128((__m128i *)a, fold16(_mm_shuffle_epi8(y, m), lo));
+        _mm_storeu_si128((__m128i *)(b - 16), fold16(_mm_shuffle_epi8(x, m), lo));
+        a += 16;
+        b -= 16;
+    }
+    swap_fold_scalar(a, b, n, lo);
+}
+
+__attribute__((target("ssse3"))) static void fold_ssse3(char *s, size_t n, unsigned char lo)
+{
+    for (; n >= 16; n -= 16, s += 16)
+        _mm_storeu_si128((__m128i *)s, fold16(_mm_loadu_si128((const __m128i *)s), lo));
+    fold_scalar(s, n, lo);
+}
+
+/* fix_block16: векторная обработка 16 байт, начиная с s[i], если в них только ASCII и
+   двухбайтные символы (кириллица, латиница с диакритикой). Байт продолжения меняется местами
+   со следующим за ним ведущим байтом одним pshufb. Возвращает число обработанных байт
+   (16, или 15, если символ разрезан границей блока) либо 0, если блок нужно обработать
+   по байтам (трёх- и четырёхбайтные символы, некорректные последовательности). */
+__attribute__((target("ssse3"))) static inline size_t fix_block16(unsigned char *s, size_t i)
+{
+    __m128i v = _mm_loadu_si128((const __m128i *)(s + i));
+    unsigned hi = (unsigned)_mm_movemask_epi8(v); // Не-ASCII байты
+    if (!hi)
+        return 16;
+    __m128i cont = _mm_cmpeq_epi8(_mm_and_si128(v, _mm_set1_epi8((char)0xc0)), _mm_set1_epi8((char)0x80));
+    __m128i lead2 = _mm_cmpeq_epi8(_mm_and_si128(v, _mm_set1_epi8((char)0xe0)), _mm_set1_epi8((char)0xc0));
+    unsigned mc = (unsigned)_mm_movemask_epi8(cont);
+    unsigned ml = (unsigned)_mm_movemask_epi8(lead2);
+    size_t len = 16;
+    if (mc & 0x8000) // Последний байт - начало символа, который закончится в следующем блоке
+    {
+        len = 15;
+        mc &= 0x7fff;
+        hi &= 0x7fff;
+        cont = _mm_srli_si128(_mm_slli_si128(cont, 1), 1); // Его не трогаем
+    }
+    /* Все не-ASCII байты - продолжения или ведущие двухбайтных, за каждым продолжением
+       сразу идёт ведущий байт */
+    if ((mc | ml) != hi || ((mc << 1) & ~ml & 0xffff))
+        return 0;
+    __m128i paired = _mm_and_si128(lead2, _mm_slli_si128(cont, 1)); // Ведущие байты пар
+    /* Индекс перестановки: продолжение берёт байт справа (+1), ведущий байт пары - слева (-1) */
+    __m128i idx = _mm_add_epi8(_mm_sub_epi8(_mm_setr_epi8(0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15),
+                                            cont),
+                               paired);
+    _mm_storeu_si128((__m128i *)(s + i), _mm_shuffle_epi8(v, idx));
+    return len;
+}
+
+__attribute__((target("ssse3"))) static void fix_ssse3(unsigned char *s, size_t n)
+{
+    size_t i = 0;
+    while (i + 16 <= n)
+    {
+        size_t done = fix_block16(s, i);
+        if (done)
+            i += done;
+        else if (s[i] < 0x80)
+            i++;
+        else
+            i = fix_step(s, i, n); // Символ, который блок не берёт, - по байтам
+    }
+    fix_scalar(s + i, n - i); // Хвост короче 16 байт (i не стоит внутри символа)
+}
+
+/* swap_avx2: по 32 байта с каждого края. vpshufb разворачивает байты внутри 128-битных половин,
+   vpermq меняет половины местами. */
+__attribute__((target("avx2"))) static void swap_avx2(char *a, char *b, size_t n)
+{
+    const __m256i m = _mm256_setr_epi8(15, 14, 13, 12, 11, 10, 9, 8, 7, 6, 5, 4, 3, 2, 1, 0,
+                                       15, 14, 13, 12, 11, 10, 9, 8, 7, 6, 5, 4, 3, 2, 1, 0);
+    for (; n >= 32; n -= 32)
+    {
+        __m256i x = _mm256_loadu_si256((const __m256i *)a);
+        __m256i y = _mm256_loadu_si256((const __m256i *)(b - 32));
+        x = _mm256_permute4x64_epi64(_mm256_shuffle_epi8(x, m), 0x4e);
+        y = _mm256_permute4x64_epi64(_mm256_shuffle_epi8(y, m), 0x4e);
+        _mm256_storeu_si256((__m256i *)a, y);
+        _mm256_storeu_si256((__m256i *)(b - 32), x);
+        a += 32;
+        b -= 32;
+    }
+    _mm256_zeroupper(); // Дальше SSE-код: без этого переход AVX -> SSE стоит дорого
+    swap_ssse3(a, b, n); // Меньше 32 пар
+}
+
+/* fold32: смена регистра 32 байт (как fold16) */
+__attribute__((target("avx2"))) static inline __m256i fold32(__m256i x, unsigned char lo)
+{
+    __m256i m = _mm256_and_si256(_mm256_cmpgt_epi8(x, _mm256_set1_epi8((char)(lo - 1))),
+                                 _mm256_cmpgt_epi8(_mm256_set1_epi8((char)(lo + 26)), x));
+    return _mm256_xor_si256(x, _mm256_and_si256(m, _mm256_set1_epi8(0x20)));
+}
+
+__attribute__((target("avx2"))) static void swap_fold_avx2(char *a, char *b, size_t n, unsigned char lo)
+{
+    const __m256i m = _mm256_setr_epi8(15, 14, 13, 12, 11, 10, 9, 8, 7, 6, 5, 4, 3, 2, 1, 0,
+                                       15, 14, 13, 12, 11, 10, 9, 8, 7, 6, 5, 4, 3, 2, 1, 0);
+    for (; n >= 32; n -= 32)
+    {
+        __m256i x = _mm256_loadu_si256((const __m256i *)a);
+        __m256i y = _mm256_loadu_si256((const __m256i *)(b - 32));
+        x = fold32(_mm256_permute4x64_epi64(_mm256_shuffle_epi8(x, m), 0x4e), lo);
+        y = fold32(_mm256_permute4x64_epi64(_mm256_shuffle_epi8(y, m), 0x4e), lo);
+        _mm256_storeu_si256((__m256i *)a, y);
+        _mm256_storeu_si256((__m256i *)(b - 32), x);
+        a += 32;
+        b -= 32;
+    }
+    _mm256_zeroupper();
+    swap_fold_ssse3(a, b, n, lo);
+}
+
+__attribute__((target("avx2"))) static void fold_avx2(char *s, size_t n, unsigned char lo)
+{
+    for (; n >= 32; n -= 32, s += 32)
+        _mm256_storeu_si256((__m256i *)s, fold32(_mm256_loadu_si256((const __m256i *)s), lo));
+    _mm256_zeroupper();
+    fold_ssse3(s, n, lo);
+}
+
+__attribute__((target("avx2"))) static void fix_avx2(unsigned char *s, size_t n)
+{
+    size_t i = 0;
+    while (i + 32 <= n)
+    {
+        size_t done;
+        if (!_mm256_movemask_epi8(_mm256_loadu_si256((const __m256i *)(s + i)))) // 32 байта ASCII
+            i += 32;
+        else if ((done = fix_block16(s, i)) != 0)
+            i += done;
+        else if (s[i] < 0x80)
+            i++;
+        else
+            i = fix_step(s, i, n);
+    }
+    _mm256_zeroupper();
+    fix_ssse3(s + i, n - i); // Хвост короче 32 байт
+}
+#endif
+
+static const struct kernel kernels[] = {
+#ifdef REVERSE_X86
+    {"avx2", swap_avx2, fix_avx2, swap_fold_avx2, fold_avx2},
+    {"ssse3", swap_ssse3, fix_ssse3, swap_fold_ssse3, fold_ssse3},
+#endif
+    {"scalar", swap_scalar, fix_scalar, swap_fold_scalar, fold_scalar},
+};
+
+static const struct kernel *active; // Выбранное ядро (NULL - ещё не выбрано)
+
+/* kernel_supported: поддерживает ли процессор инструкции ядра */
+static int kernel_supported(const struct kernel *k)
+{
+#ifdef REVERSE_X86
+    __builtin_cpu_init();
+    if (strcmp(k->name, "avx2") == 0)
+        return __builtin_cpu_supports("avx2");
+    if (strcmp(k->name, "ssse3") == 0)
+        return __builtin_cpu_supports("ssse3");
+#endif
+    (void)k;
+    return 1;
+}
+
+/* pick: первое (самое широкое) ядро, которое поддерживает процессор */
+static const struct kernel *pick(void)
+{
+    if (!active)
+    {
+        size_t i = 0;
+        while (!kernel_supported(&kernels[i])) // Скалярное ядро последнее и поддерживается всегда
+            i++;
+        active = &kernels[i];
+    }
+    return active;
+}
+
+void reverse_bytes(char *s, size_t n)
+{
+    pick()->swap(s, s + n, n / 2); // Пары с краёв к середине; средний байт нечётной длины на месте
+}
+
+void reverse_swap(char *a, char *b, size_t n, enum case_fold fold)
+{
+    if (fold == FOLD_NONE)
+        pick()->swap(a, b, n);
+    else
+        pick()->swap_fold(a, b, n, fold_lo(fold));
+}
+
+void fold_case(char *s, size_t n, enum case_fold fold)
+{
+    if (fold != FOLD_NONE)
+        pick()->fold(s, n, fold_lo(fold));
+}
+
+void reverse_fold(char *s, size_t n, int utf8, enum case_fold fold)
+{
+    const struct kernel *k = pick();
+    if (fold == FOLD_NONE)
+        k->swap(s, s + n, n / 2);
+    else
+    {
+        k->swap_fold(s, s + n, n / 2, fold_lo(fold)); // Регистр меняется при записи пар,
+        if (n & 1)
+            s[n / 2] = fold1(s[n / 2], fold_lo(fold)); // средний байт обмена не проходит
+    }
+    if (utf8) // Регистр меняется только в байтах ASCII, а их возврат символов не двигает
+        k->fix_utf8((unsigned char *)s, n);
+}
+
+void reverse_utf8(char *s, size_t n)
+{
+    const struct kernel *k = pick();
+    k->swap(s, s + n, n / 2); // Сначала разворачиваем байты,
+    k->fix_utf8((unsigned char *)s, n); // затем возвращаем порядок байтов внутри символов
+}
+
+void reverse_utf8_fix(char *s, size_t n)
+{
+    pick()->fix_utf8((unsigned char *)s, n);
+}
+
+size_t reverse_fix_cut(const char *s, size_t n, size_t p)
+{
+    const unsigned char *u = (const unsigned char *)s;
+    while (p > 0 && p < n && (u[p - 1] & 0xc0) == 0x80) // Серия продолжений заканчивается ведущим байтом
+        p++;
+    return p;
+}
+
+size_t reverse_utf8_cut(const char *s, size_t n, size_t p)
+{
+    const unsigned char *u = (const unsigned char *)s;
+    if (p >= n || (u[p] & 0xc0) != 0x80) // Перед не-продолжением символ не продолжается
+        return p;
+    size_t q = p;
+    while (q > 0 && p - q < 3 && (u[q - 1] & 0xc0) == 0x80) // Назад к ведущему байту
+        q--;
+    if (q == 0 || (u[q - 1] & 0xc0) == 0x80)
+        return p;
+    q--;
+    size_t need = utf8_seq_len(u[q]);
+    if (!need || q + need <= p) // Символ закончился до p (или это не ведущий байт)
+        return p;
+    for (size_t i = q + 1; i < q + need; ++i)
+        if (i >= n || (u[i] & 0xc0) != 0x80) // Оборванный символ разворачивается побайтно
+            return p;
+    return q + need; // Разрез - сразу за символом
+}
+
+const char *reverse_kernel(void)
+{
+    return pick()->name;
+}
+
+int reverse_set_kernel(const char *name)
+{
+    for (size_t i = 0; i < sizeof(kernels) / sizeof(kernels[0]); ++i)
+    {
+        if (strcmp(kernels[i].name, name) == 0 && kernel_supported(&kernels[i]))
+        {
+            active = &kernels[i];
+            return 0;
+        }
+    }
+    return -1;
+}
@@ -0,0 +1,61 @@
+#ifndef REVERSE_H
+#define REVERSE_H
+
+#include <stddef.h>
+
+/* Разворот строк. Ядро разворота байтов выбирается один раз при первом вызове по
+   возможностям процессора: AVX2 (32 байта за шаг), SSSE3 (16 байт), иначе скалярное
+   (8 байт за шаг через bswap). Все ядра дают одинаковый результат. */
+
+/* case_fold: смена регистра латиницы (A-Z, a-z); остальные байты, в том числе UTF-8, не меняются */
+enum case_fold
+{
+    FOLD_NONE,
+    FOLD_LOWER,
+    FOLD_UPPER,
+};
+
+/* reverse_bytes: разворачивает n байт s на месте */
+void reverse_bytes(char *s, size_t n);
+
+/* reverse_utf8: разворачивает n байт s на месте по символам UTF-8: многобайтные
+   последовательности остаются в исходном порядке байтов. Некорректные последовательности
+   (лишние байты продолжения, оборванный символ) разворачиваются побайтно. */
+void reverse_utf8(char *s, size_t n);
+
+/* reverse_fold: reverse_utf8 (utf8) или reverse_bytes, сменяющий регистр латиницы за тот же
+   проход по байтам (FOLD_NONE - просто разворот) */
+void reverse_fold(char *s, size_t n, int utf8, enum case_fold fold);
+
+/* fold_case: смена регистра латиницы в n байтах s на месте */
+void fold_case(char *s, size_t n, enum case_fold fold);
+
+/* reverse_swap: a[i] <-> b[-1 - i] для i < n - отрезки с краёв меняются местами развёрнутыми
+   (b указывает за конец правого отрезка, отрезки не пересекаются). reverse_bytes(s, n) -
+   это reverse_swap(s, s + n, n / 2, FOLD_NONE); пары [k, m) и их отражения можно обменивать
+   независимо. fold - регистр меняется в записываемых байтах (средний байт нечётной длины
+   обмен не затрагивает). */
+void reverse_swap(char *a, char *b, size_t n, enum case_fold fold);
+
+/* reverse_utf8_fix: второй проход reverse_utf8 - по уже развёрнутым байтам возвращает порядок
+   байтов внутри символов. Можно выполнять по кускам, разрезанным по reverse_fix_cut. */
+void reverse_utf8_fix(char *s, size_t n);
+
+/* reverse_fix_cut: ближайшая к p позиция не левее p, по которой развёрнутые байты s[0, n)
+   можно разрезать для reverse_utf8_fix (перед ней - не байт продолжения) */
+size_t reverse_fix_cut(const char *s, size_t n, size_t p);
+
+/* reverse_utf8_cut: ближайшая к p позиция не левее p (не дальше чем на 3 байта), по которой
+   s[0, n) можно разрезать так, что reverse_utf8 половин даёт то же, что и целой строки:
+   разрез не проходит внутри символа. s должна начинаться не позже чем за 3 байта до p
+   (или с начала строки). */
+size_t reverse_utf8_cut(const char *s, size_t n, size_t p);
+
+/* reverse_kernel: имя выбранного ядра ("avx2", "ssse3" или "scalar") */
+const char *reverse_kernel(void);
+
+/* reverse_set_kernel: принудительно выбирает ядро по имени (для сравнения ядер).
+   Возвращает 0 или -1, если ядро неизвестно или процессор его не поддерживает. */
+int reverse_set_kernel(const char *name);
+
+#endif
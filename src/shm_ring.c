@@ -0,0 +1,232 @@
+#define _GNU_SOURCE
+#include <unistd.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/eventfd.h>
+
+#include "shm_ring.h"
+#include "stats.h"
+
+#define RING_MIN_SIZE (64 * 1024) // Минимальный размер области данных
+
+/* rec_space: место, которое занимает запись длины len вместе с заголовком и выравниванием */
+static size_t rec_space(size_t len)
+{
+    return sizeof(struct ring_rec) + ((len + 7) & ~(size_t)7);
+}
+
+/* efd_signal: будит другую сторону через eventfd */
+static void efd_signal(int efd)
+{
+    uint64_t one = 1;
+    while (write(efd, &one, sizeof(one)) < 0 && errno == EINTR)
+        ;
+}
+
+int ring_create(struct shm_ring *r, size_t size)
+{
+    size_t sz = RING_MIN_SIZE;
+    while (sz < size) // Округляем до степени двойки: смещение = позиция & (size - 1)
+        sz <<= 1;
+    memset(r, 0, sizeof(*r));
+    r->memfd = r->data_efd = r->space_efd = -1;
+    r->map_len = sizeof(struct ring_hdr) + sz;
+
+    r->memfd = memfd_create("worker-ring", MFD_CLOEXEC); // Анонимный файл в памяти
+    if (r->memfd < 0 || ftruncate(r->memfd, (off_t)r->map_len) < 0)
+        goto fail;
+    r->h = mmap(NULL, r->map_len, PROT_READ | PROT_WRITE, MAP_SHARED, r->memfd, 0);
+    if (r->h == MAP_FAILED)
+    {
+        r->h = NULL;
+        goto fail;
+    }
+    r->data_efd = eventfd(0, EFD_CLOEXEC);                 // Читатель блокируется на нём в read()
+    r->space_efd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK); // Писатель ждёт его через epoll
+    if (r->data_efd < 0 || r->space_efd < 0)
+        goto fail;
+
+    r->h->magic = RING_MAGIC;
+    r->h->size = sz;
+    atomic_init(&r->h->head, 0);
+    atomic_init(&r->h->tail, 0);
+    atomic_init(&r->h->closed, 0);
+    atomic_init(&r->h->cons_waiting, 0);
+    atomic_init(&r->h->prod_waiting, 0);
+    return 0;
+fail:
+    ring_destroy(r);
+    return -1;
+}
+
+int ring_attach(struct shm_ring *r, int memfd, int data_efd, int space_efd)
+{
+    struct stat st;
+    memset(r, 0, sizeof(*r));
+    r->memfd = memfd;
+    r->data_efd = data_efd;
+    r->space_efd = space_efd;
+    if (fstat(memfd, &st) < 0 || (size_t)st.st_size < sizeof(struct ring_hdr))
+        return -1;
+    r->map_len = (size_t)st.st_size;
+    r->h = mmap(NULL, r->map_len, PROT_READ | PROT_WRITE, MAP_SHARED, memfd, 0);
+    if (r->h == MAP_FAILED)
+    {
+        r->h = NULL;
+        return -1;
+    }
+    if (r->h->magic != RING_MAGIC || sizeof(struct ring_hdr) + r->h->size != r->map_len)
+    {
+        errno = EPROTO;
+        return -1;
+    }
+    return 0;
+}
+
+void ring_destroy(struct shm_ring *r)
+{
+    if (r->h)
+        munmap(r->h, r->map_len);
+    if (r->memfd >= 0)
+        close(r->memfd);
+    if (r->data_efd >= 0)
+        close(r->data_efd);
+    if (r->space_efd >= 0)
+        close(r->space_efd);
+    memset(r, 0, sizeof(*r));
+    r->memfd = r->data_efd = r->space_efd = -1;
+}
+
+/* ring_put_one: кладёт одну запись, если для неё (и, возможно, метки WRAP) хватает места.
+   Возвращает 1 - положена, 0 - места нет. */
+static int ring_put_one(struct shm_ring *r, const char *p, size_t n, uint32_t flags)
+{
+    struct ring_hdr *h = r->h;
+    uint64_t head = atomic_load_explicit(&h->head, memory_order_relaxed); // head меняем только мы
+    uint64_t tail = atomic_load(&h->tail);
+    size_t free_bytes = h->size - (size_t)(head - tail);
+    size_t off = (size_t)head & (h->size - 1);
+    size_t need = rec_space(n);
+    size_t contig = h->size - off; // Место до конца области
+    if ((need > contig ? contig + need : need) > free_bytes)
+        return 0;
+    if (need > contig) // Не помещается в хвост - метка WRAP и запись с начала области
+    {
+        struct ring_rec *wrap = (struct ring_rec *)(h->data + off);
+        wrap->len = 0;
+        wrap->flags = RING_WRAP;
+        head += contig;
+        off = 0;
+    }
+    struct ring_rec *rec = (struct ring_rec *)(h->data + off);
+    rec->len = (uint32_t)n;
+    rec->flags = flags;
+    memcpy(h->data + off + sizeof(*rec), p, n); // Единственное копирование строки
+    atomic_store(&h->head, head + need);         // Публикуем запись
+    /* Будим читателя, только если он уснул на пустом кольце */
+    if (atomic_load(&h->cons_waiting) && atomic_exchange(&h->cons_waiting, 0))
+        efd_signal(r->data_efd);
+    return 1;
+}
+
+ssize_t ring_put(struct shm_ring *r, const char *rec, size_t len, int more)
+{
+    size_t piece_max = r->h->size / 4 - sizeof(struct ring_rec); // Предел куска длинной строки
+    size_t done = 0;
+    int retried = 0;
+    while (done < len)
+    {
+        size_t piece = len - done;
+        uint32_t flags = more ? RING_MORE : 0;
+        if (piece > piece_max) // Длинная строка - кусками, читатель соберёт её обратно
+        {
+            piece = piece_max;
+            flags = RING_MORE;
+        }
+        if (ring_put_one(r, rec + done, piece, flags))
+        {
+            done += piece;
+            continue;
+        }
+        if (retried) // Места нет и после подписки - ждём читателя
+            break;
+        /* Подписываемся на освобождение места и перепроверяем, чтобы не пропустить сигнал */
+        atomic_store(&r->h->prod_waiting, 1);
+        retried = 1;
+    }
+    if (done == len && retried)
+        atomic_store(&r->h->prod_waiting, 0);
+    return (ssize_t)done;
+}
+
+void ring_close(struct shm_ring *r)
+{
+    atomic_store(&r->h->closed, 1);
+    if (atomic_exchange(&r->h->cons_waiting, 0)) // Читатель спит - будим, чтобы увидел конец
+        efd_signal(r->data_efd);
+}
+
+void ring_ack(struct shm_ring *r)
+{
+    uint64_t v;
+    while (read(r->space_efd, &v, sizeof(v)) < 0 && errno == EINTR)
+        ;
+}
+
+/* ring_advance: читатель освобождает n байт и будит писателя, если тот ждёт места */
+static void ring_advance(struct shm_ring *r, uint64_t *tail, uint64_t n)
+{
+    *tail += n;
+    atomic_store(&r->h->tail, *tail);
+    if (atomic_load(&r->h->prod_waiting) && atomic_exchange(&r->h->prod_waiting, 0))
+        efd_signal(r->space_efd);
+}
+
+ssize_t ring_next(struct shm_ring *r, char **rec)
+{
+    struct ring_hdr *h = r->h;
+    uint64_t tail = atomic_load_explicit(&h->tail, memory_order_relaxed); // tail меняем только мы
+    if (r->release) // Предыдущая запись обработана - освобождаем её место
+    {
+        ring_advance(r, &tail, r->release);
+        r->release = 0;
+    }
+    while (1)
+    {
+        uint64_t head = atomic_load(&h->head);
+        if (head == tail) // Кольцо пусто
+        {
+            if (atomic_load(&h->closed) && atomic_load(&h->head) == tail) // И писатель закончил
+            {
+                *rec = NULL;
+                r->more = 0;
+                return 0;
+            }
+            /* Засыпаем: сначала флаг, затем перепроверка, чтобы не пропустить запись */
+            atomic_store(&h->cons_waiting, 1);
+            if (atomic_load(&h->head) != tail || atomic_load(&h->closed))
+            {
+                atomic_store(&h->cons_waiting, 0);
+                continue;
+            }
+            uint64_t v;
+            if (st_read(r->data_efd, &v, sizeof(v)) < 0 && errno != EINTR) // Ожидание записей
+                return -1;
+            continue;
+        }
+        size_t off = (size_t)tail & (h->size - 1);
+        struct ring_rec *rr = (struct ring_rec *)(h->data + off);
+        if (rr->flags & RING_WRAP) // Остаток области пуст - переходим в начало
+        {
+            ring_advance(r, &tail, h->size - off);
+            continue;
+        }
+        *rec = h->data + off + sizeof(*rr); // Строка обрабатывается прямо в разделяемой памяти
+        r->more = (rr->flags & RING_MORE) != 0;
+        r->release = rec_space(rr->len);
+        return (ssize_t)rr->len;
+    }
+}
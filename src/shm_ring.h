@@ -0,0 +1,100 @@
+#ifndef SHM_RING_H
+#define SHM_RING_H
+
+#include <sys/types.h>
+#include <stdint.h>
+#include <stddef.h>
+#include <stdatomic.h>
+
+/* Кольцевой буфер с одним писателем и одним читателем (SPSC) в разделяемой памяти (memfd).
+   Записи: заголовок struct ring_rec и данные, выровненные на 8 байт. Запись никогда не
+   переходит через конец области: если она не помещается в хвост, писатель ставит метку
+   RING_WRAP и продолжает с начала. Читатель обрабатывает запись прямо в разделяемой памяти.
+   Пробуждение через eventfd - только на переходах "пусто" (для читателя) и "полно" (для писателя). */
+
+#define RING_MAGIC 0x474e4952u // "RING"
+#define RING_WRAP 0x1u         // Метка: остаток области пуст, следующая запись - с начала
+#define RING_MORE 0x2u         // Запись - не последний кусок строки (строка больше четверти кольца или кусок от писателя)
+
+struct ring_rec
+{
+    uint32_t len;   // Длина данных записи
+    uint32_t flags; // RING_WRAP / RING_MORE
+};
+
+/* ring_hdr: управляющая часть в начале разделяемой памяти.
+   Позиции head/tail монотонно растут; смещение в области - позиция & (size - 1). */
+struct ring_hdr
+{
+    uint32_t magic; // RING_MAGIC
+    uint32_t pad;
+    uint64_t size;                          // Размер области данных (степень двойки)
+    _Alignas(64) _Atomic uint64_t head;     // Позиция записи (меняет только писатель)
+    _Atomic uint32_t closed;                // Писатель закончил работу
+    _Atomic uint32_t cons_waiting;          // Читатель спит на data_efd
+    _Alignas(64) _Atomic uint64_t tail;     // Позиция чтения (меняет только читатель)
+    _Atomic uint32_t prod_waiting;          // Писатель ждёт места (space_efd)
+    _Alignas(64) char data[];               // Область данных
+};
+
+/* shm_ring: отображение кольца и его eventfd в одном процессе */
+struct shm_ring
+{
+    struct ring_hdr *h; // Отображённая разделяемая память
+    size_t map_len;     // Длина отображения
+    int memfd;          // memfd с кольцом
+    int data_efd;       // eventfd: писатель -> читатель ("появились данные")
+    int space_efd;      // eventfd: читатель -> писатель ("появилось место")
+    uint64_t release;   // Читатель: размер последней выданной записи (освобождается при следующем чтении)
+    int more;           // Читатель: последняя выданная запись - кусок строки (RING_MORE)
+};
+
+/* ring_create: создаёт кольцо с областью не меньше size байт (округляется до степени двойки)
+   и eventfd-ы. Дескрипторы создаются с O_CLOEXEC. Возвращает 0 или -1. */
+int ring_create(struct shm_ring *r, size_t size);
+
+/* ring_attach: отображает кольцо по дескрипторам, полученным от родителя. 0 или -1. */
+int ring_attach(struct shm_ring *r, int memfd, int data_efd, int space_efd);
+
+/* ring_destroy: снимает отображение и закрывает дескрипторы */
+void ring_destroy(struct shm_ring *r);
+
+/* ring_put: писатель. Кладёт строку целиком; строку больше четверти кольца - кусками,
+   сколько поместится. more - запись сама кусок строки: последний кусок тоже помечается
+   RING_MORE. Возвращает число принятых байт (0 - места нет, писатель подписан на space_efd)
+   или -1 при ошибке. */
+ssize_t ring_put(struct shm_ring *r, const char *rec, size_t len, int more);
+
+/* ring_close: писатель. Сообщает читателю, что данных больше не будет. */
+void ring_close(struct shm_ring *r);
+
+/* ring_used: занято байт в кольце */
+static inline size_t ring_used(const struct shm_ring *r)
+{
+    return (size_t)(atomic_load_explicit(&r->h->head, memory_order_relaxed) -
+                    atomic_load_explicit(&r->h->tail, memory_order_relaxed));
+}
+
+/* ring_waiting: писатель ждёт освобождения места */
+static inline int ring_waiting(const struct shm_ring *r)
+{
+    return atomic_load(&r->h->prod_waiting) != 0;
+}
+
+/* ring_ack: писатель. Сбрасывает сработавший space_efd. */
+void ring_ack(struct shm_ring *r);
+
+/* ring_ready: читатель. В кольце есть данные после текущей записи - ring_next не заснёт. */
+static inline int ring_ready(const struct shm_ring *r)
+{
+    return atomic_load(&r->h->head) !=
+           atomic_load_explicit(&r->h->tail, memory_order_relaxed) + r->release;
+}
+
+/* ring_next: читатель. Выдаёт следующую запись (указатель в разделяемую память; можно менять
+   на месте до следующего вызова); r->more = 1 - это кусок строки, следующая запись её
+   продолжает (куски собирает вызывающий). Блокируется, пока кольцо пусто.
+   Возвращает длину, 0 после ring_close и опустошения кольца, -1 при ошибке. */
+ssize_t ring_next(struct shm_ring *r, char **rec);
+
+#endif
@@ -0,0 +1,169 @@
+#define _GNU_SOURCE
+#include <unistd.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+
+#include "spill.h"
+#include "reverse.h"
+#include "stats.h"
+
+void sp_init(struct spill *sp, size_t limit)
+{
+    memset(sp, 0, sizeof(*sp));
+    sp->limit = limit ? limit : SPILL_DEFAULT_LIMIT;
+    sp->fd = -1;
+    sp->st_write = st_entry("spill.write");
+    sp->st_read = st_entry("spill.read");
+}
+
+/* sp_reserve: буфер не меньше need байт (удвоением). 0 или -1. */
+static int sp_reserve(struct spill *sp, size_t need)
+{
+    if (need <= sp->cap)
+        return 0;
+    size_t ncap = sp->cap ? sp->cap : 64 * 1024;
+    while (ncap < need)
+        ncap *= 2;
+    char *nb = realloc(sp->buf, ncap);
+    if (!nb)
+        return -1;
+    sp->buf = nb;
+    sp->cap = ncap;
+    return 0;
+}
+
+/* open_tmp: безымянный временный файл в $TMPDIR или /tmp */
+static int open_tmp(void)
+{
+    const char *dir = getenv("TMPDIR");
+    if (!dir || !*dir)
+        dir = "/tmp";
+    int fd = open(dir, O_TMPFILE | O_RDWR | O_CLOEXEC, 0600);
+    if (fd >= 0 || (errno != EOPNOTSUPP && errno != EISDIR && errno != EINVAL))
+        return fd;
+    char path[PATH_MAX]; // ФС без O_TMPFILE - обычный файл, удалённый сразу после создания
+    snprintf(path, sizeof(path), "%s/reverse-spill-XXXXXX", dir);
+    fd = mkostemp(path, O_CLOEXEC);
+    if (fd >= 0)
+        unlink(path);
+    return fd;
+}
+
+/* put: дописывает n байт в конец файла */
+static int put(struct spill *sp, const char *p, size_t n)
+{
+    while (n > 0)
+    {
+        uint64_t t0 = st_now();
+        ssize_t w = pwrite(sp->fd, p, n, (off_t)sp->file_len);
+        st_account(sp->st_write, t0, w);
+        if (w < 0 && errno == EINTR)
+            continue;
+        if (w <= 0)
+            return -1;
+        p += w;
+        n -= (size_t)w;
+        sp->file_len += (uint64_t)w;
+    }
+    return 0;
+}
+
+int sp_add(struct spill *sp, const char *p, size_t n)
+{
+    if (n == 0)
+        return 0;
+    sp->last_nl = p[n - 1] == '\n';
+    if (sp->fd < 0 && sp->len + n <= sp->limit) // Пока в пределе - в памяти
+    {
+        if (sp_reserve(sp, sp->len + n) < 0)
+            return -1;
+        memcpy(sp->buf + sp->len, p, n);
+        sp->len += n;
+        return 0;
+    }
+    if (sp->fd < 0) // Предел превышен - собранное уходит в файл, дальше куски пишутся туда
+    {
+        if ((sp->fd = open_tmp()) < 0)
+            return -1;
+        sp->file_len = 0;
+        if (put(sp, sp->buf, sp->len) < 0)
+            return -1;
+        sp->len = 0;
+    }
+    return put(sp, p, n);
+}
+
+size_t sp_take(struct spill *sp, char **line)
+{
+    size_t n = sp->len;
+    *line = sp->buf;
+    sp->len = 0;
+    return n;
+}
+
+/* get: читает n байт файла со смещения off в буфер */
+static int get(struct spill *sp, char *p, size_t n, uint64_t off)
+{
+    while (n > 0)
+    {
+        uint64_t t0 = st_now();
+        ssize_t r = pread(sp->fd, p, n, (off_t)off);
+        st_account(sp->st_read, t0, r);
+        if (r < 0 && errno == EINTR)
+            continue;
+        if (r <= 0)
+            return -1;
+        p += r;
+        n -= (size_t)r;
+        off += (uint64_t)r;
+    }
+    return 0;
+}
+
+int sp_emit(struct spill *sp, int utf8, enum case_fold fold, void (*emit)(void *arg, const char *p, size_t n),
+            void *arg)
+{
+    int rc = 0;
+    uint64_t pos = sp->file_len - (sp->last_nl ? 1 : 0); // '\n' не разворачивается
+    if (sp_reserve(sp, SPILL_SEG + 3) < 0)
+        rc = -1;
+    while (rc == 0 && pos > 0)
+    {
+        /* Отрезок [start, pos); для UTF-8 - ещё до 3 байт перед ним (сколько есть), чтобы не
+           разрезать символ */
+        uint64_t start = pos > SPILL_SEG ? pos - SPILL_SEG : 0;
+        uint64_t from = utf8 ? (start >= 3 ? start - 3 : 0) : start;
+        size_t n = (size_t)(pos - from);
+        if (get(sp, sp->buf, n, from) < 0)
+        {
+            rc = -1;
+            break;
+        }
+        size_t cut = (size_t)(start - from);
+        if (utf8)
+            cut = reverse_utf8_cut(sp->buf, n, cut);
+        reverse_fold(sp->buf + cut, n - cut, utf8, fold);
+        emit(arg, sp->buf + cut, n - cut);
+        pos = from + cut;
+    }
+    if (rc == 0 && sp->last_nl)
+        emit(arg, "\n", 1);
+    close(sp->fd);
+    sp->fd = -1;
+    sp->file_len = 0;
+    return rc;
+}
+
+void sp_free(struct spill *sp)
+{
+    free(sp->buf);
+    sp->buf = NULL;
+    sp->cap = sp->len = 0;
+    if (sp->fd >= 0)
+        close(sp->fd);
+    sp->fd = -1;
+}
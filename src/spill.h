@@ -0,0 +1,71 @@
+#ifndef SPILL_H
+#define SPILL_H
+
+#include <sys/types.h>
+#include <stdint.h>
+#include <stddef.h>
+
+#include "reverse.h"
+
+/* Сборка длинной строки из кусков (src_more, см. transport.h). Пока строка не длиннее
+   предела, она собирается в памяти и дальше обрабатывается как обычная. Длиннее - собранное
+   и следующие куски дописываются во временный файл (O_TMPFILE в $TMPDIR или /tmp - без имени,
+   исчезает сам), а развёрнутая строка выдаётся отрезками по SPILL_SEG байт: файл читается
+   с конца, каждый отрезок разворачивается в буфере. Память обработчика - не больше предела
+   и одного отрезка при любой длине строки. */
+
+#define SPILL_SEG (1024 * 1024)                 // Отрезок чтения строки из файла
+#define SPILL_DEFAULT_LIMIT (64u * 1024 * 1024) // Предел сборки в памяти по умолчанию
+
+/* spill: собираемая строка */
+struct spill
+{
+    size_t limit;      // Предел сборки в памяти
+    char *buf;         // Собранная строка (до limit), после сброса в файл - отрезок
+    size_t len;        // Собрано в памяти
+    size_t cap;        // Ёмкость buf
+    int fd;            // Временный файл (-1 - строка в памяти)
+    uint64_t file_len; // Записано в файл
+    int last_nl;       // Последний кусок закончился '\n'
+    int st_write;      // Записи статистики: запись и чтение временного файла (stats.h)
+    int st_read;
+};
+
+/* sp_init: limit - предел сборки в памяти (0 - по умолчанию) */
+void sp_init(struct spill *sp, size_t limit);
+
+/* sp_active: строка собирается (пришёл хотя бы один кусок) */
+static inline int sp_active(const struct spill *sp)
+{
+    return sp->len > 0 || sp->fd >= 0;
+}
+
+/* sp_add: дописывает кусок. 0 или -1 (нехватка памяти, временный файл недоступен). */
+int sp_add(struct spill *sp, const char *p, size_t n);
+
+/* sp_spilled: строка в файле - выдавать через sp_emit */
+static inline int sp_spilled(const struct spill *sp)
+{
+    return sp->fd >= 0;
+}
+
+/* sp_length: длина собранной строки */
+static inline uint64_t sp_length(const struct spill *sp)
+{
+    return sp->fd >= 0 ? sp->file_len : sp->len;
+}
+
+/* sp_take: строка собрана в памяти - выдаёт её (изменяемую, до следующего sp_add) и длину;
+   следующий кусок начнёт новую строку */
+size_t sp_take(struct spill *sp, char **line);
+
+/* sp_emit: строка в файле - выдаёт её развёрнутой (utf8 - по символам, fold - со сменой
+   регистра, '\n' в конце остаётся последним) отрезками в порядке вывода через
+   emit(arg, отрезок, длина) и закрывает файл. 0 или -1 при ошибке чтения. */
+int sp_emit(struct spill *sp, int utf8, enum case_fold fold, void (*emit)(void *arg, const char *p, size_t n),
+            void *arg);
+
+/* sp_free: освобождает буфер и закрывает файл */
+void sp_free(struct spill *sp);
+
+#endif
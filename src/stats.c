@@ -0,0 +1,370 @@
+#define _GNU_SOURCE
+#include <unistd.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <signal.h>
+#include <time.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/resource.h>
+
+#include "stats.h"
+
+static struct stats local;     // Своя память, пока нет слота в общей
+__thread struct stats *st_self = &local;
+
+static __thread int16_t watch[2][ST_MAX_FD]; // Номер записи + 1 для fd в каждом направлении (0 - не учитывается)
+
+void st_init(const char *name, struct stats *slot)
+{
+    st_self = slot ? slot : &local;
+    memset(st_self, 0, sizeof(*st_self));
+    st_self->pid = (int32_t)getpid();
+    strncpy(st_self->name, name, sizeof(st_self->name) - 1);
+    memset(watch, 0, sizeof(watch));
+}
+
+void st_place(const char *cpus, int node)
+{
+    strncpy(st_self->cpus, cpus, sizeof(st_self->cpus) - 1);
+    st_self->node = node;
+}
+
+struct stats *st_shared(int n, int *memfd)
+{
+    size_t len = (size_t)n * sizeof(struct stats);
+    int fd = memfd_create("worker-stats", MFD_CLOEXEC);
+    if (fd < 0)
+        return NULL;
+    if (ftruncate(fd, (off_t)len) < 0) // Слоты заполнены нулями
+    {
+        close(fd);
+        return NULL;
+    }
+    void *p = mmap(NULL, len, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (p == MAP_FAILED)
+    {
+        close(fd);
+        return NULL;
+    }
+    *memfd = fd;
+    return p;
+}
+
+struct stats *st_attach(const char *spec)
+{
+    char *end;
+    int fd = (int)strtol(spec, &end, 10);
+    if (*end != ':')
+        return NULL;
+    long slot = strtol(end + 1, &end, 10);
+    struct stat sb;
+    if (*end != '\0' || slot < 0 || fstat(fd, &sb) < 0 ||
+        (size_t)sb.st_size < (size_t)(slot + 1) * sizeof(struct stats))
+        return NULL;
+    void *p = mmap(NULL, (size_t)sb.st_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd); // Отображению дескриптор не нужен
+    if (p == MAP_FAILED)
+        return NULL;
+    return (struct stats *)p + slot;
+}
+
+int st_entry(const char *name)
+{
+    for (uint32_t i = 0; i < st_self->nio; ++i) // Одно имя - одна запись (stdout из разных мест)
+        if (strcmp(st_self->io[i].name, name) == 0)
+            return (int)i;
+    if (st_self->nio == ST_MAX_IO)
+        return -1;
+    struct st_io *e = &st_self->io[st_self->nio];
+    strncpy(e->name, name, sizeof(e->name) - 1);
+    return (int)st_self->nio++;
+}
+
+void st_watch(int fd, enum st_dir dir, const char *name)
+{
+    if (fd < 0 || fd >= ST_MAX_FD)
+        return;
+    watch[dir][fd] = (int16_t)(st_entry(name) + 1);
+}
+
+void st_unwatch(int fd)
+{
+    if (fd < 0 || fd >= ST_MAX_FD)
+        return;
+    watch[ST_RD][fd] = watch[ST_WR][fd] = 0;
+}
+
+uint64_t st_now(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+}
+
+void st_account(int e, uint64_t t0, ssize_t r)
+{
+    if (e < 0)
+        return;
+    int saved = errno;
+    struct st_io *io = &st_self->io[e];
+    io->calls++;
+    io->ns += st_now() - t0;
+    if (r > 0)
+        io->bytes += (uint64_t)r;
+    else if (r < 0 && (saved == EAGAIN || saved == EWOULDBLOCK))
+        io->again++;
+    errno = saved;
+}
+
+/* watched: запись для fd в направлении dir (-1 - не учитывается) */
+static int watched(int fd, enum st_dir dir)
+{
+    return fd >= 0 && fd < ST_MAX_FD ? watch[dir][fd] - 1 : -1;
+}
+
+ssize_t st_read(int fd, void *buf, size_t n)
+{
+    int e = watched(fd, ST_RD);
+    if (e < 0)
+        return read(fd, buf, n);
+    uint64_t t0 = st_now();
+    ssize_t r = read(fd, buf, n);
+    st_account(e, t0, r);
+    return r;
+}
+
+ssize_t st_write(int fd, const void *buf, size_t n)
+{
+    int e = watched(fd, ST_WR);
+    if (e < 0)
+        return write(fd, buf, n);
+    uint64_t t0 = st_now();
+    ssize_t r = write(fd, buf, n);
+    st_account(e, t0, r);
+    return r;
+}
+
+ssize_t st_writev(int fd, const struct iovec *iov, int cnt)
+{
+    int e = watched(fd, ST_WR);
+    if (e < 0)
+        return writev(fd, iov, cnt);
+    uint64_t t0 = st_now();
+    ssize_t r = writev(fd, iov, cnt);
+    st_account(e, t0, r);
+    return r;
+}
+
+void st_cpu(void)
+{
+    struct rusage ru;
+    if (getrusage(RUSAGE_THREAD, &ru) < 0)
+        return;
+    st_self->user_ns = (uint64_t)ru.ru_utime.tv_sec * 1000000000ull + (uint64_t)ru.ru_utime.tv_usec * 1000ull;
+    st_self->sys_ns = (uint64_t)ru.ru_stime.tv_sec * 1000000000ull + (uint64_t)ru.ru_stime.tv_usec * 1000ull;
+}
+
+/* jbuf: буфер вывода JSON (статический: snprintf и malloc в обработчике сигнала нельзя) */
+struct jbuf
+{
+    int fd;
+    size_t len;
+    char buf[16384];
+};
+
+static void jb_flush(struct jbuf *b)
+{
+    size_t off = 0;
+    while (off < b->len)
+    {
+        ssize_t w = write(b->fd, b->buf + off, b->len - off);
+        if (w < 0 && errno == EINTR)
+            continue;
+        if (w <= 0)
+            break; // Отчёт некуда писать - теряем его, но не зависаем
+        off += (size_t)w;
+    }
+    b->len = 0;
+}
+
+static void jb_put(struct jbuf *b, const char *s)
+{
+    for (; *s; ++s)
+    {
+        if (b->len == sizeof(b->buf))
+            jb_flush(b);
+        b->buf[b->len++] = *s;
+    }
+}
+
+static void jb_u64(struct jbuf *b, uint64_t v)
+{
+    char num[24];
+    int i = (int)sizeof(num) - 1;
+    num[i] = '\0';
+    do
+        num[--i] = (char)('0' + v % 10);
+    while ((v /= 10) != 0);
+    jb_put(b, num + i);
+}
+
+/* jb_field: ", "key": value" (first - без запятой) */
+static void jb_field(struct jbuf *b, const char *key, uint64_t v, int first)
+{
+    jb_put(b, first ? "\"" : ", \"");
+    jb_put(b, key);
+    jb_put(b, "\": ");
+    jb_u64(b, v);
+}
+
+/* jb_counts: строки, байты, время процессора, гистограмма (без хвоста из нулей) и записи */
+static void jb_counts(struct jbuf *b, const struct stats *s)
+{
+    jb_field(b, "lines", s->lines, 0);
+    jb_field(b, "bytes", s->bytes, 0);
+    jb_field(b, "cpu_user_ns", s->user_ns, 0);
+    jb_field(b, "cpu_sys_ns", s->sys_ns, 0);
+    int top = ST_HIST;
+    while (top > 0 && s->hist[top - 1] == 0)
+        top--;
+    jb_put(b, ", \"len_log2_hist\": [");
+    for (int k = 0; k < top; ++k)
+    {
+        if (k)
+            jb_put(b, ", ");
+        jb_u64(b, s->hist[k]);
+    }
+    jb_put(b, "], \"io\": {");
+    uint32_t nio = s->nio < ST_MAX_IO ? s->nio : ST_MAX_IO;
+    for (uint32_t i = 0; i < nio; ++i)
+    {
+        const struct st_io *e = &s->io[i];
+        char name[ST_NAME];
+        memcpy(name, e->name, sizeof(name));
+        name[ST_NAME - 1] = '\0'; // Чужой слот мог быть испорчен
+        jb_put(b, i ? ", \"" : "\"");
+        jb_put(b, name);
+        jb_put(b, "\": {");
+        jb_field(b, "calls", e->calls, 1);
+        jb_field(b, "bytes", e->bytes, 0);
+        jb_field(b, "ns", e->ns, 0);
+        jb_field(b, "again", e->again, 0);
+        jb_put(b, "}");
+    }
+    jb_put(b, "}");
+}
+
+static void jb_process(struct jbuf *b, const struct stats *s)
+{
+    char name[sizeof(s->name)];
+    memcpy(name, s->name, sizeof(name));
+    name[sizeof(name) - 1] = '\0';
+    jb_put(b, "{\"name\": \"");
+    jb_put(b, name);
+    jb_put(b, "\"");
+    jb_field(b, "pid", (uint64_t)(s->pid > 0 ? s->pid : 0), 0);
+    if (s->cpus[0]) // Размещение (--placement)
+    {
+        char cpus[ST_CPUS];
+        memcpy(cpus, s->cpus, sizeof(cpus));
+        cpus[ST_CPUS - 1] = '\0';
+        jb_put(b, ", \"cpus\": \"");
+        jb_put(b, cpus);
+        jb_put(b, "\"");
+        if (s->node >= 0)
+            jb_field(b, "node", (uint64_t)s->node, 0);
+    }
+    jb_counts(b, s);
+    jb_put(b, "}");
+}
+
+/* add_io: прибавляет запись к итогу (записи с одинаковым именем складываются) */
+static void add_io(struct stats *t, const struct st_io *e)
+{
+    uint32_t i = 0;
+    while (i < t->nio && strncmp(t->io[i].name, e->name, ST_NAME) != 0)
+        i++;
+    if (i == t->nio)
+    {
+        if (t->nio == ST_MAX_IO)
+            return;
+        memcpy(t->io[i].name, e->name, ST_NAME);
+        t->io[i].name[ST_NAME - 1] = '\0';
+        t->nio++;
+    }
+    t->io[i].calls += e->calls;
+    t->io[i].bytes += e->bytes;
+    t->io[i].ns += e->ns;
+    t->io[i].again += e->again;
+}
+
+static struct jbuf out;     // Вывод и итог статические: в обработчике сигнала - без malloc,
+static struct stats total;  // а повторный вход исключает маска SIGUSR1 (см. st_block)
+
+void st_dump(int fd, const struct stats *s, int n)
+{
+    out.fd = fd;
+    out.len = 0;
+    if (n == 1)
+        jb_process(&out, s);
+    else
+    {
+        memset(&total, 0, sizeof(total));
+        jb_put(&out, "{\"processes\": [");
+        for (int i = 0; i < n; ++i)
+        {
+            if (i)
+                jb_put(&out, ", ");
+            jb_process(&out, &s[i]);
+            if (i == 0) // Итог - только по обработчикам
+                continue;
+            total.lines += s[i].lines;
+            total.bytes += s[i].bytes;
+            total.user_ns += s[i].user_ns;
+            total.sys_ns += s[i].sys_ns;
+            for (int k = 0; k < ST_HIST; ++k)
+                total.hist[k] += s[i].hist[k];
+            uint32_t nio = s[i].nio < ST_MAX_IO ? s[i].nio : ST_MAX_IO;
+            for (uint32_t k = 0; k < nio; ++k)
+                add_io(&total, &s[i].io[k]);
+        }
+        jb_put(&out, "], \"workers_total\": {\"workers\": ");
+        jb_u64(&out, (uint64_t)(n - 1));
+        jb_counts(&out, &total);
+        jb_put(&out, "}}");
+    }
+    jb_put(&out, "\n");
+    jb_flush(&out);
+}
+
+static void (*on_dump)(void); // Что делать по SIGUSR1
+
+static void on_usr1(int sig)
+{
+    (void)sig;
+    int saved = errno;
+    if (on_dump)
+        on_dump();
+    errno = saved;
+}
+
+void st_on_signal(void (*dump)(void))
+{
+    on_dump = dump;
+    struct sigaction sa;
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_handler = on_usr1;
+    sa.sa_flags = SA_RESTART;
+    sigemptyset(&sa.sa_mask);
+    sigaction(SIGUSR1, &sa, NULL);
+}
+
+void st_block(int block)
+{
+    sigset_t set;
+    sigemptyset(&set);
+    sigaddset(&set, SIGUSR1);
+    sigprocmask(block ? SIG_BLOCK : SIG_UNBLOCK, &set, NULL);
+}
@@ -0,0 +1,124 @@
+#ifndef STATS_H
+#define STATS_H
+
+#include <sys/types.h>
+#include <sys/uio.h>
+#include <stdint.h>
+#include <stddef.h>
+
+/* Статистика процесса: строки, байты, гистограмма длин строк, время процессора и по каждому
+   отслеживаемому дескриптору - вызовы, байты и время в системных вызовах (для блокирующих
+   дескрипторов это время ожидания). Плюс именованные ожидания (epoll, io_uring).
+   Счётчики ведутся всегда: на строку - три сложения, на системный вызов - два clock_gettime
+   (vDSO, без входа в ядро). Вывод - JSON: по SIGUSR1 и, если попросили, при выходе.
+   Родитель создаёт общую память со слотом на каждый процесс (st_shared), обработчики пишут
+   счётчики прямо в свой слот - родитель видит их без обмена сообщениями и собирает один отчёт.
+   Пока процессы работают, значения чужого слота читаются без синхронизации и приблизительны. */
+
+#define ST_HIST 33    // Гистограмма длин: hist[0] - пустые, hist[k] - [2^(k-1), 2^k), последняя - всё длиннее
+#define ST_MAX_IO 136 // Записей на процесс: stdin, stdout, по два канала на обработчика, ожидания
+#define ST_NAME 24    // Длина имени записи вместе с '\0'
+#define ST_MAX_FD 1024 // Отслеживаются дескрипторы меньше этого
+#define ST_CPUS 64     // Список процессоров процесса (--placement) вместе с '\0'
+
+/* st_io: дескриптор в одном направлении или именованное ожидание */
+struct st_io
+{
+    char name[ST_NAME];
+    uint64_t calls;  // Системных вызовов (ожиданий)
+    uint64_t bytes;  // Передано байт
+    uint64_t ns;     // Время в вызовах
+    uint64_t again;  // Неблокирующий вызов вернул EAGAIN (канал заполнен или пуст)
+};
+
+/* stats: счётчики одного процесса (своя память или слот в общей) */
+struct stats
+{
+    int32_t pid;
+    char name[16];            // "parent", "child1", ...
+    uint64_t lines;           // Обработано строк
+    uint64_t bytes;           // Байт в них
+    uint64_t hist[ST_HIST];   // Длины строк (вместе с '\n')
+    uint64_t user_ns, sys_ns; // Время процессора (на момент st_cpu)
+    char cpus[ST_CPUS];       // Процессоры размещения ("" - не размещён, см. topology.h)
+    int32_t node;             // Их узел NUMA (-1 - не один или неизвестен)
+    uint32_t nio;
+    struct st_io io[ST_MAX_IO];
+};
+
+enum st_dir
+{
+    ST_RD,
+    ST_WR,
+};
+
+extern __thread struct stats *st_self; // Статистика этого процесса (потока в режиме --threads)
+
+/* st_init: начинает учёт в вызывающем потоке под именем name. slot - слот в общей памяти
+   (NULL - своя память; она одна на процесс, поэтому потокам нужны слоты). */
+void st_init(const char *name, struct stats *slot);
+
+/* st_shared: общая память на n слотов (memfd, O_CLOEXEC). Возвращает отображение или NULL. */
+struct stats *st_shared(int n, int *memfd);
+
+/* st_attach: в обработчике - слот slot общей памяти memfd из "-S FD:SLOT". NULL при ошибке. */
+struct stats *st_attach(const char *spec);
+
+/* st_place: процессоры cpus (список "0-3,8") и узел NUMA node, на которые размещён процесс
+   или поток, - в отчёт */
+void st_place(const char *cpus, int node);
+
+/* st_entry: новая запись с именем name. Возвращает её номер или -1, если места нет. */
+int st_entry(const char *name);
+
+/* st_watch: учитывать вызовы на fd в направлении dir под именем name */
+void st_watch(int fd, enum st_dir dir, const char *name);
+
+/* st_unwatch: fd закрыт - номер может достаться другому дескриптору */
+void st_unwatch(int fd);
+
+/* st_now: монотонное время в наносекундах */
+uint64_t st_now(void);
+
+/* st_account: запись e - вызов, начатый в t0, вернул r */
+void st_account(int e, uint64_t t0, ssize_t r);
+
+/* st_count: событие записи e с bytes байт - без системного вызова и замера времени
+   (счётчики на каждую строку, например попадания в кэш) */
+static inline void st_count(int e, size_t bytes)
+{
+    if (e < 0)
+        return;
+    st_self->io[e].calls++;
+    st_self->io[e].bytes += bytes;
+}
+
+/* st_line: обработана строка длины len */
+static inline void st_line(size_t len)
+{
+    int k = len ? 64 - __builtin_clzll((unsigned long long)len) : 0;
+    st_self->lines++;
+    st_self->bytes += len;
+    st_self->hist[k < ST_HIST ? k : ST_HIST - 1]++;
+}
+
+/* Системные вызовы с учётом (для неотслеживаемых fd - обычные read/write/writev) */
+ssize_t st_read(int fd, void *buf, size_t n);
+ssize_t st_write(int fd, const void *buf, size_t n);
+ssize_t st_writev(int fd, const struct iovec *iov, int cnt);
+
+/* st_cpu: обновляет время процессора вызывающего потока (у обработчика-процесса он один) */
+void st_cpu(void);
+
+/* st_dump: пишет JSON слотов s[0, n) одной строкой в fd: один слот - объект процесса,
+   несколько - {"processes": [...], "workers_total": {...}} (итог по слотам с 1).
+   Безопасна в обработчике сигнала (без malloc и stdio). */
+void st_dump(int fd, const struct stats *s, int n);
+
+/* st_on_signal: по SIGUSR1 вызывать dump (SA_RESTART: прерванные вызовы продолжаются) */
+void st_on_signal(void (*dump)(void));
+
+/* st_block: запрещает (block=1) или снова разрешает SIGUSR1 - вокруг вывода из основного кода */
+void st_block(int block);
+
+#endif
@@ -0,0 +1,291 @@
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+#include <stdint.h>
+
+#include "reverse.h"
+
+/* test_reverse: проверка ядер разворота (make test). Каждое ядро, которое поддерживает
+   процессор (reverse_set_kernel), должно давать тот же результат, что и скалярное, на
+   случайных строках длиной 0..MAX_LEN с невыровненным началом: ASCII, корректный UTF-8 и
+   мусор (лишние байты продолжения, оборванные символы). Байты вокруг строки не должны
+   меняться. Скалярное ядро сверяется с побайтным разворотом, а по символам UTF-8 - с тем,
+   что двойной разворот корректного текста возвращает исходный. Ядра со сменой регистра
+   (reverse_fold, reverse_swap, fold_case) сверяются со скалярным разворотом, после которого
+   скалярный fold_case, а сам скалярный fold_case - с побайтной сменой регистра латиницы. */
+
+#define MAX_LEN 8192     // Длины 0..DENSE_LEN подряд, дальше - случайные до MAX_LEN
+#define DENSE_LEN 1100   // Больше 32 шагов ядра AVX2 и хвосты всех длин
+#define MAX_OFF 64       // Сдвиг начала строки от выровненного адреса
+#define GUARD 32         // Байты-сторожа по краям строки
+#define GUARD_BYTE 0x5a
+
+static const char *const kernel_names[] = {"avx2", "ssse3", "scalar"};
+
+static uint64_t rng = 0x2545f4914f6cdd1dull; // Одинаковые строки от прогона к прогону
+
+/* rnd: xorshift64* */
+static uint64_t rnd(void)
+{
+    rng ^= rng >> 12;
+    rng ^= rng << 25;
+    rng ^= rng >> 27;
+    return rng * 0x2545f4914f6cdd1dull;
+}
+
+enum text_kind
+{
+    TEXT_ASCII,
+    TEXT_UTF8,    // Корректный UTF-8: 1-4 байта на символ
+    TEXT_BROKEN,  // UTF-8 с порчей: оборванные символы, одиночные продолжения, байты 0xf8-0xff
+    TEXT_RANDOM,  // Случайные байты
+    TEXT_KINDS,
+};
+
+static const char *const kind_names[] = {"ascii", "utf8", "broken", "random"};
+
+static const enum case_fold folds[] = {FOLD_NONE, FOLD_LOWER, FOLD_UPPER};
+static const char *const fold_names[] = {"none", "lower", "upper"};
+
+/* put_char: символ UTF-8 длины len (1..4) в s; возвращает len */
+static size_t put_char(unsigned char *s, size_t len)
+{
+    static const unsigned char lead[] = {0, 0x00, 0xc2, 0xe1, 0xf1};
+    static const unsigned char span[] = {0, 0x80, 0x1e, 0x0c, 0x03};
+    s[0] = (unsigned char)(lead[len] + rnd() % span[len]);
+    for (size_t i = 1; i < len; ++i)
+        s[i] = (unsigned char)(0x80 + rnd() % 0x40);
+    return len;
+}
+
+/* fill: n байт вида kind. Символы у конца обрываются - это тоже проверка. */
+static void fill(unsigned char *s, size_t n, enum text_kind kind)
+{
+    size_t i = 0;
+    while (i < n)
+    {
+        unsigned char tmp[4];
+        size_t len;
+        switch (kind)
+        {
+        case TEXT_ASCII:
+            s[i++] = (unsigned char)(0x20 + rnd() % 0x5f);
+            continue;
+        case TEXT_RANDOM:
+            s[i++] = (unsigned char)rnd();
+            continue;
+        case TEXT_BROKEN:
+            if (rnd() % 8 == 0) // Одиночное продолжение, недопустимый байт или оборванный символ
+            {
+                uint64_t r = rnd();
+                if (r % 3 == 0)
+                    s[i++] = (unsigned char)(0x80 + r % 0x40);
+                else if (r % 3 == 1)
+                    s[i++] = (unsigned char)(0xf8 + r % 8);
+                else
+                {
+                    len = put_char(tmp, 2 + r % 3);
+                    size_t cut = 1 + rnd() % (len - 1);
+                    for (size_t k = 0; k < cut && i < n; ++k)
+                        s[i++] = tmp[k];
+                }
+                continue;
+            }
+            /* fallthrough - обычный символ */
+        case TEXT_UTF8:
+        default:
+            len = put_char(tmp, 1 + rnd() % 4);
+            for (size_t k = 0; k < len && i < n; ++k)
+                s[i++] = tmp[k];
+            continue;
+        }
+    }
+}
+
+/* Буферы: исходная строка и её копии для проверяемого ядра и для скалярного */
+static unsigned char src[MAX_LEN];
+static unsigned char buf_kernel[MAX_LEN + MAX_OFF + 2 * GUARD];
+static unsigned char buf_scalar[MAX_LEN + MAX_OFF + 2 * GUARD];
+
+/* place: копия src[0, n) со сдвигом off между сторожами; возвращает начало строки */
+static char *place(unsigned char *buf, size_t n, size_t off)
+{
+    memset(buf, GUARD_BYTE, sizeof(buf_kernel));
+    memcpy(buf + GUARD + off, src, n);
+    return (char *)buf + GUARD + off;
+}
+
+/* guards_ok: байты вне строки [GUARD + off, GUARD + off + n) не тронуты */
+static int guards_ok(const unsigned char *buf, size_t n, size_t off)
+{
+    for (size_t i = 0; i < sizeof(buf_kernel); ++i)
+        if ((i < GUARD + off || i >= GUARD + off + n) && buf[i] != GUARD_BYTE)
+            return 0;
+    return 1;
+}
+
+static int failures;
+
+/* fail: сообщение о расхождении (не больше 20 - дальше, скорее всего, то же самое) */
+static void fail(const char *kernel, const char *what, enum text_kind kind, size_t n, size_t off)
+{
+    if (++failures <= 20)
+        fprintf(stderr, "FAIL %s %s: %s text, len %zu, offset %zu\n", kernel, what, kind_names[kind], n, off);
+}
+
+/* naive_fold: смена регистра одного байта - только A-Z или a-z */
+static unsigned char naive_fold(unsigned char c, enum case_fold fold)
+{
+    if (fold == FOLD_LOWER && c >= 'A' && c <= 'Z')
+        return (unsigned char)(c + 0x20);
+    if (fold == FOLD_UPPER && c >= 'a' && c <= 'z')
+        return (unsigned char)(c - 0x20);
+    return c;
+}
+
+/* check_scalar: скалярное ядро - с побайтным разворотом, побайтной сменой регистра и
+   двойным разворотом по символам */
+static void check_scalar(enum text_kind kind, size_t n, size_t off)
+{
+    reverse_set_kernel("scalar");
+    char *s = place(buf_scalar, n, off);
+    reverse_bytes(s, n);
+    for (size_t i = 0; i < n; ++i)
+        if ((unsigned char)s[i] != src[n - 1 - i])
+        {
+            fail("scalar", "reverse_bytes vs naive", kind, n, off);
+            break;
+        }
+    for (int f = 1; f < 3; ++f)
+    {
+        char what[64];
+        snprintf(what, sizeof(what), "fold_case %s vs naive", fold_names[f]);
+        s = place(buf_scalar, n, off);
+        fold_case(s, n, folds[f]);
+        for (size_t i = 0; i < n; ++i)
+            if ((unsigned char)s[i] != naive_fold(src[i], folds[f]))
+            {
+                fail("scalar", what, kind, n, off);
+                break;
+            }
+        if (!guards_ok(buf_scalar, n, off))
+            fail("scalar", "fold_case guards", kind, n, off);
+    }
+    if (kind != TEXT_UTF8 && kind != TEXT_ASCII)
+        return;
+    s = place(buf_scalar, n, off);
+    reverse_utf8(s, n);
+    reverse_utf8(s, n);
+    if (memcmp(s, src, n) != 0 || !guards_ok(buf_scalar, n, off))
+        fail("scalar", "reverse_utf8 twice", kind, n, off);
+}
+
+/* check_fold: ядро name со сменой регистра fold против скалярных разворота и fold_case */
+static void check_fold(const char *name, enum case_fold fold, enum text_kind kind, size_t n, size_t off)
+{
+    char what[64];
+    for (int utf8 = 0; utf8 <= 1; ++utf8)
+    {
+        reverse_set_kernel("scalar");
+        char *want = place(buf_scalar, n, off);
+        if (utf8)
+            reverse_utf8(want, n);
+        else
+            reverse_bytes(want, n);
+        fold_case(want, n, fold);
+        reverse_set_kernel(name);
+        char *got = place(buf_kernel, n, off);
+        reverse_fold(got, n, utf8, fold);
+        snprintf(what, sizeof(what), "reverse_fold %s %s", utf8 ? "utf8" : "bytes", fold_names[fold]);
+        if (memcmp(got, want, n) != 0 || !guards_ok(buf_kernel, n, off))
+            fail(name, what, kind, n, off);
+    }
+
+    /* reverse_swap двумя кусками со случайной границей (так его делят помощники разворота);
+       средний байт нечётной длины обмен не трогает */
+    reverse_set_kernel("scalar");
+    char *want = place(buf_scalar, n, off);
+    reverse_bytes(want, n);
+    fold_case(want, n, fold);
+    if (n % 2)
+        want[n / 2] = (char)src[n / 2];
+    reverse_set_kernel(name);
+    char *got = place(buf_kernel, n, off);
+    size_t k = (size_t)(rnd() % (n / 2 + 1));
+    reverse_swap(got, got + n, k, fold);
+    reverse_swap(got + k, got + n - k, n / 2 - k, fold);
+    snprintf(what, sizeof(what), "reverse_swap %s", fold_names[fold]);
+    if (memcmp(got, want, n) != 0 || !guards_ok(buf_kernel, n, off))
+        fail(name, what, kind, n, off);
+
+    if (fold == FOLD_NONE)
+        return;
+    reverse_set_kernel("scalar");
+    want = place(buf_scalar, n, off);
+    fold_case(want, n, fold);
+    reverse_set_kernel(name);
+    got = place(buf_kernel, n, off);
+    fold_case(got, n, fold);
+    snprintf(what, sizeof(what), "fold_case %s", fold_names[fold]);
+    if (memcmp(got, want, n) != 0 || !guards_ok(buf_kernel, n, off))
+        fail(name, what, kind, n, off);
+}
+
+/* check_kernel: ядро name против скалярного на src[0, n) со сдвигом off */
+static void check_kernel(const char *name, enum text_kind kind, size_t n, size_t off)
+{
+    for (int utf8 = 0; utf8 <= 1; ++utf8)
+    {
+        reverse_set_kernel("scalar");
+        char *want = place(buf_scalar, n, off);
+        if (utf8)
+            reverse_utf8(want, n);
+        else
+            reverse_bytes(want, n);
+        reverse_set_kernel(name);
+        char *got = place(buf_kernel, n, off);
+        if (utf8)
+            reverse_utf8(got, n);
+        else
+            reverse_bytes(got, n);
+        if (memcmp(got, want, n) != 0 || !guards_ok(buf_kernel, n, off))
+            fail(name, utf8 ? "reverse_utf8" : "reverse_bytes", kind, n, off);
+    }
+    for (int f = 0; f < 3; ++f)
+        check_fold(name, folds[f], kind, n, off);
+}
+
+/* check_all: строка длины n (вида kind) со случайным сдвигом - каждым ядром */
+static void check_all(enum text_kind kind, size_t n)
+{
+    size_t off = (size_t)(rnd() % MAX_OFF);
+    fill(src, n, kind);
+    check_scalar(kind, n, off);
+    for (size_t k = 0; k < sizeof(kernel_names) / sizeof(kernel_names[0]); ++k)
+        if (reverse_set_kernel(kernel_names[k]) == 0)
+            check_kernel(kernel_names[k], kind, n, off);
+}
+
+int main(void)
+{
+    for (size_t k = 0; k < sizeof(kernel_names) / sizeof(kernel_names[0]); ++k)
+        printf("kernel %-6s %s\n", kernel_names[k],
+               reverse_set_kernel(kernel_names[k]) == 0 ? "tested" : "not supported, skipped");
+
+    size_t cases = 0;
+    for (int kind = 0; kind < TEXT_KINDS; ++kind)
+    {
+        for (size_t n = 0; n <= DENSE_LEN; ++n, ++cases)
+            check_all((enum text_kind)kind, n);
+        for (int r = 0; r < 300; ++r, ++cases)
+            check_all((enum text_kind)kind, DENSE_LEN + (size_t)(rnd() % (MAX_LEN - DENSE_LEN + 1)));
+    }
+
+    if (failures)
+    {
+        printf("test_reverse: %d failures in %zu strings\n", failures, cases);
+        return 1;
+    }
+    printf("test_reverse: %zu strings OK\n", cases);
+    return 0;
+}
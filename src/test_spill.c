@@ -0,0 +1,122 @@
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+#include <stdint.h>
+
+#include "spill.h"
+#include "reverse.h"
+
+/* test_spill: проверка выдачи строк из временного файла (make test). Строка длиннее предела
+   сборки уходит в файл и выдаётся sp_emit отрезками по SPILL_SEG с конца; результат должен
+   совпадать с разворотом всей строки в памяти - побайтным и по символам UTF-8, со сменой
+   регистра и без, с '\n' в конце и без. Длины - около кратных SPILL_SEG: последний отрезок
+   (начало строки) короче трёх байт, а первый символ строки - многобайтный и пересекает
+   границу отрезка. */
+
+#define LIMIT (64 * 1024) // Предел сборки в памяти: строки тестов все уходят в файл
+#define PIECE 70001       // Куски sp_add - не кратны ни пределу, ни SPILL_SEG
+#define MAX_LEN (2 * SPILL_SEG + 8)
+
+static uint64_t rng = 0x2545f4914f6cdd1dull; // Одинаковые строки от прогона к прогону
+
+/* rnd: xorshift64* */
+static uint64_t rnd(void)
+{
+    rng ^= rng >> 12;
+    rng ^= rng << 25;
+    rng ^= rng >> 27;
+    return rng * 0x2545f4914f6cdd1dull;
+}
+
+/* put_char: символ UTF-8 длины len (1..4) в s; возвращает len */
+static size_t put_char(unsigned char *s, size_t len)
+{
+    static const unsigned char lead[] = {0, 0x41, 0xc3, 0xe1, 0xf1};
+    static const unsigned char span[] = {0, 0x3a, 0x1c, 0x0c, 0x03};
+    s[0] = (unsigned char)(lead[len] + rnd() % span[len]);
+    for (size_t i = 1; i < len; ++i)
+        s[i] = (unsigned char)(0x80 + rnd() % 0x40);
+    return len;
+}
+
+/* fill: n байт: первый символ длины first, дальше - символы 1-4 байта (последний может
+   оборваться - это тоже проверка) */
+static void fill(unsigned char *s, size_t n, size_t first)
+{
+    unsigned char tmp[4];
+    size_t i = 0, len = put_char(tmp, first);
+    for (;;)
+    {
+        for (size_t k = 0; k < len && i < n; ++k)
+            s[i++] = tmp[k];
+        if (i == n)
+            return;
+        len = put_char(tmp, 1 + rnd() % 4);
+    }
+}
+
+static unsigned char line[MAX_LEN + 1];
+static unsigned char want[MAX_LEN + 1];
+static unsigned char got[MAX_LEN + 1];
+static size_t got_len;
+
+/* collect: приёмник sp_emit */
+static void collect(void *arg, const char *p, size_t n)
+{
+    (void)arg;
+    if (got_len + n <= sizeof(got))
+        memcpy(got + got_len, p, n);
+    got_len += n;
+}
+
+static int failures;
+
+/* check: строка line[0, n) (с '\n' - nl) через файл против разворота в памяти */
+static void check(size_t n, size_t first, int utf8, enum case_fold fold, int nl)
+{
+    size_t total = n + (nl ? 1 : 0);
+    fill(line, n, first);
+    if (nl)
+        line[n] = '\n';
+    memcpy(want, line, total);
+    reverse_fold((char *)want, n, utf8, fold);
+
+    struct spill sp;
+    sp_init(&sp, LIMIT);
+    int rc = 0;
+    for (size_t off = 0; rc == 0 && off < total; off += PIECE)
+        rc = sp_add(&sp, (const char *)line + off, total - off < PIECE ? total - off : PIECE);
+    got_len = 0;
+    if (rc == 0 && sp_spilled(&sp))
+        rc = sp_emit(&sp, utf8, fold, collect, NULL);
+    else
+        rc = -1;
+    sp_free(&sp);
+
+    if (rc < 0 || got_len != total || memcmp(got, want, total) != 0)
+    {
+        if (++failures <= 20)
+            fprintf(stderr, "FAIL %s len %zu (SPILL_SEG*%zu+%zu), first char %zu bytes, fold %d, %s\n",
+                    utf8 ? "utf8" : "bytes", n, n / SPILL_SEG, n % SPILL_SEG, first, (int)fold,
+                    rc < 0 ? "spill failed" : nl ? "with newline" : "no newline");
+    }
+}
+
+int main(void)
+{
+    size_t cases = 0;
+    for (size_t segs = 1; segs <= 2; ++segs)
+        for (size_t rest = 0; rest <= 4; ++rest)
+            for (size_t first = 1; first <= 4; ++first)
+                for (int utf8 = 0; utf8 <= 1; ++utf8)
+                    for (int nl = 0; nl <= 1; ++nl, ++cases)
+                        check(segs * SPILL_SEG + rest, first, utf8, rest % 2 ? FOLD_UPPER : FOLD_NONE, nl);
+
+    if (failures)
+    {
+        printf("test_spill: %d failures in %zu lines\n", failures, cases);
+        return 1;
+    }
+    printf("test_spill: %zu lines OK\n", cases);
+    return 0;
+}
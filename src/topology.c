@@ -0,0 +1,280 @@
+#define _GNU_SOURCE
+#include <unistd.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <dirent.h>
+#include <sys/syscall.h>
+#include <linux/mempolicy.h>
+
+#include "topology.h"
+
+#define SYS_CPU "/sys/devices/system/cpu"
+
+/* read_text: содержимое файла sysfs без '\n' в buf. 0 или -1. */
+static int read_text(const char *path, char *buf, size_t size)
+{
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0)
+        return -1;
+    ssize_t r = read(fd, buf, size - 1);
+    close(fd);
+    if (r <= 0)
+        return -1;
+    buf[r] = '\0';
+    buf[strcspn(buf, "\n")] = '\0';
+    return 0;
+}
+
+/* read_int: число из файла sysfs (-1 - нет файла) */
+static int read_int(const char *path)
+{
+    char buf[32];
+    return read_text(path, buf, sizeof(buf)) < 0 ? -1 : atoi(buf);
+}
+
+/* l3_domain: наименьший процессор с общим с cpu кэшем третьего уровня (-1 - нет данных) */
+static int l3_domain(int cpu)
+{
+    char path[128], buf[TP_LIST_MAX];
+    for (int k = 0; k < 16; ++k)
+    {
+        snprintf(path, sizeof(path), SYS_CPU "/cpu%d/cache/index%d/level", cpu, k);
+        int level = read_int(path);
+        if (level < 0) // Уровни кэша кончились
+            return -1;
+        if (level != 3)
+            continue;
+        snprintf(path, sizeof(path), SYS_CPU "/cpu%d/cache/index%d/shared_cpu_list", cpu, k);
+        cpu_set_t set;
+        if (read_text(path, buf, sizeof(buf)) < 0 || tp_parse(buf, &set) < 0)
+            return -1;
+        for (int c = 0; c < CPU_SETSIZE; ++c)
+            if (CPU_ISSET(c, &set))
+                return c;
+    }
+    return -1;
+}
+
+/* numa_node: узел процессора - ссылка nodeN в его каталоге (-1 - ядро без NUMA) */
+static int numa_node(int cpu)
+{
+    char path[64];
+    snprintf(path, sizeof(path), SYS_CPU "/cpu%d", cpu);
+    DIR *d = opendir(path);
+    if (!d)
+        return -1;
+    int node = -1;
+    struct dirent *e;
+    while (node < 0 && (e = readdir(d)) != NULL)
+        if (strncmp(e->d_name, "node", 4) == 0 && e->d_name[4] >= '0' && e->d_name[4] <= '9')
+            node = atoi(e->d_name + 4);
+    closedir(d);
+    return node;
+}
+
+int tp_read(struct topology *t)
+{
+    cpu_set_t allowed;
+    if (sched_getaffinity(0, sizeof(allowed), &allowed) < 0)
+        return -1;
+    t->n = 0;
+    for (int c = 0; c < CPU_SETSIZE; ++c)
+    {
+        if (!CPU_ISSET(c, &allowed))
+            continue;
+        char path[128];
+        struct tp_cpu *p = &t->cpu[t->n++];
+        p->cpu = c;
+        snprintf(path, sizeof(path), SYS_CPU "/cpu%d/topology/core_id", c);
+        p->core = read_int(path);
+        snprintf(path, sizeof(path), SYS_CPU "/cpu%d/topology/physical_package_id", c);
+        p->package = read_int(path);
+        if (p->core < 0 || p->package < 0) // sysfs нет (или процессор исчез)
+            return -1;
+        p->l3 = l3_domain(c);
+        if (p->l3 < 0)
+            p->l3 = CPU_SETSIZE + p->package; // Не совпадает ни с одним номером процессора
+        p->node = numa_node(c);
+        p->sibling = 0;
+        for (int j = 0; j < t->n - 1; ++j)
+            p->sibling += t->cpu[j].package == p->package && t->cpu[j].core == p->core;
+    }
+    return t->n > 0 ? 0 : -1;
+}
+
+/* order_l3: процессоры самого большого домена L3 - сначала по одному на ядро. Возвращает число. */
+static int order_l3(const struct topology *t, int *order)
+{
+    int best = -1, best_count = 0;
+    for (int i = 0; i < t->n; ++i)
+    {
+        int count = 0;
+        for (int j = 0; j < t->n; ++j)
+            count += t->cpu[j].l3 == t->cpu[i].l3;
+        if (count > best_count)
+        {
+            best = t->cpu[i].l3;
+            best_count = count;
+        }
+    }
+    int m = 0;
+    for (int pass = 1; pass >= 0; --pass) // Первые потоки ядер, затем соседи SMT
+        for (int i = 0; i < t->n; ++i)
+            if (t->cpu[i].l3 == best && (t->cpu[i].sibling == 0) == pass)
+                order[m++] = i;
+    return m;
+}
+
+/* order_spread: все процессоры; подряд идущие - из разных пакетов (по очереди), сначала по
+   одному на ядро. Возвращает число. */
+static int order_spread(const struct topology *t, int *order)
+{
+    static int rank[CPU_SETSIZE]; // Номер процессора среди процессоров его прохода в его пакете
+    for (int i = 0; i < t->n; ++i)
+    {
+        rank[i] = 0;
+        for (int j = 0; j < i; ++j)
+            rank[i] += t->cpu[j].package == t->cpu[i].package && (t->cpu[j].sibling == 0) == (t->cpu[i].sibling == 0);
+    }
+    int m = 0;
+    for (int pass = 1; pass >= 0; --pass) // Первые потоки ядер, затем соседи SMT
+    {
+        int added = 1;
+        for (int r = 0; added; ++r) // r-й процессор прохода из каждого пакета по очереди
+        {
+            added = 0;
+            for (int i = 0; i < t->n; ++i)
+                if ((t->cpu[i].sibling == 0) == pass && rank[i] == r)
+                {
+                    order[m++] = i;
+                    added = 1;
+                }
+        }
+    }
+    return m;
+}
+
+/* set_node: узел NUMA набора - общий у всех его процессоров или -1 */
+static int set_node(const struct topology *t, const cpu_set_t *set)
+{
+    int node = -2;
+    for (int i = 0; i < t->n; ++i)
+    {
+        if (!CPU_ISSET(t->cpu[i].cpu, set))
+            continue;
+        if (node == -2)
+            node = t->cpu[i].node;
+        else if (node != t->cpu[i].node)
+            return -1;
+    }
+    return node < 0 ? -1 : node;
+}
+
+void tp_plan(const struct topology *t, enum tp_policy policy, int n, struct tp_place *parent,
+             struct tp_place *workers)
+{
+    static int order[CPU_SETSIZE];
+    int m = policy == TP_L3 ? order_l3(t, order) : order_spread(t, order);
+
+    CPU_ZERO(&parent->cpus);
+    CPU_SET(t->cpu[order[0]].cpu, &parent->cpus);
+    parent->node = t->cpu[order[0]].node;
+
+    /* Основные процессоры обработчиков - следующие по порядку (процессоров меньше, чем
+       участников, - по кругу, вместе с родителем, если иначе никак) */
+    int rest = m > 1 ? 1 : 0;
+    int avail = m - rest;
+    for (int w = 0; w < n; ++w)
+    {
+        CPU_ZERO(&workers[w].cpus);
+        CPU_SET(t->cpu[order[rest + w % avail]].cpu, &workers[w].cpus);
+    }
+
+    /* Оставшиеся - наименее нагруженному обработчику с тем же L3, иначе наименее нагруженному */
+    for (int k = rest + n; k < m; ++k)
+    {
+        const struct tp_cpu *c = &t->cpu[order[k]];
+        int to = -1, same = 0;
+        for (int w = 0; w < n; ++w)
+        {
+            int w_same = t->cpu[order[rest + w % avail]].l3 == c->l3;
+            if (to < 0 || w_same > same ||
+                (w_same == same && CPU_COUNT(&workers[w].cpus) < CPU_COUNT(&workers[to].cpus)))
+            {
+                to = w;
+                same = w_same;
+            }
+        }
+        CPU_SET(c->cpu, &workers[to].cpus);
+    }
+    for (int w = 0; w < n; ++w)
+        workers[w].node = set_node(t, &workers[w].cpus);
+}
+
+int tp_format(const cpu_set_t *set, char *buf, size_t size)
+{
+    size_t len = 0;
+    buf[0] = '\0';
+    for (int c = 0; c < CPU_SETSIZE; ++c)
+    {
+        if (!CPU_ISSET(c, set))
+            continue;
+        int end = c;
+        while (end + 1 < CPU_SETSIZE && CPU_ISSET(end + 1, set))
+            end++;
+        char item[32];
+        int il = end > c ? snprintf(item, sizeof(item), "%s%d-%d", len ? "," : "", c, end)
+                         : snprintf(item, sizeof(item), "%s%d", len ? "," : "", c);
+        if (len + (size_t)il + 4 > size) // За списком всегда остаётся место для "..." и '\0'
+        {
+            if (len + 4 <= size)
+                strcpy(buf + len, "...");
+            return -1;
+        }
+        memcpy(buf + len, item, (size_t)il + 1);
+        len += (size_t)il;
+        c = end;
+    }
+    return 0;
+}
+
+int tp_parse(const char *list, cpu_set_t *set)
+{
+    CPU_ZERO(set);
+    const char *p = list;
+    while (*p)
+    {
+        char *end;
+        long a = strtol(p, &end, 10), b = a;
+        if (end == p)
+            return -1;
+        if (*end == '-')
+        {
+            p = end + 1;
+            b = strtol(p, &end, 10);
+            if (end == p)
+                return -1;
+        }
+        if (a < 0 || b < a || b >= CPU_SETSIZE)
+            return -1;
+        for (long c = a; c <= b; ++c)
+            CPU_SET((int)c, set);
+        if (*end == ',')
+            end++;
+        else if (*end != '\0')
+            return -1;
+        p = end;
+    }
+    return CPU_COUNT(set) > 0 ? 0 : -1;
+}
+
+int tp_bind(void *addr, size_t len, int node)
+{
+    if (node < 0 || node >= (int)(8 * sizeof(unsigned long)))
+        return -1;
+    unsigned long mask = 1ul << node;
+    /* maxnode - число битов маски плюс один (ядро отбрасывает последний) */
+    return (int)syscall(__NR_mbind, addr, len, MPOL_PREFERRED, &mask, 8 * sizeof(mask) + 1, MPOL_MF_MOVE);
+}
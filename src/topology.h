@@ -0,0 +1,73 @@
+#ifndef TOPOLOGY_H
+#define TOPOLOGY_H
+
+#include <sched.h>
+#include <stddef.h>
+
+/* Топология процессоров (sysfs) и размещение родителя и обработчиков (--placement).
+   Из /sys/devices/system/cpu берутся ядро, пакет (сокет), общий кэш L3 и узел NUMA каждого
+   доступного процессора (маска sched_getaffinity). План размещения: родитель - на первом
+   процессоре порядка, выбранного политикой, обработчики - по одному процессору порядка,
+   остальные процессоры (для помощников разворота и сжатия) - наименее нагруженному
+   обработчику с тем же L3. Сначала идут разные физические ядра, потом их соседи SMT.
+     TP_L3     - все в одном домене L3 (самом большом): данные каналов и колец остаются в
+                 общем кэше;
+     TP_SPREAD - по всем процессорам, пакеты по очереди: больше ядер и кэшей на обработчиков.
+   Буфер, который читает обработчик (кольцо shm), привязывается к его узлу NUMA (tp_bind);
+   свои буферы обработчик выделяет сам - уже на своих процессорах, и ядро кладёт их на
+   его узел. */
+
+#define TP_LIST_MAX 8192 // Буфер списка процессоров ("0-3,8") для любого набора
+
+enum tp_policy
+{
+    TP_NONE,   // Без размещения: процессоры выбирает планировщик
+    TP_L3,     // Один домен общего кэша L3
+    TP_SPREAD, // По ядрам всех пакетов
+};
+
+/* tp_cpu: доступный процессор */
+struct tp_cpu
+{
+    int cpu;     // Номер
+    int core;    // core_id (уникален в пределах пакета)
+    int package; // physical_package_id
+    int sibling; // Номер среди процессоров своего ядра (0 - первый, остальные - соседи SMT)
+    int l3;      // Домен L3: наименьший процессор с общим кэшем (без данных о L3 - пакет)
+    int node;    // Узел NUMA (-1 - неизвестен)
+};
+
+/* topology: доступные процессоры по возрастанию номеров */
+struct topology
+{
+    int n;
+    struct tp_cpu cpu[CPU_SETSIZE];
+};
+
+/* tp_place: процессоры одного участника и их узел NUMA (-1 - не один или неизвестен).
+   Пустой набор - не размещён. */
+struct tp_place
+{
+    cpu_set_t cpus;
+    int node;
+};
+
+/* tp_read: читает топологию доступных процессоров. 0 или -1 (нет sysfs). */
+int tp_read(struct topology *t);
+
+/* tp_plan: размещение по политике policy (не TP_NONE) родителя и n обработчиков */
+void tp_plan(const struct topology *t, enum tp_policy policy, int n, struct tp_place *parent,
+             struct tp_place *workers);
+
+/* tp_format: набор в виде списка "0-3,8". Не поместившийся список обрезается с "..." на
+   конце, тогда возвращается -1; иначе 0. */
+int tp_format(const cpu_set_t *set, char *buf, size_t size);
+
+/* tp_parse: список "0-3,8" в набор. 0 или -1 (ошибка разбора или пустой набор). */
+int tp_parse(const char *list, cpu_set_t *set);
+
+/* tp_bind: страницы [addr, addr + len) - предпочтительно на узле node (mbind MPOL_PREFERRED;
+   уже занятые страницы переносятся). 0 или -1. */
+int tp_bind(void *addr, size_t len, int node);
+
+#endif
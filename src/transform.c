@@ -0,0 +1,154 @@
+#define _GNU_SOURCE
+#include <string.h>
+
+#include "transform.h"
+
+/* push: добавляет шаг в план. 0 или -1 (план длиннее XF_MAX_STEPS). */
+static int push(struct xform *x, enum xf_op op, enum case_fold fold, const char *text, size_t text_len)
+{
+    if (x->n == XF_MAX_STEPS)
+        return -1;
+    x->step[x->n++] = (struct xf_step){op, fold, text, text_len};
+    return 0;
+}
+
+/* add_step: шаг цепочки - в план, слитым с предыдущим, где это возможно. 0 или -1. */
+static int add_step(struct xform *x, enum xf_op op, enum case_fold fold, const char *text, size_t text_len)
+{
+    struct xf_step *last = x->n > 0 ? &x->step[x->n - 1] : NULL;
+    switch (op)
+    {
+    case XF_TRIM:
+        if (last && last->op == XF_TRIM) // Второй trim ничего не отрежет
+            return 0;
+        break;
+    case XF_FOLD:
+        /* Регистр меняется только в байтах ASCII, которые разворот переставляет, но не меняет:
+           смена регистра до или после разворота - одно и то же, и её делает ядро разворота */
+        if (last && (last->op == XF_FOLD || last->op == XF_REVERSE))
+        {
+            last->fold = fold; // Действует последняя смена регистра
+            return 0;
+        }
+        break;
+    case XF_REVERSE:
+        if (last && last->op == XF_FOLD)
+        {
+            last->op = XF_REVERSE;
+            return 0;
+        }
+        /* Двойной побайтный разворот - тождество. По символам - нет: некорректные
+           последовательности разворачиваются побайтно, и второй разворот их не восстанавливает. */
+        if (last && last->op == XF_REVERSE && !x->utf8)
+        {
+            last->op = XF_FOLD; // Смена регистра первого разворота остаётся
+            if (last->fold == FOLD_NONE)
+                x->n--;
+            return 0;
+        }
+        break;
+    case XF_FILTER:
+    case XF_DROP:
+        break;
+    }
+    return push(x, op, fold, text, text_len);
+}
+
+/* starts: spec начинается с name, за которым конец шага или ':' (с аргументом) */
+static int starts(const char *spec, size_t len, const char *name)
+{
+    size_t n = strlen(name);
+    return len >= n && memcmp(spec, name, n) == 0 && (len == n || spec[n] == ':');
+}
+
+int xf_parse(struct xform *x, const char *spec, int utf8)
+{
+    memset(x, 0, sizeof(*x));
+    x->utf8 = utf8;
+    if (!spec || !*spec)
+        return -1;
+    const char *p = spec;
+    while (1)
+    {
+        const char *end = strchr(p, ',');
+        size_t len = end ? (size_t)(end - p) : strlen(p);
+        int rc;
+        if (len == 7 && memcmp(p, "reverse", 7) == 0)
+            rc = add_step(x, XF_REVERSE, FOLD_NONE, NULL, 0);
+        else if (len == 4 && memcmp(p, "trim", 4) == 0)
+            rc = add_step(x, XF_TRIM, FOLD_NONE, NULL, 0);
+        else if (len == 5 && memcmp(p, "lower", 5) == 0)
+            rc = add_step(x, XF_FOLD, FOLD_LOWER, NULL, 0);
+        else if (len == 5 && memcmp(p, "upper", 5) == 0)
+            rc = add_step(x, XF_FOLD, FOLD_UPPER, NULL, 0);
+        else if (starts(p, len, "filter") && len > 7)
+            rc = add_step(x, XF_FILTER, FOLD_NONE, p + 7, len - 7);
+        else if (starts(p, len, "drop") && len > 5)
+            rc = add_step(x, XF_DROP, FOLD_NONE, p + 5, len - 5);
+        else
+            rc = -1; // Неизвестный шаг или фильтр без текста
+        if (rc < 0)
+            return -1;
+        if (!end)
+            return 0;
+        p = end + 1;
+    }
+}
+
+int xf_same_length(const struct xform *x)
+{
+    for (int i = 0; i < x->n; ++i)
+        if (x->step[i].op == XF_TRIM || x->step[i].op == XF_FILTER || x->step[i].op == XF_DROP)
+            return 0;
+    return 1;
+}
+
+int xf_spillable(const struct xform *x)
+{
+    return x->n == 1 && x->step[0].op == XF_REVERSE;
+}
+
+/* is_space: пробельный символ для trim ('\n' сюда не попадает - он не часть строки) */
+static inline int is_space(char c)
+{
+    return c == ' ' || c == '\t' || c == '\r' || c == '\v' || c == '\f';
+}
+
+ssize_t xf_apply(const struct xform *x, struct rev_pool *rp, char **line, size_t len)
+{
+    char *s = *line;
+    size_t n = len;
+    int nl = n > 0 && s[n - 1] == '\n'; // Не преобразуем символ новой строки
+    n -= (size_t)nl;
+    for (int i = 0; i < x->n; ++i)
+    {
+        const struct xf_step *st = &x->step[i];
+        switch (st->op)
+        {
+        case XF_REVERSE:
+            rp_reverse(rp, s, n, x->utf8, st->fold);
+            break;
+        case XF_FOLD:
+            fold_case(s, n, st->fold);
+            break;
+        case XF_TRIM:
+            while (n > 0 && is_space(s[n - 1]))
+                n--;
+            while (n > 0 && is_space(*s))
+            {
+                s++;
+                n--;
+            }
+            break;
+        case XF_FILTER:
+        case XF_DROP:
+            if ((memmem(s, n, st->text, st->text_len) != NULL) != (st->op == XF_FILTER))
+                return -1;
+            break;
+        }
+    }
+    if (nl) // После trim '\n' встаёт сразу за строкой - на место отрезанного пробела
+        s[n++] = '\n';
+    *line = s;
+    return (ssize_t)n;
+}
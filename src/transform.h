@@ -0,0 +1,68 @@
+#ifndef TRANSFORM_H
+#define TRANSFORM_H
+
+#include <sys/types.h>
+#include <stddef.h>
+
+#include "reverse.h"
+#include "rev_pool.h"
+
+/* Цепочка преобразований строки (-x у обработчика, --transform у родителя): шаги через
+   запятую, выполняются по порядку:
+     reverse      - разворот (по символам UTF-8 при -u)
+     trim         - пробельные символы (пробел, \t, \r, \v, \f) в начале и в конце
+     lower, upper - регистр латиницы (остальные символы не меняются)
+     filter:TEXT  - оставить только строки, содержащие TEXT (TEXT - байты до запятой)
+     drop:TEXT    - отбросить строки, содержащие TEXT
+   '\n' в конце строки шагам не виден и остаётся последним.
+   Разбор сливает цепочку в план: каждый шаг работает на месте в буфере строки, без копий и
+   системных вызовов. Подряд идущие trim - один шаг, подряд идущие lower/upper - один (действует
+   последний); смена регистра рядом с разворотом выполняется в том же проходе ядра разворота,
+   а два разворота подряд побайтно взаимно уничтожаются. trim сдвигает только границы строки. */
+
+#define XF_MAX_STEPS 16      // Предел шагов плана (после слияния)
+#define XF_DEFAULT "reverse" // Цепочка по умолчанию
+
+enum xf_op
+{
+    XF_REVERSE, // Разворот (со сменой регистра fold)
+    XF_FOLD,    // Смена регистра
+    XF_TRIM,
+    XF_FILTER,  // Строка без text отбрасывается
+    XF_DROP,    // Строка с text отбрасывается
+};
+
+/* xf_step: шаг плана */
+struct xf_step
+{
+    enum xf_op op;
+    enum case_fold fold;  // XF_REVERSE, XF_FOLD
+    const char *text;     // XF_FILTER, XF_DROP: подстрока внутри строки цепочки
+    size_t text_len;
+};
+
+/* xform: план цепочки */
+struct xform
+{
+    struct xf_step step[XF_MAX_STEPS];
+    int n;    // Шагов (0 - строки выводятся как есть)
+    int utf8; // Разворот по символам UTF-8
+};
+
+/* xf_parse: разбирает цепочку spec (строка должна жить, пока используется план). 0 или -1. */
+int xf_parse(struct xform *x, const char *spec, int utf8);
+
+/* xf_same_length: каждая строка выходит той же длины (нет trim, filter, drop) - этого требуют
+   режимы, в которых место строки в выводе известно заранее (--ordered, --input) */
+int xf_same_length(const struct xform *x);
+
+/* xf_spillable: план - один разворот, и строку длиннее предела сборки можно выдать отрезками
+   с конца временного файла (sp_emit, см. spill.h); иначе строка собирается в памяти целиком */
+int xf_spillable(const struct xform *x);
+
+/* xf_apply: применяет план к строке line длины len на месте (длинный разворот - вместе с
+   помощниками rp). Возвращает новую длину и начало строки в *line или -1, если строка
+   отброшена. */
+ssize_t xf_apply(const struct xform *x, struct rev_pool *rp, char **line, size_t len);
+
+#endif
@@ -0,0 +1,275 @@
+#define _GNU_SOURCE
+#include <unistd.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/ioctl.h>
+#include <sys/epoll.h>
+
+#include "transport.h"
+
+int chan_create(struct channel *ch, enum transport_kind kind, int raw, size_t frame_bytes,
+                uint32_t frame_records, size_t limit, int pipe_size)
+{
+    memset(ch, 0, sizeof(*ch));
+    ch->kind = kind;
+    ch->raw = raw;
+    ch->limit = limit;
+    ch->fd = ch->child_fd = -1;
+    if (kind == TRANSPORT_SHM)
+    {
+        if (ring_create(&ch->ring, limit) < 0) // Кольцо размером с очередь
+            return -1;
+        snprintf(ch->spec, sizeof(ch->spec), "shm:%d,%d,%d", ch->ring.memfd, ch->ring.data_efd,
+                 ch->ring.space_efd);
+        return 0;
+    }
+
+    int p[2]; // p[0] - чтение, p[1] - запись
+    /* O_CLOEXEC: следующие обработчики не унаследуют концы записи чужих каналов,
+       иначе они не увидят EOF после закрытия канала родителем */
+    if (pipe2(p, O_CLOEXEC) < 0)
+        return -1;
+    ch->child_fd = p[0];
+    ch->fd = p[1];
+    /* Ёмкость канала: больше буфер ядра - реже родитель упирается в медленного обработчика */
+    if (pipe_size > 0 && fcntl(ch->fd, F_SETPIPE_SZ, pipe_size) < 0)
+        errno = 0; // Не удалось (предел pipe-max-size) - остаётся ёмкость по умолчанию
+    /* Конец записи неблокирующий: заполненный канал не останавливает родителя */
+    fcntl(ch->fd, F_SETFL, fcntl(ch->fd, F_GETFL) | O_NONBLOCK);
+    if (!raw) // Строки отправляются не по одной, а пакетами (см. frame.h)
+    {
+        fq_init(&ch->q);
+        fb_init(&ch->fb, &ch->q, frame_bytes, frame_records);
+        strcpy(ch->spec, "frames");
+    }
+    return 0;
+}
+
+const char *chan_child_setup(struct channel *ch)
+{
+    if (ch->kind == TRANSPORT_SHM)
+    {
+        /* Дескрипторы кольца должны пережить exec */
+        fcntl(ch->ring.memfd, F_SETFD, 0);
+        fcntl(ch->ring.data_efd, F_SETFD, 0);
+        fcntl(ch->ring.space_efd, F_SETFD, 0);
+        return ch->spec;
+    }
+    /* Перенаправляем stdin на чтение из канала (dup2 снимает O_CLOEXEC с копии) */
+    if (dup2(ch->child_fd, 0) == -1)
+        return NULL;
+    return ch->raw ? NULL : ch->spec;
+}
+
+const char *chan_thread_setup(struct channel *ch)
+{
+    if (ch->kind != TRANSPORT_SHM)
+        return NULL;
+    int fds[3] = {ch->ring.memfd, ch->ring.data_efd, ch->ring.space_efd};
+    for (int i = 0; i < 3; ++i)
+    {
+        fds[i] = fcntl(fds[i], F_DUPFD_CLOEXEC, 0); // eventfd-копия делит счётчик с оригиналом
+        if (fds[i] < 0)
+        {
+            while (i-- > 0)
+                close(fds[i]);
+            return NULL;
+        }
+    }
+    snprintf(ch->spec, sizeof(ch->spec), "shm:%d,%d,%d", fds[0], fds[1], fds[2]);
+    return ch->spec;
+}
+
+int chan_pass_fds(const struct channel *ch, int *fds)
+{
+    if (ch->kind == TRANSPORT_SHM)
+    {
+        fds[0] = ch->ring.memfd;
+        fds[1] = ch->ring.data_efd;
+        fds[2] = ch->ring.space_efd;
+        return 3;
+    }
+    fds[0] = ch->child_fd;
+    return 1;
+}
+
+void chan_parent_setup(struct channel *ch)
+{
+    if (ch->kind == TRANSPORT_PIPE && ch->child_fd >= 0)
+    {
+        close(ch->child_fd); // Родитель не будет читать из канала
+        ch->child_fd = -1;
+    }
+}
+
+ssize_t chan_send(struct channel *ch, const char *rec, size_t len, int more)
+{
+    if (ch->kind == TRANSPORT_SHM)
+        return ring_put(&ch->ring, rec, len, more); // Прямо в кольцо обработчика
+    if (fb_add(&ch->fb, rec, len, more) < 0)       // В фрейм канала
+        return -1;
+    return (ssize_t)len;
+}
+
+int chan_full(const struct channel *ch)
+{
+    if (ch->kind == TRANSPORT_SHM)
+        return ring_waiting(&ch->ring); // Писатель уже упёрся в заполненное кольцо
+    return fq_bytes(&ch->q) >= ch->limit;
+}
+
+int chan_idle_ms(const struct channel *ch, uint64_t now)
+{
+    if (!chan_building(ch))
+        return -1;
+    return (int)((now - ch->fb.first_ns) / 1000000ull);
+}
+
+int chan_building(const struct channel *ch)
+{
+    return ch->kind == TRANSPORT_PIPE && !ch->raw && !fb_empty(&ch->fb);
+}
+
+void chan_seal(struct channel *ch)
+{
+    if (ch->kind == TRANSPORT_PIPE && !ch->raw)
+        fb_seal(&ch->fb);
+}
+
+int chan_write(struct channel *ch)
+{
+    if (ch->kind == TRANSPORT_SHM || ch->raw) // Кольцо не требует отдельной отправки
+        return 0;
+    return fq_write(&ch->q, ch->fd) < 0 ? -1 : 0;
+}
+
+int chan_pending(const struct channel *ch)
+{
+    if (ch->kind == TRANSPORT_SHM || ch->raw)
+        return 0;
+    return fq_bytes(&ch->q) > 0;
+}
+
+size_t chan_load(const struct channel *ch)
+{
+    if (ch->kind == TRANSPORT_SHM)
+        return ring_used(&ch->ring);
+    int q = 0;
+    /* FIONREAD на конце записи возвращает заполненность всего канала */
+    if (ioctl(ch->fd, FIONREAD, &q) < 0)
+        q = 0;
+    return (size_t)q + (ch->raw ? 0 : fq_bytes(&ch->q));
+}
+
+int chan_wait_fd(const struct channel *ch)
+{
+    return ch->kind == TRANSPORT_SHM ? ch->ring.space_efd : ch->fd;
+}
+
+uint32_t chan_wait_events(const struct channel *ch)
+{
+    if (ch->kind == TRANSPORT_SHM)
+        return ring_waiting(&ch->ring) ? EPOLLIN : 0; // eventfd "появилось место"
+    return chan_pending(ch) ? EPOLLOUT : 0;
+}
+
+void chan_ack(struct channel *ch)
+{
+    if (ch->kind == TRANSPORT_SHM)
+        ring_ack(&ch->ring);
+}
+
+void chan_close(struct channel *ch)
+{
+    if (ch->kind == TRANSPORT_SHM)
+    {
+        ring_close(&ch->ring);   // Обработчик дочитает кольцо и завершится
+        ring_destroy(&ch->ring); // Отображение у обработчика остаётся действительным
+        return;
+    }
+    close(ch->fd); // Сигнализируем обработчику, что больше данных не будет
+    if (!ch->raw)
+    {
+        fb_free(&ch->fb);
+        fq_free(&ch->q);
+    }
+}
+
+int src_open(struct source *src, const char *spec)
+{
+    memset(src, 0, sizeof(*src));
+    if (!spec) // Постоянный читатель stdin: один буфер на всё время работы
+    {
+        src->kind = SOURCE_LINES;
+        if (lr_init(&src->lr, 0, 0) < 0)
+            return -1;
+        src->lr.max_line = LR_PIECE; // Длинная строка не растит буфер - идёт кусками
+        return 0;
+    }
+    if (strcmp(spec, "frames") == 0)
+    {
+        src->kind = SOURCE_FRAMES;
+        return fr_init(&src->fr, 0);
+    }
+    int memfd, data_efd, space_efd;
+    if (sscanf(spec, "shm:%d,%d,%d", &memfd, &data_efd, &space_efd) == 3)
+    {
+        src->kind = SOURCE_SHM;
+        return ring_attach(&src->ring, memfd, data_efd, space_efd);
+    }
+    errno = EINVAL;
+    return -1;
+}
+
+ssize_t src_next(struct source *src, char **rec)
+{
+    switch (src->kind)
+    {
+    case SOURCE_FRAMES:
+        return fr_next(&src->fr, rec);
+    case SOURCE_SHM:
+        return ring_next(&src->ring, rec);
+    default:
+        return lr_next(&src->lr, rec);
+    }
+}
+
+void src_use_uring(struct source *src, struct uring *io)
+{
+    if (src->kind == SOURCE_FRAMES)
+        fr_use_uring(&src->fr, io);
+    else if (src->kind == SOURCE_LINES)
+        lr_use_uring(&src->lr, io);
+}
+
+int src_ready(struct source *src)
+{
+    switch (src->kind)
+    {
+    case SOURCE_FRAMES:
+        return fr_ready(&src->fr);
+    case SOURCE_SHM:
+        return ring_ready(&src->ring);
+    default:
+        return lr_ready(&src->lr);
+    }
+}
+
+void src_close(struct source *src)
+{
+    switch (src->kind)
+    {
+    case SOURCE_FRAMES:
+        fr_free(&src->fr);
+        break;
+    case SOURCE_SHM:
+        ring_destroy(&src->ring);
+        break;
+    default:
+        lr_free(&src->lr);
+        break;
+    }
+}
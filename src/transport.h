@@ -0,0 +1,144 @@
+#ifndef TRANSPORT_H
+#define TRANSPORT_H
+
+#include <sys/types.h>
+#include <stdint.h>
+#include <stddef.h>
+
+#include "line_reader.h"
+#include "frame.h"
+#include "shm_ring.h"
+
+/* Транспорт между родителем и обработчиком. Родитель работает с ним через struct channel,
+   обработчик - через struct source; код вокруг не зависит от выбранного транспорта.
+     TRANSPORT_PIPE - канал (pipe), строки идут фреймами (frame.h) или, в режиме фрагментов, как есть;
+     TRANSPORT_SHM  - кольцо в разделяемой памяти (shm_ring.h), строки читаются прямо из него. */
+enum transport_kind
+{
+    TRANSPORT_PIPE,
+    TRANSPORT_SHM,
+};
+
+/* channel: родительская сторона транспорта к одному обработчику */
+struct channel
+{
+    enum transport_kind kind;
+    int raw;                 // pipe: строки пишутся без фреймов (режим фрагментов)
+    int fd;                  // pipe: конец записи (O_NONBLOCK)
+    int child_fd;            // pipe: конец чтения (до запуска обработчика)
+    size_t limit;            // Предел неотправленных данных (pipe - очередь, shm - размер кольца)
+    struct frame_queue q;    // pipe: готовые фреймы
+    struct frame_builder fb; // pipe: собираемый фрейм
+    struct shm_ring ring;    // shm: кольцо
+    char spec[64];           // Аргумент "-T" для обработчика
+};
+
+/* chan_create: создаёт транспорт до fork(). frame_bytes/frame_records - параметры фреймов,
+   limit - очередь (pipe) или размер кольца (shm), pipe_size - ёмкость канала (0 - по умолчанию).
+   Возвращает 0 или -1. */
+int chan_create(struct channel *ch, enum transport_kind kind, int raw, size_t frame_bytes,
+                uint32_t frame_records, size_t limit, int pipe_size);
+
+/* chan_child_setup: в дочернем процессе перед exec - подключает транспорт (pipe - к stdin,
+   shm - снимает O_CLOEXEC с дескрипторов) и возвращает аргумент для "-T" (NULL - не нужен). */
+const char *chan_child_setup(struct channel *ch);
+
+/* chan_thread_setup: для обработчика-потока (parent --threads, только shm) - копии дескрипторов
+   кольца, которыми владеет поток (chan_close закрывает родительские, пока поток дочитывает),
+   и аргумент для src_open. NULL при ошибке. */
+const char *chan_thread_setup(struct channel *ch);
+
+/* chan_pass_fds: дескрипторы обработчика для передачи через SCM_RIGHTS (обработчик пула
+   parent --daemon): pipe - конец чтения, shm - memfd, data_efd, space_efd - в порядке спецификации
+   "shm:...". Возвращает их число (до 3). */
+int chan_pass_fds(const struct channel *ch, int *fds);
+
+/* chan_parent_setup: в родителе после fork - закрывает ненужную родителю сторону */
+void chan_parent_setup(struct channel *ch);
+
+/* chan_send: отдаёт строку обработчику. more - это кусок строки, продолжение придёт следующими
+   вызовами (обработчик увидит src_more). Возвращает число принятых байт:
+   len - принята целиком, меньше (в т.ч. 0) - места нет, остаток нужно отправить позже; -1 - ошибка. */
+ssize_t chan_send(struct channel *ch, const char *rec, size_t len, int more);
+
+/* chan_full: места для новых строк нет - родитель должен придержать ввод */
+int chan_full(const struct channel *ch);
+
+/* chan_idle_ms: сколько мс собираемый фрейм ждёт отправки (-1 - ничего не собирается) */
+int chan_idle_ms(const struct channel *ch, uint64_t now);
+
+/* chan_building: собирается неполный фрейм */
+int chan_building(const struct channel *ch);
+
+/* chan_seal: завершает собираемый фрейм (для shm - ничего не делает) */
+void chan_seal(struct channel *ch);
+
+/* chan_write: отправляет накопленное, сколько примет транспорт. 0 или -1 при ошибке. */
+int chan_write(struct channel *ch);
+
+/* chan_pending: остались неотправленные данные */
+int chan_pending(const struct channel *ch);
+
+/* chan_load: нагрузка обработчика в байтах (данные, которые он ещё не прочитал) */
+size_t chan_load(const struct channel *ch);
+
+/* chan_wait_fd: дескриптор, готовность которого означает "можно отправлять дальше" */
+int chan_wait_fd(const struct channel *ch);
+
+/* chan_wait_events: события epoll, которых сейчас стоит ждать на chan_wait_fd (0 - никаких) */
+uint32_t chan_wait_events(const struct channel *ch);
+
+/* chan_ack: вызывается после срабатывания chan_wait_fd */
+void chan_ack(struct channel *ch);
+
+/* chan_close: сообщает обработчику о конце данных и освобождает ресурсы родителя */
+void chan_close(struct channel *ch);
+
+/* source: сторона обработчика - источник строк */
+struct source
+{
+    enum
+    {
+        SOURCE_LINES,  // Обычные строки из stdin
+        SOURCE_FRAMES, // Фреймы из stdin
+        SOURCE_SHM,    // Кольцо в разделяемой памяти
+    } kind;
+    struct line_reader lr;
+    struct frame_reader fr;
+    struct shm_ring ring;
+};
+
+/* src_open: открывает источник по описанию: NULL - строки из stdin, "frames" - фреймы из stdin,
+   "shm:MEMFD,DATA_EFD,SPACE_EFD" - кольцо. Возвращает 0 или -1.
+   Длинная строка может прийти кусками (родитель не держит её целиком, строки stdin
+   читаются по LR_PIECE) - после каждого куска, кроме последнего, src_more истинно. */
+int src_open(struct source *src, const char *spec);
+
+/* src_next: следующая строка (указатель действителен и изменяем до следующего вызова).
+   Возвращает длину, 0 на конце данных, -1 при ошибке. */
+ssize_t src_next(struct source *src, char **rec);
+
+/* src_more: последняя выданная запись - кусок строки, следующая запись её продолжает */
+static inline int src_more(const struct source *src)
+{
+    switch (src->kind)
+    {
+    case SOURCE_FRAMES:
+        return src->fr.more;
+    case SOURCE_SHM:
+        return src->ring.more;
+    default:
+        return src->lr.more;
+    }
+}
+
+/* src_use_uring: канал stdin читается через io_uring с опережением. Кольцо в разделяемой
+   памяти читается без системных вызовов - для него ничего не меняется. */
+void src_use_uring(struct source *src, struct uring *io);
+
+/* src_ready: следующая строка уже доступна - src_next не будет ждать данных */
+int src_ready(struct source *src);
+
+void src_close(struct source *src);
+
+#endif
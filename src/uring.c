@@ -0,0 +1,194 @@
+#define _GNU_SOURCE
+#include <unistd.h>
+#include <string.h>
+#include <errno.h>
+#include <stdatomic.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+
+#include "uring.h"
+#include "stats.h"
+
+static int sys_setup(unsigned entries, struct io_uring_params *p)
+{
+    return (int)syscall(__NR_io_uring_setup, entries, p);
+}
+
+static int sys_enter(int fd, unsigned to_submit, unsigned min_complete, unsigned flags)
+{
+    return (int)syscall(__NR_io_uring_enter, fd, to_submit, min_complete, flags, NULL, 0);
+}
+
+/* Общие с ядром счётчики колец: чтение с acquire, запись с release */
+static unsigned load_acq(const unsigned *p)
+{
+    return atomic_load_explicit((_Atomic unsigned *)p, memory_order_acquire);
+}
+
+static void store_rel(unsigned *p, unsigned v)
+{
+    atomic_store_explicit((_Atomic unsigned *)p, v, memory_order_release);
+}
+
+int uring_init(struct uring *u, unsigned entries)
+{
+    struct io_uring_params p;
+    memset(u, 0, sizeof(*u));
+    memset(&p, 0, sizeof(p));
+    u->fd = sys_setup(entries, &p);
+    if (u->fd < 0)
+        return -1;
+    u->st_wait = st_entry("uring.wait"); // Время, когда ядро ещё не закончило нужную операцию
+
+    u->sq_map_len = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+    u->cq_map_len = p.cq_off.cqes + p.cq_entries * sizeof(struct io_uring_cqe);
+    if (p.features & IORING_FEAT_SINGLE_MMAP) // SQ и CQ в одном отображении
+    {
+        if (u->cq_map_len > u->sq_map_len)
+            u->sq_map_len = u->cq_map_len;
+        u->cq_map_len = 0;
+    }
+    u->sq_map = mmap(NULL, u->sq_map_len, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, u->fd,
+                     IORING_OFF_SQ_RING);
+    if (u->sq_map == MAP_FAILED)
+    {
+        u->sq_map = NULL;
+        goto fail;
+    }
+    u->cq_map = u->sq_map;
+    if (u->cq_map_len)
+    {
+        u->cq_map = mmap(NULL, u->cq_map_len, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, u->fd,
+                         IORING_OFF_CQ_RING);
+        if (u->cq_map == MAP_FAILED)
+        {
+            u->cq_map = NULL;
+            goto fail;
+        }
+    }
+    u->sqes_len = p.sq_entries * sizeof(struct io_uring_sqe);
+    u->sqes = mmap(NULL, u->sqes_len, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, u->fd,
+                   IORING_OFF_SQES);
+    if (u->sqes == MAP_FAILED)
+    {
+        u->sqes = NULL;
+        goto fail;
+    }
+
+    char *sq = u->sq_map, *cq = u->cq_map;
+    u->sq_head = (unsigned *)(sq + p.sq_off.head);
+    u->sq_tail = (unsigned *)(sq + p.sq_off.tail);
+    u->sq_mask = (unsigned *)(sq + p.sq_off.ring_mask);
+    u->sq_array = (unsigned *)(sq + p.sq_off.array);
+    u->sq_entries = p.sq_entries;
+    u->sq_local = *u->sq_tail;
+    u->cq_head = (unsigned *)(cq + p.cq_off.head);
+    u->cq_tail = (unsigned *)(cq + p.cq_off.tail);
+    u->cq_mask = (unsigned *)(cq + p.cq_off.ring_mask);
+    u->cqes = (struct io_uring_cqe *)(cq + p.cq_off.cqes);
+    u->cq_entries = p.cq_entries;
+    return 0;
+fail:
+    uring_free(u);
+    return -1;
+}
+
+void uring_free(struct uring *u)
+{
+    if (u->sqes)
+        munmap(u->sqes, u->sqes_len);
+    if (u->cq_map && u->cq_map != u->sq_map)
+        munmap(u->cq_map, u->cq_map_len);
+    if (u->sq_map)
+        munmap(u->sq_map, u->sq_map_len);
+    if (u->fd >= 0)
+        close(u->fd);
+    memset(u, 0, sizeof(*u));
+    u->fd = -1;
+}
+
+int uring_register_buffers(struct uring *u, const struct iovec *iov, unsigned n)
+{
+    return (int)syscall(__NR_io_uring_register, u->fd, IORING_REGISTER_BUFFERS, iov, n);
+}
+
+/* queued: записи, поставленные в SQ, но ещё не забранные ядром */
+static unsigned queued(const struct uring *u)
+{
+    return u->sq_local - load_acq(u->sq_head);
+}
+
+int uring_room(const struct uring *u, unsigned n)
+{
+    return u->sq_entries - queued(u) >= n && u->inflight + queued(u) + n <= u->cq_entries;
+}
+
+int uring_reserve(struct uring *u, unsigned n)
+{
+    if (n > u->sq_entries)
+        return -1;
+    while (!uring_room(u, n))
+    {
+        int sq_full = u->sq_entries - queued(u) < n;
+        if (uring_submit(u, !sq_full) < 0) // SQ освобождает отправка, CQ - завершения
+            return -1;
+    }
+    return 0;
+}
+
+struct io_uring_sqe *uring_sqe(struct uring *u, struct uring_op *op)
+{
+    if (!uring_room(u, 1))
+        return NULL;
+    unsigned idx = u->sq_local & *u->sq_mask;
+    struct io_uring_sqe *sqe = &u->sqes[idx];
+    memset(sqe, 0, sizeof(*sqe));
+    sqe->user_data = (uint64_t)(uintptr_t)op;
+    u->sq_array[idx] = idx;
+    u->sq_local++;
+    return sqe;
+}
+
+/* reap: обрабатывает все готовые завершения. Возвращает их число. */
+static unsigned reap(struct uring *u)
+{
+    unsigned n = 0;
+    unsigned head = *u->cq_head;
+    while (head != load_acq(u->cq_tail))
+    {
+        struct io_uring_cqe *cqe = &u->cqes[head & *u->cq_mask];
+        struct uring_op *op = (struct uring_op *)(uintptr_t)cqe->user_data;
+        int res = cqe->res;
+        store_rel(u->cq_head, ++head); // Запись CQ свободна
+        u->inflight--;
+        n++;
+        op->done(op, res); // Может поставить новые записи в SQ (но не отправляет их)
+    }
+    return n;
+}
+
+int uring_submit(struct uring *u, int wait)
+{
+    int got = 0; // Уже обработали хотя бы одно завершение
+    while (1)
+    {
+        store_rel(u->sq_tail, u->sq_local); // Публикуем новые записи для ядра
+        unsigned to_submit = queued(u);
+        int need_wait = wait && !got && u->inflight + to_submit > 0;
+        if (to_submit == 0 && !need_wait)
+            return 0;
+        uint64_t t0 = need_wait ? st_now() : 0;
+        int r = sys_enter(u->fd, to_submit, need_wait ? 1 : 0, need_wait ? IORING_ENTER_GETEVENTS : 0);
+        if (need_wait)
+            st_account(u->st_wait, t0, 0);
+        if (r < 0)
+        {
+            if (errno != EINTR && errno != EAGAIN && errno != EBUSY)
+                return -1;
+            r = 0; // Прервано или ядро занято - обрабатываем завершения и повторяем
+        }
+        u->inflight += (unsigned)r; // Без SQPOLL ядро забирает записи прямо в io_uring_enter
+        if (reap(u) > 0)
+            got = 1; // Колбэки могли поставить новые записи - отправим их на следующем круге
+    }
+}
@@ -0,0 +1,65 @@
+#ifndef URING_H
+#define URING_H
+
+#include <sys/types.h>
+#include <sys/uio.h>
+#include <stdint.h>
+#include <stddef.h>
+#include <linux/io_uring.h>
+
+/* Минимальная обёртка над io_uring на системных вызовах (без liburing).
+   Каждая операция описывается struct uring_op, встроенной в структуру владельца:
+   её адрес уходит в user_data, и по завершении вызывается op->done с результатом. */
+
+struct uring_op
+{
+    void (*done)(struct uring_op *op, int res); // Вызывается из uring_submit
+};
+
+/* uring: кольца отправки (SQ) и завершения (CQ), отображённые из ядра */
+struct uring
+{
+    int fd;
+    /* SQ */
+    unsigned *sq_head, *sq_tail, *sq_mask, *sq_array;
+    unsigned sq_entries;
+    unsigned sq_local; // Хвост с ещё не отправленными в ядро записями
+    struct io_uring_sqe *sqes;
+    /* CQ */
+    unsigned *cq_head, *cq_tail, *cq_mask;
+    struct io_uring_cqe *cqes;
+    /* Отображения */
+    void *sq_map, *cq_map;
+    size_t sq_map_len, cq_map_len, sqes_len;
+    unsigned cq_entries;
+    unsigned inflight; // Отправлено и ещё не завершено
+    int st_wait;       // Запись статистики "uring.wait" (stats.h)
+};
+
+/* uring_init: создаёт кольцо на entries записей. -1, если io_uring недоступен
+   (старое ядро, запрет seccomp или io_uring_disabled) - тогда нужен обычный путь. */
+int uring_init(struct uring *u, unsigned entries);
+
+void uring_free(struct uring *u);
+
+/* uring_register_buffers: регистрирует буферы для READ_FIXED/WRITE_FIXED (индекс = номер в iov) */
+int uring_register_buffers(struct uring *u, const struct iovec *iov, unsigned n);
+
+/* uring_reserve: обеспечивает n свободных записей SQ, отправляя накопленное и при необходимости
+   дожидаясь завершений. Записи, взятые после него, уйдут в ядро одним вызовом - так цепочка
+   IOSQE_IO_LINK не разрывается. 0 или -1. Из колбэков не вызывается. */
+int uring_reserve(struct uring *u, unsigned n);
+
+/* uring_room: есть n свободных записей SQ, а завершений в полёте останется не больше, чем вмещает
+   CQ (иначе ядру пришлось бы их придерживать). Для колбэков, где uring_reserve недоступен. */
+int uring_room(const struct uring *u, unsigned n);
+
+/* uring_sqe: свободная запись SQ (заполнена нулями) с привязанной операцией op, NULL - места нет.
+   В ядро уходит при следующем uring_submit. */
+struct io_uring_sqe *uring_sqe(struct uring *u, struct uring_op *op);
+
+/* uring_submit: отправляет записи в ядро и обрабатывает готовые завершения (вызывая op->done).
+   wait - дождаться хотя бы одного завершения, если что-то в полёте. 0 или -1 при ошибке. */
+int uring_submit(struct uring *u, int wait);
+
+#endif
@@ -0,0 +1,242 @@
+#define _GNU_SOURCE
+#include <unistd.h>
+#include <stdlib.h>
+#include <string.h>
+#include <getopt.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <stdio.h>
+
+#include "worker_core.h"
+#include "stats.h"
+#include "jobs.h"
+#include "topology.h"
+
+/* Процесс-обработчик: разбирает параметры и запускает обработку (worker_core.h).
+   Тот же обработчик работает потоком родителя в режиме parent --threads, а в пуле
+   parent --daemon - процессом, который выполняет задание за заданием (-J). */
+
+/* dump_stats: по SIGUSR1 - статистика обработчика в stderr */
+static void dump_stats(void)
+{
+    st_cpu();
+    st_dump(2, st_self, 1);
+}
+
+/* place: -A NODE:CPUS - обработчик занимает свои процессоры (помощники наследуют набор) и
+   отмечает их в статистике. 0 или -1 (ошибка разбора). */
+static int place(const char *spec)
+{
+    char *end;
+    int node = (int)strtol(spec, &end, 10);
+    cpu_set_t set;
+    if (end == spec || *end != ':' || tp_parse(end + 1, &set) < 0)
+        return -1;
+    if (sched_setaffinity(0, sizeof(set), &set) < 0)
+    {
+        wlog("sched_setaffinity failed\n");
+        return 0;
+    }
+    char list[ST_CPUS];
+    tp_format(&set, list, sizeof(list));
+    st_place(list, node);
+    return 0;
+}
+
+/* close_fds: закрывает дескрипторы негодного задания */
+static void close_fds(const int *fds, int n)
+{
+    for (int i = 0; i < n; ++i)
+        close(fds[i]);
+}
+
+/* serve: режим пула демона - задания JOB_WORK приходят по сокету sock (jobs.h): вход задания
+   (канал с фреймами или кольцо), stdout клиента и, если он открылся, выходной файл. На каждое
+   задание - worker_run, затем ответ JOB_DONE. Процесс живёт, пока демон не закроет сокет. */
+static int serve(const struct worker_conf *base, int sock)
+{
+    /* Между заданиями stdin и stdout - /dev/null: номера 0 и 1 не достанутся чужим
+       дескрипторам, а stdout клиента отпускается сразу по окончании задания */
+    int null = open("/dev/null", O_RDWR | O_CLOEXEC);
+    if (null < 0 || dup2(null, 0) < 0 || dup2(null, 1) < 0)
+    {
+        wlog("dup2 failed\n");
+        return 1;
+    }
+    signal(SIGPIPE, SIG_IGN); // Закрытый клиентом stdout - ошибка задания, а не конец обработчика
+    while (1)
+    {
+        struct job_hdr h;
+        int fds[JOB_MAX_FDS];
+        int nfds = 0;
+        int r = job_recv(sock, &h, fds, JOB_MAX_FDS, &nfds);
+        if (r == 0) // Демон завершился
+            return 0;
+        int nin = (h.flags & JOB_SHM) ? 3 : 1; // Кольцо - три дескриптора, канал - один
+        int nfile = (h.flags & JOB_FILE) ? 1 : 0;
+        if (r < 0 || h.kind != JOB_WORK || nfds != nin + 1 + nfile)
+        {
+            close_fds(fds, r > 0 ? nfds : 0);
+            wlog("bad job message\n");
+            return 1;
+        }
+
+        struct worker_conf c = *base;
+        char spec[64];
+        c.utf8 = (h.flags & JOB_UTF8) != 0;
+        if (h.flags & JOB_SHM)
+        {
+            snprintf(spec, sizeof(spec), "shm:%d,%d,%d", fds[0], fds[1], fds[2]);
+            c.spec = spec;
+        }
+        else
+        {
+            dup2(fds[0], 0); // Фреймы читаются из stdin
+            close(fds[0]);
+            c.spec = "frames";
+        }
+        dup2(fds[nin], 1);
+        close(fds[nin]);
+        c.out_file = NULL;
+        c.file_fd = nfile ? fds[nin + 1] : -1;
+
+        h.kind = JOB_DONE;
+        h.status = worker_run(&c);
+        dup2(null, 0); // Вход и stdout клиента больше не держим
+        dup2(null, 1);
+        if (job_send(sock, &h, NULL, 0) < 0)
+            return 1;
+    }
+}
+
+int main(int argc, char *argv[])
+{
+    /* Имя обработчика: задано при сборке (child1/child2) или берётся из argv[0],
+       который родитель выставляет в "childN" */
+#ifdef WORKER_NAME
+    const char *worker_name = WORKER_NAME;
+#else
+    const char *slash = strrchr(argv[0], '/');
+    const char *worker_name = slash ? slash + 1 : argv[0];
+#endif
+    wlog_name(worker_name);
+
+    /* -T SPEC: откуда и в каком виде приходит вход (см. src_open в transport.h):
+       "frames" - фреймы из stdin, "shm:..." - кольцо в разделяемой памяти.
+       -F - то же, что -T frames. Без параметров - обычные строки из stdin.
+       -u: разворот по символам UTF-8 (многобайтные символы не разрушаются).
+       -B KiB, -L ms: буфер вывода и наибольшая задержка строки в нём (см. output.h);
+       -t: файл пишется один раз, в stdout данные дублируются через tee(), если stdout - канал;
+       -I: чтение и запись через io_uring (если ядро его не даёт - обычные read/writev);
+       -M SIZE:PATH: записи - описатели строк файла PATH (line_index.h), выходной файл
+       отображается в память, SIZE - его размер, если известен (0 - нет);
+       -S FD:SLOT: счётчики (stats.h) ведутся в слоте SLOT общей памяти родителя FD;
+       -J FD: режим пула parent --daemon - задания приходят по сокету FD, имя файла не нужно;
+       -z LEVEL: файл сжимается gzip (уровень 1..9), -Z N - не больше N потоков сжатия;
+       -H BYTES: ожидаемый размер файла (место выделяется заранее), -O: запись с O_DIRECT,
+       -W MiB: окно фоновой записи, -Y SYNC: политика sync (none|close|periodic[:MiB],
+       см. file_sink.h);
+       -G MiB: строка длиннее собирается во временном файле, а не в памяти (см. spill.h);
+       -R N: не больше N потоков-помощников разворота длинных строк (см. rev_pool.h);
+       -x CHAIN: цепочка преобразований строк вместо разворота (см. transform.h);
+       -K MiB: кэш результатов повторяющихся строк (см. line_cache.h);
+       -A NODE:CPUS: процессоры обработчика (список "0-3,8") и их узел NUMA (см. topology.h). */
+    struct worker_conf c = {
+        .name = worker_name,
+        .out_fd = 1,
+        .out_deadline_ms = -1,
+        .gzip_threads = -1,
+        .rev_threads = -1,
+    };
+    const char *stats_spec = NULL;
+    const char *place_spec = NULL;
+    int job_sock = -1;
+    int opt;
+    while ((opt = getopt(argc, argv, "FT:uB:L:tIM:S:J:z:Z:H:OW:Y:G:R:x:K:A:")) != -1)
+    {
+        if (opt == 'F')
+            c.spec = "frames";
+        else if (opt == 'u')
+            c.utf8 = 1;
+        else if (opt == 'B')
+            c.out_bytes = (size_t)strtoul(optarg, NULL, 10) * 1024;
+        else if (opt == 'L')
+            c.out_deadline_ms = atoi(optarg);
+        else if (opt == 't')
+            c.tee = 1;
+        else if (opt == 'I')
+            c.io_uring = 1;
+        else if (opt == 'M')
+        {
+            char *path;
+            c.map_size = (size_t)strtoull(optarg, &path, 10);
+            if (*path != ':')
+            {
+                wlog("input file mapping failed\n");
+                return 1;
+            }
+            c.map_path = path + 1;
+        }
+        else if (opt == 'S')
+            stats_spec = optarg;
+        else if (opt == 'J')
+            job_sock = atoi(optarg);
+        else if (opt == 'z')
+            c.gzip_level = atoi(optarg);
+        else if (opt == 'Z')
+            c.gzip_threads = atoi(optarg);
+        else if (opt == 'H')
+            c.file.size_hint = strtoull(optarg, NULL, 10);
+        else if (opt == 'O')
+            c.file.direct = 1;
+        else if (opt == 'W')
+            c.file.writeback_bytes = strtoull(optarg, NULL, 10) * 1024 * 1024;
+        else if (opt == 'Y')
+        {
+            if (fs_parse_sync(optarg, &c.file) < 0)
+            {
+                wlog("invalid sync policy\n");
+                return 1;
+            }
+        }
+        else if (opt == 'G')
+            c.spill_limit = (size_t)strtoull(optarg, NULL, 10) * 1024 * 1024;
+        else if (opt == 'R')
+            c.rev_threads = atoi(optarg);
+        else if (opt == 'x')
+            c.xform = optarg;
+        else if (opt == 'A')
+            place_spec = optarg;
+        else if (opt == 'K')
+            c.cache_bytes = (size_t)strtoull(optarg, NULL, 10) * 1024 * 1024;
+        else if (opt == 'T')
+            c.spec = optarg;
+        else
+            return 1;
+    }
+
+    /* Статистика: в слоте родителя (он соберёт общий отчёт) или в своей памяти */
+    struct stats *slot = stats_spec ? st_attach(stats_spec) : NULL;
+    if (stats_spec && !slot)
+        wlog("stats slot unavailable\n");
+    st_init(worker_name, slot);
+    st_on_signal(dump_stats);
+    if (place_spec && place(place_spec) < 0)
+    {
+        wlog("bad placement\n");
+        return 1;
+    }
+
+    if (job_sock >= 0)
+        return serve(&c, job_sock);
+
+    /* Проверяем, что программе передано имя выходного файла */
+    if (optind >= argc) // После параметров должно идти имя файла
+    {
+        wlog("no filename provided\n");
+        return 1; // Завершаем с ошибкой
+    }
+    c.out_file = argv[optind]; // Получаем имя файла из аргументов
+
+    return worker_run(&c);
+}
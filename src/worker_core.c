@@ -0,0 +1,429 @@
+#define _GNU_SOURCE
+#include <unistd.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+
+#include "worker_core.h"
+#include "transport.h"
+#include "output.h"
+#include "gzip_writer.h"
+#include "file_sink.h"
+#include "line_index.h"
+#include "spill.h"
+#include "rev_pool.h"
+#include "transform.h"
+#include "line_cache.h"
+#include "stats.h"
+
+/* write_all: гарантированная запись всех байтов в файловый дескриптор */
+static ssize_t write_all(int fd, const void *buf, size_t count)
+{
+    const char *p = buf; // Указатель на текущую позицию в буфере
+    size_t left = count; // Количество байт, которые ещё нужно записать
+    while (left > 0)     // Пока есть данные для записи
+    {
+        ssize_t w = write(fd, p, left); // Пытаемся записать оставшиеся байты
+        if (w < 0)                      // Если произошла ошибка
+        {
+            if (errno == EINTR) // Если вызов был прерван сигналом
+                continue;       // Повторяем попытку
+            return -1;          // Возвращаем ошибку
+        }
+        left -= (size_t)w; // Уменьшаем счётчик оставшихся байт
+        p += w;            // Сдвигаем указатель
+    }
+    return (ssize_t)count; // Возвращаем количество записанных байт
+}
+
+/* eprint: выводит сообщение об ошибке в stderr */
+static void eprint(const char *s)
+{
+    if (s)                          // Если строка не NULL
+        write_all(2, s, strlen(s)); // Выводим в stderr (fd=2)
+}
+
+static __thread const char *worker_name = "worker"; // Префикс сообщений (свой у каждого потока --threads)
+
+void wlog_name(const char *name)
+{
+    worker_name = name;
+}
+
+void wlog(const char *s)
+{
+    eprint(worker_name);
+    eprint(": ");
+    eprint(s);
+}
+
+/* report: сообщает об ошибках вывода (маска OUT_ERR_*); приёмник с ошибкой отключается,
+   поэтому каждая ошибка выводится один раз */
+static void report(int err)
+{
+    if (err & OUT_ERR_STDOUT)
+        wlog("write stdout failed\n");
+    if (err & OUT_ERR_FILE)
+        wlog("write file failed\n");
+}
+
+/* emit_out: отрезок развёрнутой строки из временного файла (sp_emit) - в вывод */
+static void emit_out(void *arg, const char *p, size_t n)
+{
+    report(ow_add(arg, p, n));
+}
+
+#define OM_MIN_BYTES (1024 * 1024) // Шаг роста выходного файла, размер которого не известен заранее
+
+/* out_map: режим -M - выходной файл, отображённый в память. Строка копируется из отображения
+   входного файла сразу на своё место в выходном и разворачивается там. Размер файла выделяется
+   заранее (fallocate), если родитель его знает (режим rr), иначе файл растёт удвоением. */
+struct out_map
+{
+    int fd;      // Выходной файл (-1 - нет: строки разворачиваются во временном буфере)
+    char *p;     // Отображение или временный буфер
+    size_t cap;  // Его размер
+    size_t end;  // Конец записанных строк
+};
+
+/* om_reserve: отображение покрывает первые need байт файла. 0 или -1. */
+static int om_reserve(struct out_map *m, size_t need)
+{
+    if (need <= m->cap)
+        return 0;
+    size_t ncap = m->cap * 2; // Не мельче шага и не меньше нужного
+    if (ncap < OM_MIN_BYTES)
+        ncap = OM_MIN_BYTES;
+    if (ncap < need)
+        ncap = need;
+    if (m->fd < 0) // Временный буфер под одну строку
+    {
+        char *nb = realloc(m->p, ncap);
+        if (!nb)
+            return -1;
+        m->p = nb;
+        m->cap = ncap;
+        return 0;
+    }
+    /* Блоки выделяются сразу: запись через отображение не ждёт выделения на каждой странице */
+    if (fallocate(m->fd, 0, 0, (off_t)ncap) < 0 && ftruncate(m->fd, (off_t)ncap) < 0)
+        return -1;
+    void *np = m->p ? mremap(m->p, m->cap, ncap, MREMAP_MAYMOVE)
+                    : mmap(NULL, ncap, PROT_READ | PROT_WRITE, MAP_SHARED, m->fd, 0);
+    if (np == MAP_FAILED)
+        return -1;
+    m->p = np;
+    m->cap = ncap;
+    return 0;
+}
+
+/* om_close: снимает отображение и обрезает файл по записанным строкам */
+static void om_close(struct out_map *m)
+{
+    if (m->fd < 0)
+    {
+        free(m->p);
+        return;
+    }
+    if (m->p)
+        munmap(m->p, m->cap);
+    if (ftruncate(m->fd, (off_t)m->end) < 0) // Лишнее после роста удвоением
+        wlog("truncate output failed\n");
+}
+
+/* map_line: по описателю строки копирует её из входного файла в выходной.
+   Возвращает длину строки и её место в *line, -1 - повреждённый описатель. */
+static ssize_t map_line(const char *in, size_t in_size, struct out_map *m, const char *rec, ssize_t len,
+                        char **line)
+{
+    struct line_desc d;
+    if (len != (ssize_t)sizeof(d))
+        return -1;
+    memcpy(&d, rec, sizeof(d)); // Запись во фрейме может быть невыровненной
+    if (d.in_off > in_size || d.len > in_size - d.in_off)
+        return -1;
+    uint64_t off = m->fd >= 0 ? d.out_off : 0;
+    if (om_reserve(m, (size_t)(off + d.len)) < 0)
+    {
+        if (m->fd < 0)
+            return -1;
+        wlog("write file failed\n"); // Дальше - только stdout, строки во временном буфере
+        if (m->p)
+            munmap(m->p, m->cap);
+        m->fd = -1;
+        m->p = NULL;
+        m->cap = 0;
+        off = 0;
+        if (om_reserve(m, d.len) < 0)
+            return -1;
+    }
+    char *dst = m->p + off;
+    memcpy(dst, in + d.in_off, d.len);
+    if (m->fd >= 0 && off + d.len > m->end)
+        m->end = (size_t)(off + d.len);
+    *line = dst;
+    return (ssize_t)d.len;
+}
+
+/* map_input: отображает входной файл режима -M. 0 или -1. */
+static int map_input(const char *path, const char **map, size_t *size)
+{
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    struct stat st;
+    if (fd < 0 || fstat(fd, &st) < 0)
+    {
+        if (fd >= 0)
+            close(fd);
+        return -1;
+    }
+    *size = (size_t)st.st_size;
+    *map = NULL;
+    if (*size > 0)
+    {
+        void *p = mmap(NULL, *size, PROT_READ, MAP_SHARED, fd, 0);
+        if (p == MAP_FAILED)
+        {
+            close(fd);
+            return -1;
+        }
+        *map = p;
+    }
+    close(fd);
+    return 0;
+}
+
+int worker_run(const struct worker_conf *c)
+{
+    wlog_name(c->name);
+
+    /* Что делать со строками: цепочка преобразований (по умолчанию - разворот) */
+    struct xform xf;
+    if (xf_parse(&xf, c->xform ? c->xform : XF_DEFAULT, c->utf8) < 0)
+    {
+        wlog("bad transform chain\n");
+        return 1;
+    }
+    if (c->map_path && !xf_same_length(&xf)) // Место строки в файле -M задано её исходной длиной
+    {
+        wlog("transform chain changes line length\n");
+        return 1;
+    }
+
+    /* Открываем файл для записи (для отображения в память нужен и доступ на чтение);
+       в режиме демона файл уже открыт клиентом */
+    int fd = c->out_file ? open(c->out_file, (c->map_path ? O_RDWR : O_WRONLY) | O_CREAT | O_TRUNC, 0644) : c->file_fd;
+    // O_WRONLY - только запись, O_CREAT - создать если нет, O_TRUNC - очистить если есть
+    // 0644 - права доступа (rw-r--r--)
+    if (fd < 0 && c->out_file) // Если не удалось открыть файл
+    {
+        wlog("open failed\n");
+        fd = -1; // Устанавливаем fd в -1 (будем писать только в stdout)
+    }
+
+    /* Режим -M: отображения входного и выходного файлов */
+    const char *in_map = NULL;
+    size_t in_size = 0;
+    struct out_map om = {fd, NULL, 0, 0};
+    if (c->map_path)
+    {
+        if (map_input(c->map_path, &in_map, &in_size) < 0)
+        {
+            wlog("input file mapping failed\n");
+            if (fd >= 0)
+                close(fd);
+            return 1;
+        }
+        if (fd >= 0 && c->map_size > 0 && om_reserve(&om, c->map_size) < 0) // Файл целиком - сразу
+        {
+            wlog("write file failed\n");
+            om.fd = -1;
+        }
+    }
+
+    /* Источник строк: один буфер на всё время работы */
+    struct source in;
+    if (src_open(&in, c->spec) < 0)
+    {
+        wlog("input setup failed\n");
+        if (fd >= 0)
+            close(fd);
+        return 1;
+    }
+
+    /* Вывод: строки копятся в буфере и уходят в stdout и файл крупными порциями
+       (в режиме -M файл пишется через отображение, буфер - только для stdout).
+       Файл пишет слой file_sink (со сжатием - через конвейер gzip); tee() и io_uring
+       пишут файл сами, мимо него */
+    struct out_writer out;
+    struct file_sink fs;
+    struct gzip_writer gz;
+    int gzip = fd >= 0 && c->gzip_level > 0 && !c->map_path;
+    int sink = fd >= 0 && !c->map_path && (gzip || (!c->tee && !c->io_uring));
+    int ok = !sink || fs_init(&fs, fd, &c->file) == 0;
+    if (ok && gzip && gzw_init(&gz, &fs, c->gzip_level, c->gzip_threads) < 0)
+    {
+        fs_free(&fs);
+        ok = 0;
+    }
+    if (ok && ow_init(&out, c->out_fd, c->map_path || sink ? -1 : fd, c->out_bytes, c->out_deadline_ms, c->tee) < 0)
+    {
+        if (gzip)
+            gzw_free(&gz);
+        if (sink)
+            fs_free(&fs);
+        ok = 0;
+    }
+    if (!ok)
+    {
+        wlog("out of memory\n");
+        src_close(&in);
+        if (fd >= 0)
+            close(fd);
+        return 1;
+    }
+    if (gzip)
+        ow_use_gzip(&out, &gz);
+    else if (sink)
+        ow_use_sink(&out, &fs);
+
+    /* Учитываемые дескрипторы: ожидание ввода, запись в stdout и в файл */
+    if (in.kind == SOURCE_SHM)
+        st_watch(in.ring.data_efd, ST_RD, "ring.wait");
+    else
+        st_watch(0, ST_RD, "stdin.read");
+    st_watch(c->out_fd, ST_WR, "stdout.write");
+    if (fd >= 0 && !c->map_path)
+        st_watch(fd, ST_WR, "file.write");
+
+    /* io_uring: ядро читает следующую порцию ввода и пишет прошлые буферы вывода, пока
+       разворачиваются текущие строки */
+    struct uring ring;
+    ring.fd = -1;
+    if (c->io_uring)
+    {
+        if (uring_init(&ring, 64) < 0)
+            wlog("io_uring unavailable, using read/write\n");
+        else if (ow_use_uring(&out, &ring) < 0)
+        {
+            wlog("io_uring output unavailable, using read/write\n");
+            uring_free(&ring);
+        }
+        else
+            src_use_uring(&in, &ring);
+    }
+
+    /* Длинные строки приходят кусками: собираются в памяти или во временном файле
+       (если строку после цепочки можно выдать отрезками с конца файла) */
+    struct spill sp;
+    sp_init(&sp, xf_spillable(&xf) ? c->spill_limit : SIZE_MAX);
+
+    /* Строку длиннее REV_PAR_MIN разворачивают несколько потоков */
+    struct rev_pool rp;
+    rp_init(&rp, c->rev_threads);
+
+    /* Кэш результатов для повторяющихся строк (в режиме -M строка уже лежит на своём месте
+       в выходном файле - кэш ей не нужен) */
+    struct line_cache lc;
+    if (lc_init(&lc, c->map_path ? 0 : c->cache_bytes) < 0)
+        wlog("cache disabled: out of memory\n");
+
+    /* Основной цикл обработки строк */
+    while (1) // Читаем строки до EOF
+    {
+        if (!src_ready(&in)) // Сейчас будем ждать ввода - сначала отдаём накопленное
+        {
+            report(ow_flush(&out));
+            st_cpu(); // Родитель видит время процессора на момент последнего простоя
+        }
+
+        char *line = NULL;                 // Указатель на очередную строку (внутри буфера источника)
+        ssize_t rl = src_next(&in, &line); // Очередная строка из pipe или кольца
+        if (rl < 0)                        // Если произошла ошибка чтения
+        {
+            wlog("read error\n");
+            break; // Прерываем цикл
+        }
+        if (rl == 0 && !sp_active(&sp)) // Если достигнут конец данных (родитель закрыл канал)
+            break;   // Выходим из цикла (собираемая строка, оборванная концом данных, - ниже)
+        if (c->map_path && (rl = map_line(in_map, in_size, &om, line, rl, &line)) < 0) // Описатель -> строка
+        {
+            wlog("bad line descriptor\n");
+            break;
+        }
+        if (src_more(&in) || sp_active(&sp)) // Кусок длинной строки
+        {
+            if (sp_add(&sp, line, (size_t)rl) < 0)
+            {
+                wlog("spill failed\n");
+                break;
+            }
+            if (src_more(&in)) // Строка ещё не закончилась
+                continue;
+            if (sp_spilled(&sp)) // Строка в файле - выводится развёрнутой отрезками с конца
+            {
+                st_line((size_t)sp_length(&sp));
+                if (sp_emit(&sp, c->utf8, xf.step[0].fold, emit_out, &out) < 0) // План - один разворот
+                {
+                    wlog("spill failed\n");
+                    break;
+                }
+                continue;
+            }
+            rl = (ssize_t)sp_take(&sp, &line); // Собрана в памяти - дальше как обычная
+        }
+
+        st_line((size_t)rl);
+        const char *hit;
+        ssize_t hit_len;
+        if (lc_get(&lc, line, (size_t)rl, &hit, &hit_len)) // Такая строка уже была
+        {
+            if (hit_len >= 0)
+                report(ow_add(&out, hit, (size_t)hit_len));
+            continue;
+        }
+        rl = xf_apply(&xf, &rp, &line, (size_t)rl); // Преобразуем строку прямо в буфере источника
+        lc_put(&lc, line, rl);
+        if (rl < 0) // Отброшена фильтром
+            continue;
+
+        /* Выводим преобразованную строку в stdout и в файл (если он открыт) */
+        report(ow_add(&out, line, (size_t)rl));
+    }
+    sp_free(&sp);
+    rp_free(&rp);
+    lc_free(&lc);
+    report(ow_close(&out)); // Остаток буфера и записи в полёте
+    ow_free(&out);
+    if (sink)
+    {
+        int failed = gzip ? out.gz == NULL : out.sink == NULL; // Ошибку записи уже сообщил ow_add
+        int err = gzip && gzw_close(&gz) < 0; // Последний блок и сжатые в полёте
+        err |= fs_close(&fs) < 0;             // Хвост файла и политика sync
+        if (err && !failed)
+            report(OUT_ERR_FILE);
+        if (gzip)
+            gzw_free(&gz);
+        fs_free(&fs);
+    }
+    src_close(&in); // Освобождаем буфер источника
+    if (ring.fd >= 0)
+        uring_free(&ring);
+    if (c->map_path)
+    {
+        om_close(&om);
+        if (in_map)
+            munmap((void *)in_map, in_size);
+    }
+
+    /* Закрываем файл если он был открыт (номер может достаться другому дескриптору) */
+    if (fd >= 0)
+    {
+        st_unwatch(fd);
+        close(fd);
+    }
+    st_cpu(); // Итог для отчёта родителя
+    return 0;
+}
@@ -0,0 +1,48 @@
+#ifndef WORKER_CORE_H
+#define WORKER_CORE_H
+
+#include <sys/types.h>
+#include <stddef.h>
+
+#include "file_sink.h"
+
+/* Обработчик строк: читает источник, преобразует строки (по умолчанию - разворачивает) и пишет
+   их в свой файл и в stdout.
+   Работает как отдельный процесс (worker.c разбирает параметры из argv) или как поток
+   родителя (parent --threads) - поведение и вывод одинаковые. */
+
+/* worker_conf: параметры одного обработчика */
+struct worker_conf
+{
+    const char *name;     // Имя для сообщений: child1, child2, ...
+    const char *spec;     // Источник строк (см. src_open): NULL, "frames" или "shm:..."
+    const char *out_file; // Выходной файл (NULL - уже открыт, см. file_fd)
+    int file_fd;          // Открытый выходной файл при out_file == NULL (-1 - нет); закрывается здесь
+    int out_fd;           // Куда идёт вывод помимо файла: stdout или канал возврата (--ordered)
+    int utf8;             // Разворот по символам UTF-8
+    const char *xform;    // Цепочка преобразований строк (см. transform.h); NULL - разворот
+    size_t out_bytes;     // Буфер вывода (0 - по умолчанию, см. output.h)
+    int out_deadline_ms;  // Наибольшая задержка строки в буфере (<0 - по умолчанию)
+    int tee;              // Файл пишется один раз, stdout дублируется через tee()
+    int io_uring;         // Чтение и запись через io_uring
+    const char *map_path; // Записи - описатели строк этого файла (line_index.h); NULL - сами строки
+    size_t map_size;      // Размер выходного файла, если известен заранее (0 - нет)
+    int gzip_level;       // Файл сжимается gzip с этим уровнем (1..9); 0 - пишется как есть
+    int gzip_threads;     // Предел потоков сжатия (<0 - по числу процессоров, см. gzip_writer.h)
+    struct fs_conf file;  // Запись файла: подсказка размера, O_DIRECT, фоновая запись, sync
+    size_t spill_limit;   // Строка длиннее собирается во временном файле (0 - по умолчанию, см. spill.h)
+    size_t cache_bytes;   // Кэш результатов повторяющихся строк, байт (0 - нет, см. line_cache.h)
+    int rev_threads;      // Предел помощников разворота длинных строк (<0 - по числу процессоров, см. rev_pool.h)
+};
+
+/* worker_run: обрабатывает строки до конца данных. Статистика ведётся в st_self вызывающего
+   потока (stats.h). Возвращает код завершения: 0 или 1 при ошибке настройки. */
+int worker_run(const struct worker_conf *c);
+
+/* wlog_name: префикс сообщений wlog в вызывающем потоке (worker_run ставит conf->name) */
+void wlog_name(const char *name);
+
+/* wlog: сообщение об ошибке в stderr с префиксом имени обработчика */
+void wlog(const char *s);
+
+#endif